@@ -0,0 +1,953 @@
+//-----------------------------------------------------------------------------
+// name: accuracy.c
+// desc: accuracy-vs-speed harness - the fast chain against the
+//       double-precision reference, stage by stage, with error budgets
+//
+//   every stage of engine_process() is fed the reference's own input for
+//   that stage (rounded to float) and compared with the reference output,
+//   so each row is that stage's error alone: fft, magnitude, phase, the
+//   16-bit loop cache round trip, peak decisions, harmonics, cartesian and
+//   inverse fft.  the whole chain is then run end to end on each item of a
+//   fixed synthetic corpus, once with harmonics off (bypass: transforms
+//   only) and once on (output).  with harmonics on a peak decision that
+//   flips near the threshold changes what is added and feeds back through
+//   the previous frame, and harmonics added onto an empty bin take the
+//   phase of its rounding noise; so for the output row the reference runs
+//   in lockstep with the fast chain and takes its decisions on ties and its
+//   phases below the spectral floor (reference_engine.match).  what is left
+//   is rounding and flips outside ties.
+//
+//   reported per stage: SNR (reference energy over error energy), max abs
+//   error and spectral error (rms dB difference of magnitude spectra over
+//   the bins within 120 dB of the frame peak); phase is weighted by
+//   magnitude, peaks report the fraction of flipped decisions (ties within
+//   DECISION_TOLERANCE of the curve left out).  each stage has a declared
+//   budget below; a fast path (approximate atan2 or sincos, simd ffts,
+//   fused stages) is adopted only if this still exits 0.  a table goes to
+//   stderr and JSON to stdout.
+//
+//   golden files (-W) hold the reference bypass and output of each corpus
+//   item for a window size, as 2-channel double wav, with their checksums
+//   in golden_dir/w<window>.sum; -C checks the live reference against
+//   those checksums, which catches a drifting reference (libm, compiler
+//   flags).  golden/w1024.sum is the manifest for the default window,
+//   from the build line below on x86-64; flags that allow fma contraction
+//   (-march=native) move the reference by more than rounding to float
+//   hides, and -C reports that as drift.
+//
+//   build:
+//     gcc -O2 -std=gnu99 -o accuracy accuracy.c reference.c engine.c
+//         fft.c fft_plan.c arena.c loopcache.c waveshaper.c partials.c pool.c
+//         realtime.c -lsndfile -lpthread -lm
+//   run:
+//     ./accuracy [-w window] [-W golden_dir | -C golden_dir] > accuracy.json
+//     ./accuracy -C golden
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <sndfile.h>
+#include "fft.h"
+#include "engine.h"
+#include "reference.h"
+#include "loopcache.h"
+
+#define CORPUS_RATE         44100.0
+#define CORPUS_SECONDS      4
+#define BLOCK_FRAMES        4096    // or one hop, if larger
+#define SPECTRAL_FLOOR      1e-6    // bins below -120 dB of the frame peak are not compared
+#define DECISION_TOLERANCE  1e-5    // peak decisions this close to the curve are ties
+#define GOLDEN_GAIN         0.001f  // harmonics gain of the end-to-end runs and golden files
+
+enum
+{
+    STAGE_FFT,
+    STAGE_MAGNITUDE,
+    STAGE_PHASE,
+    STAGE_LOOPCACHE,
+    STAGE_PEAKS,
+    STAGE_HARMONICS,
+    STAGE_CARTESIAN,
+    STAGE_IFFT,
+    STAGE_BYPASS,
+    STAGE_OUTPUT,
+    STAGES
+};
+
+// accumulated error of one stage
+typedef struct
+{
+    double signal, noise;       // energies of the reference and of the error
+    double max_abs;
+    double spectral_sq;         // sum of squared dB differences
+    long spectral_n;
+    long flips, decisions;
+} error_stats;
+
+// what a stage may lose; 0 leaves a metric unchecked
+typedef struct
+{
+    const char * stage;
+    double min_snr_db;
+    double max_abs;
+    double max_spectral_db;
+    double max_flip_rate;
+} error_budget;
+
+// the declared budgets.  the fp32 chain as it stands is 15-30 dB inside
+// them (w 1024: fft 138, magnitude 151, phase 145, ifft 138, bypass 133 dB
+// snr; no flipped peak outside ties); tightening one is a decision,
+// loosening one needs a reason.  the harmonics-on output, ties settled,
+// is looser: 52 dB at worst here, 38 dB (chirp) at w 16384.  the 16-bit
+// loop cache is lossy by design, 76 dB here
+static const error_budget g_budgets[STAGES] =
+{
+    { "fft",        110.0, 1e-6,    0.1,  0.0  },
+    { "magnitude",  120.0, 1e-6,    0.1,  0.0  },
+    { "phase",      90.0,  1e-4,    0.0,  0.0  },
+    { "loopcache16", 60.0, 0.0,     0.1,  0.0  },
+    { "peaks",      0.0,   0.0,     0.0,  1e-3 },
+    { "harmonics",  120.0, 1e-6,    0.1,  0.0  },
+    { "cartesian",  100.0, 1e-6,    0.1,  0.0  },
+    { "ifft",       110.0, 1e-5,    0.0,  0.0  },
+    { "bypass",     100.0, 1e-5,    0.1,  0.0  },
+    { "output",     30.0,  0.0,     1.0,  0.0  },
+};
+
+typedef struct
+{
+    const char * name;
+    void (*make)( double * x, long n );
+} corpus_item;
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: noise()
+// desc: uniform -1..1 from a fixed lcg, so the corpus is the same everywhere
+//-----------------------------------------------------------------------------
+static double noise( uint32_t * state )
+{
+    *state = *state * 1664525u + 1013904223u;
+    return ( *state >> 8 ) / 8388608.0 - 1.0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: make_*()
+// desc: the corpus
+//-----------------------------------------------------------------------------
+static void make_harmonic( double * x, long n )
+{
+    long i;
+    int p;
+
+    for( i = 0; i < n; i++ )
+    {
+        x[i] = 0.0;
+        for( p = 1; p <= 8; p++ )
+            x[i] += 0.3 / p * sin( 2.0 * M_PI * 110.0 * p * i / CORPUS_RATE );
+    }
+}
+
+static void make_chirp( double * x, long n )
+{
+    const double f0 = 20.0, f1 = 20000.0, T = n / CORPUS_RATE, k = log( f1 / f0 );
+    long i;
+
+    for( i = 0; i < n; i++ )
+    {
+        double t = i / CORPUS_RATE;
+        x[i] = 0.5 * sin( 2.0 * M_PI * f0 * T / k * ( exp( t / T * k ) - 1.0 ) );
+    }
+}
+
+static void make_noise( double * x, long n )
+{
+    uint32_t state = 1;
+    long i;
+
+    for( i = 0; i < n; i++ )
+        x[i] = 0.3 * noise( &state );
+}
+
+static void make_impulses( double * x, long n )
+{
+    long i;
+
+    for( i = 0; i < n; i++ )
+        x[i] = i % (long)( CORPUS_RATE / 4 ) == 0 ? 0.9 : 0.0;
+}
+
+static void make_quiet( double * x, long n )
+{
+    long i;
+
+    make_harmonic( x, n );
+    for( i = 0; i < n; i++ )
+        x[i] *= 1e-4;
+}
+
+static const corpus_item g_corpus[] =
+{
+    { "harmonic", make_harmonic },  // 110 Hz and 7 partials
+    { "chirp", make_chirp },        // log sweep 20 Hz - 20 kHz
+    { "noise", make_noise },        // white
+    { "impulses", make_impulses },  // clicks every 250 ms
+    { "quiet", make_quiet },        // the harmonic item at -80 dB
+};
+#define CORPUS_ITEMS    ( sizeof(g_corpus) / sizeof(g_corpus[0]) )
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: accumulate_real() / accumulate_complex()
+// desc: error of fast against reference values; spectral error over
+//       magnitudes when spectral is set, leaving out bins at or below floor
+//-----------------------------------------------------------------------------
+static void accumulate_real( error_stats * s, const float * fast, const double * ref,
+                             long n, bool spectral, double floor )
+{
+    double peak = 0.0;
+    long i;
+
+    for( i = 0; i < n; i++ )
+    {
+        double d = fast[i] - ref[i];
+        s->signal += ref[i] * ref[i];
+        s->noise += d * d;
+        if( fabs( d ) > s->max_abs ) s->max_abs = fabs( d );
+        if( fabs( ref[i] ) > peak ) peak = fabs( ref[i] );
+    }
+
+    if( !spectral || peak == 0.0 )
+        return;
+
+    for( i = 0; i < n; i++ )
+    {
+        if( fabs( ref[i] ) <= peak * SPECTRAL_FLOOR || fabs( ref[i] ) <= floor )
+            continue;
+        {
+            double db = 20.0 * log10( ( fabs( fast[i] ) + 1e-30 ) / fabs( ref[i] ) );
+            s->spectral_sq += db * db;
+            s->spectral_n++;
+        }
+    }
+}
+
+static void accumulate_complex( error_stats * s, const float * fre, const float * fim,
+                                const double * re, const double * im, long n )
+{
+    double peak = 0.0;
+    long i;
+
+    for( i = 0; i < n; i++ )
+    {
+        double dr = fre[i] - re[i], di = fim[i] - im[i];
+        double m = re[i] * re[i] + im[i] * im[i];
+        s->signal += m;
+        s->noise += dr * dr + di * di;
+        if( fabs( dr ) > s->max_abs ) s->max_abs = fabs( dr );
+        if( fabs( di ) > s->max_abs ) s->max_abs = fabs( di );
+        if( m > peak ) peak = m;
+    }
+
+    for( i = 0; i < n; i++ )
+    {
+        double m = re[i] * re[i] + im[i] * im[i];
+        double fm = (double)fre[i] * fre[i] + (double)fim[i] * fim[i];
+        if( m <= peak * SPECTRAL_FLOOR * SPECTRAL_FLOOR )
+            continue;
+        {
+            double db = 10.0 * log10( ( fm + 1e-60 ) / m );
+            s->spectral_sq += db * db;
+            s->spectral_n++;
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: accumulate_phase()
+// desc: phase error as magnitude-weighted phasor error; max abs is the
+//       wrapped angle over the bins above the floor
+//-----------------------------------------------------------------------------
+static void accumulate_phase( error_stats * s, const float * fast, const double * ref,
+                              const double * magnitude, long n )
+{
+    double peak = 0.0;
+    long i;
+
+    for( i = 0; i < n; i++ )
+        if( magnitude[i] > peak ) peak = magnitude[i];
+
+    for( i = 0; i < n; i++ )
+    {
+        double d = remainder( fast[i] - ref[i], 2.0 * M_PI );
+        double m2 = magnitude[i] * magnitude[i];
+        s->signal += m2;
+        s->noise += m2 * 2.0 * ( 1.0 - cos( d ) );
+        if( magnitude[i] > peak * SPECTRAL_FLOOR && fabs( d ) > s->max_abs )
+            s->max_abs = fabs( d );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: accumulate_signal()
+// desc: time-domain error, with the spectral error taken over hanning
+//       frames of window samples; near-silent frames are left out by a
+//       floor 120 dB under a full-scale sine at the signal's peak
+//-----------------------------------------------------------------------------
+static void accumulate_signal( error_stats * s, const float * fast, const double * ref,
+                               long n, long window )
+{
+    double * a = (double *)malloc( window * sizeof(double) );
+    double * b = (double *)malloc( window * sizeof(double) );
+    double * w = (double *)malloc( window * sizeof(double) );
+    float * af = (float *)malloc( window / 2 * sizeof(float) );
+    double * ma = (double *)malloc( window / 2 * sizeof(double) );
+    double floor = 0.0;
+    long i, j;
+
+    accumulate_real( s, fast, ref, n, false, 0.0 );
+    for( i = 0; i < n; i++ )
+        if( fabs( ref[i] ) > floor ) floor = fabs( ref[i] );
+    // a hanning-windowed sine peaks at a quarter of its amplitude here
+    floor *= 0.25 * SPECTRAL_FLOOR;
+
+    reference_hanning( w, window );
+    for( i = 0; i + window <= n; i += window / 2 )
+    {
+        for( j = 0; j < window; j++ )
+        {
+            a[j] = fast[i+j] * w[j];
+            b[j] = ref[i+j] * w[j];
+        }
+        reference_rfft( a, window / 2, true );
+        reference_rfft( b, window / 2, true );
+
+        // magnitudes only; float is plenty for the dB difference
+        for( j = 1; j < window / 2; j++ )
+        {
+            af[j] = (float)hypot( a[2*j], a[2*j+1] );
+            ma[j] = hypot( b[2*j], b[2*j+1] );
+        }
+        af[0] = (float)fabs( a[0] );
+        ma[0] = fabs( b[0] );
+        {
+            error_stats spectral;
+            memset( &spectral, 0, sizeof(spectral) );
+            accumulate_real( &spectral, af, ma, window / 2, true, floor );
+            s->spectral_sq += spectral.spectral_sq;
+            s->spectral_n += spectral.spectral_n;
+        }
+    }
+
+    free( a ); free( b ); free( w ); free( af ); free( ma );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: to_float() / to_double()
+// desc: round or widen n values
+//-----------------------------------------------------------------------------
+static void to_float( float * out, const double * in, long n )
+{
+    long i;
+    for( i = 0; i < n; i++ )
+        out[i] = (float)in[i];
+}
+
+static void to_double( double * out, const float * in, long n )
+{
+    long i;
+    for( i = 0; i < n; i++ )
+        out[i] = in[i];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_forward() / reference_inverse()
+// desc: the reference fft between reals and planar bins
+//-----------------------------------------------------------------------------
+static void reference_forward( const double * x, const double * window, double * re,
+                               double * im, double * scratch, long W )
+{
+    long j;
+
+    for( j = 0; j < W; j++ )
+        scratch[j] = x[j] * window[j];
+    reference_rfft( scratch, W / 2, true );
+    for( j = 0; j < W / 2; j++ )
+    {
+        re[j] = scratch[2*j];
+        im[j] = scratch[2*j+1];
+    }
+}
+
+static void reference_inverse( const double * re, const double * im, double * x, long W )
+{
+    long j;
+
+    for( j = 0; j < W / 2; j++ )
+    {
+        x[2*j] = re[j];
+        x[2*j+1] = im[j];
+    }
+    reference_rfft( x, W / 2, false );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: check_stages()
+// desc: each stage in isolation on every hop of a signal
+//-----------------------------------------------------------------------------
+static int check_stages( error_stats * stats, const float * input, long n, long W )
+{
+    const long nbins = W / 2;
+    fft_plan plan;
+    float * window = (float *)malloc( W * sizeof(float) );
+    double * dwindow = (double *)malloc( W * sizeof(double) );
+    double * x = (double *)malloc( W * sizeof(double) );
+    double * y = (double *)malloc( W * sizeof(double) );
+    float * fx = (float *)malloc( W * sizeof(float) );
+    // per-stage reference values and float copies of them
+    double * re = (double *)malloc( nbins * sizeof(double) );
+    double * im = (double *)malloc( nbins * sizeof(double) );
+    double * mag = (double *)malloc( nbins * sizeof(double) );
+    double * phase = (double *)malloc( nbins * sizeof(double) );
+    double * mag2 = (double *)malloc( nbins * sizeof(double) );
+    double * curve = (double *)malloc( nbins * sizeof(double) );
+    float * fre = (float *)malloc( nbins * sizeof(float) );
+    float * fim = (float *)malloc( nbins * sizeof(float) );
+    float * fmag = (float *)malloc( nbins * sizeof(float) );
+    float * fphase = (float *)malloc( nbins * sizeof(float) );
+    float * fmag2 = (float *)malloc( nbins * sizeof(float) );
+    float * fcurve = (float *)malloc( nbins * sizeof(float) );
+    bool * peaks = (bool *)malloc( nbins * sizeof(bool) );
+    bool * fpeaks = (bool *)malloc( nbins * sizeof(bool) );
+    const int orders[3] = { 2, 3, 5 };
+    loop_cache cache;
+    long i, j;
+    int k;
+
+    if( fft_plan_create( &plan, nbins ) != 0 )
+        return -1;
+    if( loopcache_create( &cache, W / 2, W / 2, nbins, true ) != 0 )
+    {
+        fft_plan_destroy( &plan );
+        return -1;
+    }
+    hanning( window, W );
+    reference_hanning( dwindow, W );
+
+    for( i = 0; i + W <= n; i += W / 2 )
+    {
+        // fft
+        to_double( x, input + i, W );
+        reference_forward( x, dwindow, re, im, y, W );
+        rfft_split_forward( &plan, input + i, window, fre, fim );
+        accumulate_complex( &stats[STAGE_FFT], fre, fim, re, im, nbins );
+
+        // polar, from the reference spectrum
+        to_float( fre, re, nbins ); to_double( re, fre, nbins );
+        to_float( fim, im, nbins ); to_double( im, fim, nbins );
+        reference_to_polar( re, im, mag, phase, nbins );
+        engine_to_polar( fre, fim, fmag, fphase, nbins );
+        accumulate_real( &stats[STAGE_MAGNITUDE], fmag, mag, nbins, true, 0.0 );
+        accumulate_phase( &stats[STAGE_PHASE], fphase, phase, mag, nbins );
+
+        // 16-bit loop cache round trip of the reference magnitude and phase,
+        // against the spectrum they came from (the float cartesian adds
+        // its own error, far below the cache's)
+        to_float( fmag, mag, nbins );
+        to_float( fphase, phase, nbins );
+        loopcache_store( &cache, 0, fmag, fphase );
+        loopcache_load( &cache, 0, fmag, fphase );
+        engine_to_cartesian( fmag, fphase, fre, fim, nbins );
+        accumulate_complex( &stats[STAGE_LOOPCACHE], fre, fim, re, im, nbins );
+
+        // peak decisions, from the reference magnitude
+        to_float( fmag, mag, nbins ); to_double( mag, fmag, nbins );
+        reference_adaptivecurve( curve, mag, W, 0.0 );
+        reference_findpeaks( mag, curve, peaks, W );
+        adaptivecurve( fcurve, fmag, W, 0.0f );
+        findpeaks( fmag, fcurve, fpeaks, W );
+        // near-ties (flat spectra: noise, clicks) may go either way
+        for( j = 0; j < W / 4; j++ )
+        {
+            if( fabs( mag[j] - curve[j] ) <= mag[j] * DECISION_TOLERANCE )
+                continue;
+            stats[STAGE_PEAKS].flips += peaks[j] != fpeaks[j];
+            stats[STAGE_PEAKS].decisions++;
+        }
+
+        // harmonics, both from the reference decisions (the previous-frame
+        // half works on a scratch copy)
+        memcpy( mag2, mag, nbins * sizeof(double) );
+        memcpy( fmag2, fmag, nbins * sizeof(float) );
+        for( k = 0; k < 3; k++ )
+        {
+            reference_harmonics( peaks, peaks, mag, mag2, W, GOLDEN_GAIN, orders[k] );
+            harmonics( peaks, peaks, fmag, fmag2, W, GOLDEN_GAIN, orders[k] );
+        }
+        accumulate_real( &stats[STAGE_HARMONICS], fmag, mag, nbins, true, 0.0 );
+
+        // cartesian, from the reference magnitude and phase
+        to_float( fmag, mag, nbins ); to_double( mag, fmag, nbins );
+        to_float( fphase, phase, nbins ); to_double( phase, fphase, nbins );
+        reference_to_cartesian( mag, phase, re, im, nbins );
+        engine_to_cartesian( fmag, fphase, fre, fim, nbins );
+        accumulate_complex( &stats[STAGE_CARTESIAN], fre, fim, re, im, nbins );
+
+        // inverse, from the reference spectrum
+        to_float( fre, re, nbins ); to_double( re, fre, nbins );
+        to_float( fim, im, nbins ); to_double( im, fim, nbins );
+        reference_inverse( re, im, y, W );
+        rfft_split_inverse( &plan, fre, fim, fx );
+        accumulate_real( &stats[STAGE_IFFT], fx, y, W, false, 0.0 );
+    }
+
+    loopcache_destroy( &cache );
+    fft_plan_destroy( &plan );
+    free( window ); free( dwindow ); free( x ); free( y ); free( fx );
+    free( re ); free( im ); free( mag ); free( phase ); free( mag2 ); free( curve );
+    free( fre ); free( fim ); free( fmag ); free( fphase ); free( fmag2 ); free( fcurve );
+    free( peaks ); free( fpeaks );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: run_fast() / run_reference()
+// desc: the whole chain over a signal, in blocks as the players run it
+//-----------------------------------------------------------------------------
+static int run_fast( const float * input, float * output, long n, long W, long block,
+                     bool toggle )
+{
+    engine_params params = { .second = GOLDEN_GAIN, .third = GOLDEN_GAIN, .fifth = GOLDEN_GAIN,
+                             .threshold = 0.0f, .toggle = toggle };
+    engine_config config = { .window_size = W, .frames_per_buffer = block, .channels = 1,
+                             .huge_pages = false };
+    harmonic_engine engine;
+    long b;
+
+    if( engine_create( &engine, &config ) != 0 )
+        return -1;
+    for( b = 0; b + block <= n; b += block )
+        engine_process( &engine, &params, input + b, output + b, block );
+    engine_destroy( &engine );
+
+    return 0;
+}
+
+static int run_reference( const double * input, double * output, long n, long W, long block,
+                          bool toggle )
+{
+    engine_params params = { .second = GOLDEN_GAIN, .third = GOLDEN_GAIN, .fifth = GOLDEN_GAIN,
+                             .threshold = 0.0f, .toggle = toggle };
+    reference_engine ref;
+    long b;
+
+    if( reference_create( &ref, W ) != 0 )
+        return -1;
+    for( b = 0; b + block <= n; b += block )
+        reference_process( &ref, &params, input + b, output + b, block );
+    reference_destroy( &ref );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: run_matched()
+// desc: both chains with harmonics on, hop by hop in lockstep; where a
+//       reference peak decision is a near-tie it takes the fast chain's,
+//       so the output differs by rounding and by flips outside ties only.
+//       ties counts the tied decisions that went the other way
+//-----------------------------------------------------------------------------
+static int run_matched( const float * input, const double * dinput, float * output,
+                        double * ref_output, long n, long W, long block, long * ties )
+{
+    engine_params params = { .second = GOLDEN_GAIN, .third = GOLDEN_GAIN, .fifth = GOLDEN_GAIN,
+                             .threshold = 0.0f, .toggle = true };
+    engine_config config = { .window_size = W, .frames_per_buffer = block, .channels = 1,
+                             .huge_pages = false };
+    harmonic_engine engine;
+    reference_engine ref;
+    long i;
+
+    if( engine_create( &engine, &config ) != 0 )
+        return -1;
+    if( reference_create( &ref, W ) != 0 )
+    {
+        engine_destroy( &engine );
+        return -1;
+    }
+    ref.match = &engine;
+    ref.tie_tolerance = DECISION_TOLERANCE;
+    ref.tie_floor = SPECTRAL_FLOOR;
+
+    // same hops as run_fast() in blocks; only the call granularity differs
+    for( i = 0; i + W / 2 <= n; i += W / 2 )
+    {
+        engine_process( &engine, &params, input + i, output + i, W / 2 );
+        reference_process( &ref, &params, dinput + i, ref_output + i, W / 2 );
+    }
+    *ties = ref.ties;
+
+    reference_destroy( &ref );
+    engine_destroy( &engine );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: golden_write()
+// desc: write one item's golden file (bypass, output interleaved)
+//-----------------------------------------------------------------------------
+static int golden_write( const char * dir, const char * name, long W, const double * bypass,
+                         const double * output, long n )
+{
+    char path[1024];
+    SF_INFO info;
+    SNDFILE * file;
+    double * frames = (double *)malloc( 2 * n * sizeof(double) );
+    sf_count_t done;
+    long i;
+
+    snprintf( path, sizeof(path), "%s/%s_w%ld.wav", dir, name, W );
+    memset( &info, 0, sizeof(info) );
+    info.samplerate = (int)CORPUS_RATE;
+    info.channels = 2;
+    info.format = SF_FORMAT_WAV | SF_FORMAT_DOUBLE;
+
+    if( !frames || !( file = sf_open( path, SFM_WRITE, &info ) ) )
+    {
+        fprintf( stderr, "Error: could not open golden file %s\n", path );
+        free( frames );
+        return -1;
+    }
+
+    for( i = 0; i < n; i++ )
+    {
+        frames[2*i] = bypass[i];
+        frames[2*i+1] = output[i];
+    }
+    done = sf_writef_double( file, frames, n );
+
+    sf_close( file );
+    free( frames );
+
+    return done == n ? 0 : -1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: checksum()
+// desc: fnv-1a of a signal rounded to float: a reference that drifts by
+//       an ulp or two of double (libm, flags) mostly still matches, one
+//       whose decisions or stages changed does not
+//-----------------------------------------------------------------------------
+static uint64_t checksum( const double * x, long n )
+{
+    uint64_t hash = 14695981039346656037ull;
+    uint32_t bits;
+    float f;
+    long i;
+    int k;
+
+    for( i = 0; i < n; i++ )
+    {
+        f = (float)x[i] + 0.0f;        // -0 hashes as 0
+        memcpy( &bits, &f, sizeof(bits) );
+        for( k = 0; k < 4; k++ )
+        {
+            hash ^= ( bits >> ( 8 * k ) ) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    }
+
+    return hash;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: golden_open()
+// desc: the manifest of golden checksums for a window size
+//-----------------------------------------------------------------------------
+static FILE * golden_open( const char * dir, long W, bool write )
+{
+    char path[1024];
+    FILE * manifest;
+
+    snprintf( path, sizeof(path), "%s/w%ld.sum", dir, W );
+    if( !( manifest = fopen( path, write ? "w" : "r" ) ) )
+        fprintf( stderr, "Error: could not open golden manifest %s\n", path );
+    else if( write )
+        fprintf( manifest, "# accuracy -W: window %ld, harmonics gain %g; item, fnv-1a of the\n"
+                           "# reference bypass and output rounded to float\n", W, GOLDEN_GAIN );
+
+    return manifest;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: golden_check()
+// desc: the next manifest entry against an item's reference outputs;
+//       returns true if both match
+//-----------------------------------------------------------------------------
+static bool golden_check( FILE * manifest, const char * name, const double * bypass,
+                          const double * output, long n )
+{
+    char line[256], item[64];
+    unsigned long long want_bypass, want_output;
+    uint64_t got_bypass = checksum( bypass, n ), got_output = checksum( output, n );
+
+    while( fgets( line, sizeof(line), manifest ) )
+    {
+        if( line[0] == '#' )
+            continue;
+        if( sscanf( line, "%63s %llx %llx", item, &want_bypass, &want_output ) != 3 ||
+            strcmp( item, name ) != 0 )
+            break;
+        if( got_bypass == want_bypass && got_output == want_output )
+            return true;
+        fprintf( stderr, "%-20s reference drifted from the golden %s%s\n", name,
+                 got_bypass != want_bypass ? "bypass " : "",
+                 got_output != want_output ? "output" : "" );
+        return false;
+    }
+
+    fprintf( stderr, "%-20s no golden entry\n", name );
+    return false;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: metrics()
+// desc: snr (dB), spectral error (dB) and flip rate of accumulated stats
+//-----------------------------------------------------------------------------
+static void metrics( const error_stats * s, double * snr, double * spectral, double * flips )
+{
+    *snr = s->noise > 0.0 ? 10.0 * log10( s->signal / s->noise ) : INFINITY;
+    *spectral = s->spectral_n ? sqrt( s->spectral_sq / s->spectral_n ) : 0.0;
+    *flips = s->decisions ? (double)s->flips / s->decisions : 0.0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: report()
+// desc: one row against its budget; returns true if within it
+//-----------------------------------------------------------------------------
+static bool report( const char * label, const error_stats * s, const error_budget * b,
+                    bool last )
+{
+    double snr, spectral, flips;
+    bool pass, gated = b->min_snr_db != 0.0 || b->max_abs != 0.0 ||
+                       b->max_spectral_db != 0.0 || b->max_flip_rate != 0.0;
+    const char * verdict;
+
+    metrics( s, &snr, &spectral, &flips );
+    pass = ( b->min_snr_db == 0.0 || snr >= b->min_snr_db ) &&
+           ( b->max_abs == 0.0 || s->max_abs <= b->max_abs ) &&
+           ( b->max_spectral_db == 0.0 || spectral <= b->max_spectral_db ) &&
+           ( b->max_flip_rate == 0.0 || flips <= b->max_flip_rate );
+    verdict = !gated ? "not gated" : pass ? "ok" : "OVER BUDGET";
+
+    if( s->decisions )
+        fprintf( stderr, "%-20s %9s %12s %12s %9.5f%%  %s\n", label, "", "", "",
+                 100.0 * flips, verdict );
+    else
+        fprintf( stderr, "%-20s %9.1f %12.3e %12.5f %10s  %s\n", label, snr, s->max_abs,
+                 spectral, "", verdict );
+
+    printf( "    \"%s\": { \"snr_db\": %.2f, \"max_abs\": %.6e, \"spectral_db\": %.6f, "
+            "\"flip_rate\": %.6f, \"pass\": %s }%s\n", label, isinf( snr ) ? 999.0 : snr,
+            s->max_abs, spectral, flips, pass ? "true" : "false", last ? "" : "," );
+
+    return pass;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: usage()
+// desc: print the options to stderr
+//-----------------------------------------------------------------------------
+static void usage( const char * name )
+{
+    fprintf( stderr, "Usage: %s [-w window] [-W golden_dir | -C golden_dir]\n"
+                     "  -w  window size, power of 2 (default 1024)\n"
+                     "  -W  write the reference outputs of the corpus as golden files\n"
+                     "      and their checksums to golden_dir/w<window>.sum\n"
+                     "  -C  check the reference outputs against golden_dir/w<window>.sum\n"
+                     "exits 1 if any stage is over its error budget or the reference drifted\n", name );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: main()
+// desc: stage checks and end-to-end runs over the corpus, each against
+//       its budget; exits 1 if any is over or the reference drifted
+//-----------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+    long window = 1024, block, n, ties;
+    const char * write_dir = NULL, * compare_dir = NULL;
+    error_stats stats[STAGES];
+    double * x, * ref_bypass, * ref_output, * ref_matched;
+    float * xf, * bypass, * output;
+    FILE * manifest = NULL;
+    bool pass = true, golden = true;
+    unsigned int c;
+    int opt, s;
+
+    while( ( opt = getopt( argc, argv, "w:W:C:" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'w': window = atol( optarg ); break;
+            case 'W': write_dir = optarg; break;
+            case 'C': compare_dir = optarg; break;
+            default: usage( argv[0] ); return EXIT_FAILURE;
+        }
+    }
+    if( window < 64 || ( window & ( window - 1 ) ) || ( write_dir && compare_dir ) )
+    {
+        usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+    block = window / 2 > BLOCK_FRAMES ? window / 2 : BLOCK_FRAMES;
+    n = (long)( CORPUS_SECONDS * CORPUS_RATE ) / block * block;
+
+    if( ( write_dir || compare_dir ) &&
+        !( manifest = golden_open( write_dir ? write_dir : compare_dir, window, write_dir != NULL ) ) )
+        return EXIT_FAILURE;
+
+    // every signal carries a hop of zeros past its end for the last block
+    x = (double *)calloc( n + window, sizeof(double) );
+    xf = (float *)calloc( n + window, sizeof(float) );
+    ref_bypass = (double *)malloc( n * sizeof(double) );
+    ref_output = (double *)malloc( n * sizeof(double) );
+    ref_matched = (double *)malloc( n * sizeof(double) );
+    bypass = (float *)malloc( n * sizeof(float) );
+    output = (float *)malloc( n * sizeof(float) );
+    if( !x || !xf || !ref_bypass || !ref_output || !ref_matched || !bypass || !output )
+    {
+        fprintf( stderr, "Error: out of memory\n" );
+        return EXIT_FAILURE;
+    }
+    memset( stats, 0, sizeof(stats) );
+
+    fprintf( stderr, "window %ld, %u corpus items of %d s, harmonics gain %g%s%s\n", window,
+             (unsigned int)CORPUS_ITEMS, CORPUS_SECONDS, GOLDEN_GAIN,
+             compare_dir ? ", golden files in " : "", compare_dir ? compare_dir : "" );
+    fprintf( stderr, "%-20s %9s %12s %12s %10s\n", "stage", "snr dB", "max abs", "spectral dB",
+             "flips" );
+    printf( "{\n  \"benchmark\": \"accuracy\",\n  \"window\": %ld,\n  \"outputs\": {\n", window );
+
+    for( c = 0; c < CORPUS_ITEMS; c++ )
+    {
+        error_stats item[2];
+        char label[64];
+
+        // both chains see the same (float) input
+        g_corpus[c].make( x, n );
+        to_float( xf, x, n );
+        to_double( x, xf, n );
+
+        if( check_stages( stats, xf, n, window ) != 0 ||
+            run_fast( xf, bypass, n, window, block, false ) != 0 ||
+            run_matched( xf, x, output, ref_matched, n, window, block, &ties ) != 0 )
+        {
+            fprintf( stderr, "Error: could not create the processing engine\n" );
+            return EXIT_FAILURE;
+        }
+        if( run_reference( x, ref_bypass, n, window, block, false ) != 0 ||
+            ( manifest && run_reference( x, ref_output, n, window, block, true ) != 0 ) )
+        {
+            fprintf( stderr, "Error: could not create the reference engine\n" );
+            return EXIT_FAILURE;
+        }
+
+        if( write_dir )
+        {
+            if( golden_write( write_dir, g_corpus[c].name, window, ref_bypass, ref_output, n ) != 0 )
+                return EXIT_FAILURE;
+            fprintf( manifest, "%-10s %016llx %016llx\n", g_corpus[c].name,
+                     (unsigned long long)checksum( ref_bypass, n ),
+                     (unsigned long long)checksum( ref_output, n ) );
+        }
+        else if( compare_dir )
+            golden &= golden_check( manifest, g_corpus[c].name, ref_bypass, ref_output, n );
+
+        memset( item, 0, sizeof(item) );
+        accumulate_signal( &item[0], bypass, ref_bypass, n, window );
+        accumulate_signal( &item[1], output, ref_matched, n, window );
+
+        snprintf( label, sizeof(label), "%s/bypass", g_corpus[c].name );
+        pass &= report( label, &item[0], &g_budgets[STAGE_BYPASS], false );
+        snprintf( label, sizeof(label), "%s/output", g_corpus[c].name );
+        pass &= report( label, &item[1], &g_budgets[STAGE_OUTPUT], c == CORPUS_ITEMS - 1 );
+        if( ties )
+            fprintf( stderr, "%-20s %ld tied peak decisions went the other way\n", "", ties );
+    }
+
+    printf( "  },\n  \"stages\": {\n" );
+    for( s = 0; s < STAGE_BYPASS; s++ )
+        pass &= report( g_budgets[s].stage, &stats[s], &g_budgets[s], s == STAGE_BYPASS - 1 );
+    printf( "  },\n  \"golden\": \"%s\",\n  \"pass\": %s\n}\n",
+            !compare_dir ? "unchecked" : golden ? "match" : "drifted",
+            pass && golden ? "true" : "false" );
+
+    fprintf( stderr, "%s\n", !pass ? "over budget" : !golden ? "reference drifted from the golden files"
+                                                           : "all stages within budget" );
+
+    if( manifest && fclose( manifest ) != 0 )
+        golden = false;
+    free( x ); free( xf ); free( ref_bypass ); free( ref_output ); free( ref_matched );
+    free( bypass ); free( output );
+
+    return pass && golden ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,162 @@
+//-----------------------------------------------------------------------------
+// name: arena.c
+// desc: bump allocator over one 64-byte aligned block
+//-----------------------------------------------------------------------------
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined( __WINDOWS_ASIO__ ) && !defined( __WINDOWS_DS__ )
+  #include <sys/mman.h>
+  #define HAVE_MMAP
+#endif
+
+#define HUGE_PAGE_SIZE      (2UL * 1024 * 1024)
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: arena_create()
+// desc: allocate a zeroed block; with huge_pages, try MAP_HUGETLB, then a
+//       mapping advised for transparent huge pages, then the heap
+//-----------------------------------------------------------------------------
+int arena_create( arena * a, size_t size, bool huge_pages )
+{
+    void * mem = NULL;
+
+    a->base = NULL;
+    a->size = ARENA_ROUND( size );
+    a->used = 0;
+    a->backing = ARENA_HEAP;
+
+#ifdef HAVE_MMAP
+    if( huge_pages )
+    {
+        size_t mapped = ( a->size + HUGE_PAGE_SIZE - 1 ) & ~( HUGE_PAGE_SIZE - 1 );
+
+#ifdef MAP_HUGETLB
+        mem = mmap( NULL, mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+        if( mem != MAP_FAILED )
+            a->backing = ARENA_HUGE_PAGES;
+        else
+            mem = NULL;
+#endif
+        if( !mem )
+        {
+            mem = mmap( NULL, mapped, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            if( mem == MAP_FAILED )
+                return -1;
+#ifdef MADV_HUGEPAGE
+            madvise( mem, mapped, MADV_HUGEPAGE );
+#endif
+            a->backing = ARENA_THP;
+        }
+
+        // anonymous mappings are zeroed; touch them so pages exist now
+        a->size = mapped;
+        a->base = (char *)mem;
+        memset( a->base, 0, a->size );
+        return 0;
+    }
+#endif
+
+    if( posix_memalign( &mem, ARENA_ALIGN, a->size ) != 0 )
+        return -1;
+
+    a->base = (char *)mem;
+    memset( a->base, 0, a->size );
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: arena_wrap() / arena_measure()
+// desc: arenas over caller memory, or over nothing for a sizing pass
+//-----------------------------------------------------------------------------
+void arena_wrap( arena * a, void * mem, size_t size )
+{
+    a->base = (char *)mem;
+    a->size = size;
+    a->used = 0;
+    a->backing = ARENA_WRAPPED;
+}
+
+void arena_measure( arena * a )
+{
+    a->base = NULL;
+    a->size = 0;
+    a->used = 0;
+    a->backing = ARENA_MEASURE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: arena_alloc()
+// desc: next aligned slice of the block
+//-----------------------------------------------------------------------------
+void * arena_alloc( arena * a, size_t bytes )
+{
+    size_t offset = a->used;
+
+    a->used += ARENA_ROUND( bytes );
+
+    if( a->backing == ARENA_MEASURE || a->used > a->size )
+        return NULL;
+
+    return a->base + offset;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: arena_destroy()
+// desc: release the block (caller memory is left alone)
+//-----------------------------------------------------------------------------
+void arena_destroy( arena * a )
+{
+    switch( a->backing )
+    {
+        case ARENA_HEAP:
+            free( a->base );
+            break;
+#ifdef HAVE_MMAP
+        case ARENA_HUGE_PAGES:
+        case ARENA_THP:
+            if( a->base )
+                munmap( a->base, a->size );
+            break;
+#endif
+    }
+
+    a->base = NULL;
+    a->size = 0;
+    a->used = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: arena_backing_name()
+// desc: what the arena's memory came from, for the startup report
+//-----------------------------------------------------------------------------
+const char * arena_backing_name( const arena * a )
+{
+    switch( a->backing )
+    {
+        case ARENA_MEASURE:    return "none";
+        case ARENA_WRAPPED:    return "caller memory";
+        case ARENA_HEAP:       return "heap";
+        case ARENA_HUGE_PAGES: return "huge pages";
+        case ARENA_THP:        return "transparent huge pages";
+    }
+    return "unknown";
+}
@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// name: arena.h
+// desc: bump allocator over one 64-byte aligned block, optionally backed by
+//       huge pages; used to lay out all per-stream buffers up front
+//-----------------------------------------------------------------------------
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define ARENA_ALIGN         64
+
+// how an arena's memory was obtained
+#define ARENA_MEASURE       0   // no memory, only counts bytes
+#define ARENA_WRAPPED       1   // caller's memory
+#define ARENA_HEAP          2   // aligned heap block
+#define ARENA_HUGE_PAGES    3   // explicit huge pages (MAP_HUGETLB)
+#define ARENA_THP           4   // anonymous mapping with transparent huge pages
+
+typedef struct
+{
+    char * base;
+    size_t size;
+    size_t used;
+    int backing;
+} arena;
+
+// round a size up to the arena alignment
+#define ARENA_ROUND( bytes ) \
+    ( ( (size_t)(bytes) + ARENA_ALIGN - 1 ) & ~(size_t)( ARENA_ALIGN - 1 ) )
+
+// allocate a zeroed arena of size bytes; returns 0 on success
+int    arena_create( arena * a, size_t size, bool huge_pages );
+// carve from memory the caller owns (must be ARENA_ALIGN aligned)
+void   arena_wrap( arena * a, void * mem, size_t size );
+// start a sizing pass: allocations return NULL and only advance used
+void   arena_measure( arena * a );
+// aligned allocation; NULL when measuring or out of space
+void * arena_alloc( arena * a, size_t bytes );
+void   arena_destroy( arena * a );
+
+// human readable backing, for startup reports
+const char * arena_backing_name( const arena * a );
+
+#endif
@@ -0,0 +1,626 @@
+//-----------------------------------------------------------------------------
+// name: callbackbench.c
+// desc: end-to-end throughput harness for the audio callback chain
+//
+//   runs what paCallback does for every block - read a block and a hop from
+//   the source, keep the first channel, pick up parameters from the
+//   mailbox, engine_process() and fill a visualization snapshot - without
+//   audio hardware, as fast as it will go.  the time of each block goes
+//   into a log-linear histogram.
+//
+//   the source is a recorded file (-f, read through libsndfile as the
+//   players do) or a synthetic mix of harmonically related partials and
+//   noise.  reports p50/p99/p99.9/max block time, the realtime factor
+//   (audio time / processing time, i.e. how many instances one core could
+//   run) and how many blocks missed their deadline of one block duration.
+//   a table goes to stderr and JSON to stdout.
+//
+//   -P (profiling mode, Linux) also reads the hardware counters of
+//   perfcount.h at the end of every stage marked for trace.h and reports
+//   each stage's cycles, instructions, IPC, branch misses and cache misses
+//   per frequency bin processed.  it needs a build with HARMONICS_TRACE.
+//   the counters exclude the kernel, so the read() per stage only adds a
+//   few user instructions, but it does evict some cache between stages.
+//
+//   -A caches the current frame's analysis per hop of the looped source
+//   (loopcache.h, fp32 or fp16 storage), as the players do with
+//   HARMONICS_LOOP_CACHE; the loop is trimmed to whole hops.  -G turns on
+//   the silence gate as HARMONICS_GATE does, and -q makes that fraction of
+//   every second of the synthetic source near-silent (-100 dB noise) to
+//   give it something to gate.  -S runs the time-domain waveshaper
+//   (waveshaper.h) instead of the spectral chain, oversampled -O times.
+//   -I stamps harmonics at exact multiples of interpolated peaks
+//   (partials.h) instead of harmonics()' multiples of bins.  -j splits
+//   harmonics across a pool of threads for large windows, as
+//   HARMONICS_THREADS does for harmonics2.  -R is HARMONICS_REALTIME:
+//   the bench thread and the workers get realtime_thread(), memory is
+//   locked, and whatever could not be applied is reported.
+//
+//   -W records the output as HARMONICS_RECORD does (recorder.h, .wav,
+//   .flac or .raw); the bench runs faster than realtime, so blocks the
+//   writer thread could not take are dropped and reported rather than
+//   waited for.
+//
+//   with -DHARMONICS_RTCHECK and librtcheck.so preloaded (rtcheck.h), any
+//   allocation, lock or blocking call made from the callback or from the
+//   workers is reported at exit and the bench fails.
+//
+//   build:
+//     gcc -O2 -std=gnu99 -o callbackbench callbackbench.c histogram.c
+//         engine.c mailbox.c snapshot.c fft.c fft_plan.c arena.c loopcache.c
+//         waveshaper.c partials.c pool.c realtime.c recorder.c
+//         -lsndfile -lpthread -lm
+//   profiling build: add -DHARMONICS_TRACE trace.c perfcount.c -lpthread
+//   realtime-safety check: add -DHARMONICS_RTCHECK -rdynamic, build
+//     librtcheck.so (see rtcheck.c) and run with LD_PRELOAD=./librtcheck.so
+//   run:
+//     ./callbackbench [-w window] [-b block] [-r rate] [-c channels]
+//                     [-n blocks] [-g gain] [-f audio_file] [-N] [-P]
+//                     [-A fp32|fp16] [-G gate] [-q quiet] [-S] [-O factor]
+//                     [-I] [-j threads] [-R priority[,cpu]]
+//                     [-W output_file] > results.json
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sndfile.h>
+#include "engine.h"
+#include "mailbox.h"
+#include "recorder.h"
+#include "snapshot.h"
+#include "histogram.h"
+#include "trace.h"
+#include "rtcheck.h"
+#ifdef HARMONICS_TRACE
+#include "perfcount.h"
+#endif
+
+#define SYNTH_SECONDS       10      // length of the looped synthetic source
+#define SYNTH_PARTIALS      8
+#define SYNTH_FUNDAMENTAL   110.0
+
+// the block source
+typedef struct
+{
+    SNDFILE * infile;       // recorded source, or NULL
+    float * synth;          // interleaved synthetic source otherwise
+    long synth_frames;
+    long loop;              // frames looped over
+    long position;          // loop frame of the next read
+    int channels;
+} bench_source;
+
+#ifdef HARMONICS_TRACE
+// profiling mode: counter totals per stage
+static perf_group g_perf;
+static uint64_t g_perf_last[PERF_COUNTERS];
+static uint64_t g_perf_stage[TRACE_STAGES][PERF_COUNTERS];
+#endif
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: now_ns()
+// desc: monotonic time in nanoseconds
+//-----------------------------------------------------------------------------
+static uint64_t now_ns( )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: synth_create()
+// desc: decaying harmonic partials plus a little noise, every channel
+//       alike; the last quiet fraction of every second is near-silent
+//-----------------------------------------------------------------------------
+static int synth_create( bench_source * s, double rate, int channels, double quiet )
+{
+    long i;
+    int p, c;
+
+    s->infile = NULL;
+    s->channels = channels;
+    s->position = 0;
+    s->synth_frames = s->loop = (long)( SYNTH_SECONDS * rate );
+    s->synth = (float *)malloc( s->synth_frames * channels * sizeof(float) );
+    if( !s->synth )
+        return -1;
+
+    srand( 1 );
+    for( i = 0; i < s->synth_frames; i++ )
+    {
+        double v = 0.02 * ( 2.0 * rand( ) / RAND_MAX - 1.0 );
+        if( fmod( i / rate, 1.0 ) >= 1.0 - quiet )
+            v *= 0.00001 / 0.02;
+        else
+            for( p = 1; p <= SYNTH_PARTIALS; p++ )
+                v += 0.3 / p * sin( 2.0 * M_PI * SYNTH_FUNDAMENTAL * p * i / rate );
+        for( c = 0; c < channels; c++ )
+            s->synth[i * channels + c] = (float)v;
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: source_read()
+// desc: frames interleaved frames into buffer, looping at s->loop; the
+//       read position then steps back by rewind frames, as in paCallback.
+//       returns the loop offset of the first frame
+//-----------------------------------------------------------------------------
+static long source_read( bench_source * s, float * buffer, long frames, long rewind )
+{
+    long offset = s->position, done = 0;
+
+    while( done < frames )
+    {
+        long n = s->loop - s->position;
+        if( n > frames - done ) n = frames - done;
+        if( s->infile )
+        {
+            long got = (long)sf_readf_float( s->infile, buffer + done * s->channels, n );
+            if( got < n )
+                memset( buffer + ( done + got ) * s->channels, 0, ( n - got ) * s->channels * sizeof(float) );
+        }
+        else
+            memcpy( buffer + done * s->channels, s->synth + s->position * s->channels,
+                    n * s->channels * sizeof(float) );
+        done += n;
+        s->position = ( s->position + n ) % s->loop;
+        if( s->infile && s->position == 0 )
+            sf_seek( s->infile, 0, SEEK_SET );
+    }
+
+    s->position = ( ( s->position - rewind ) % s->loop + s->loop ) % s->loop;
+    if( s->infile )
+        sf_seek( s->infile, s->position, SEEK_SET );
+
+    return offset;
+}
+
+
+
+
+#ifdef HARMONICS_TRACE
+//-----------------------------------------------------------------------------
+// name: profile_hook()
+// desc: the counts since the previous mark belong to the stage just ended
+//-----------------------------------------------------------------------------
+static void profile_hook( unsigned int stage )
+{
+    uint64_t now[PERF_COUNTERS];
+    int k;
+
+    // the whole-callback span ends after the last stage; nothing of its own
+    if( stage == TRACE_CALLBACK_TOTAL )
+        return;
+
+    perf_group_read( &g_perf, now );
+    for( k = 0; k < PERF_COUNTERS; k++ )
+    {
+        g_perf_stage[stage][k] += now[k] - g_perf_last[k];
+        g_perf_last[k] = now[k];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: profile_report()
+// desc: per-stage counts per bin, table to stderr and a json member to stdout
+//-----------------------------------------------------------------------------
+static void profile_report( double bins )
+{
+    uint64_t total[PERF_COUNTERS] = { 0 };
+    int s, k;
+
+    fprintf( stderr, "hardware counters per bin (%.0f bins, group on the pmu %.1f%% of the time)\n",
+             bins, 100.0 * perf_group_coverage( &g_perf ) );
+    fprintf( stderr, "%-12s", "stage" );
+    for( k = 0; k < PERF_COUNTERS; k++ )
+        fprintf( stderr, " %13s", perf_counter_name( k ) );
+    fprintf( stderr, " %6s\n", "ipc" );
+
+    printf( "  \"profile\": {\n    \"bins\": %.0f, \"coverage\": %.4f,\n", bins,
+            perf_group_coverage( &g_perf ) );
+    for( s = 0; s <= TRACE_STAGES; s++ )
+    {
+        const uint64_t * v = s < TRACE_STAGES ? g_perf_stage[s] : total;
+        const char * name = s < TRACE_STAGES ? trace_stage_name( s ) : "total";
+
+        if( s == TRACE_CALLBACK_TOTAL || s == TRACE_XRUN )
+            continue;
+        if( s < TRACE_STAGES && v[PERF_CYCLES] + v[PERF_INSTRUCTIONS] == 0 )
+            continue;
+
+        fprintf( stderr, "%-12s", name );
+        printf( "    \"%s\": {", name );
+        for( k = 0; k < PERF_COUNTERS; k++ )
+        {
+            if( s < TRACE_STAGES )
+                total[k] += v[k];
+            if( perf_group_has( &g_perf, k ) )
+            {
+                fprintf( stderr, " %13.3f", v[k] / bins );
+                printf( "%s\"%s\": %.4f", k ? ", " : " ", perf_counter_name( k ), v[k] / bins );
+            }
+            else
+            {
+                fprintf( stderr, " %13s", "n/a" );
+                printf( "%s\"%s\": null", k ? ", " : " ", perf_counter_name( k ) );
+            }
+        }
+        fprintf( stderr, " %6.2f\n", v[PERF_CYCLES] ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0.0 );
+        printf( ", \"ipc\": %.3f }%s\n", v[PERF_CYCLES] ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0.0,
+                s < TRACE_STAGES ? "," : "" );
+    }
+    printf( "  },\n" );
+}
+#endif
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: usage()
+// desc: print the options to stderr
+//-----------------------------------------------------------------------------
+static void usage( const char * name )
+{
+    fprintf( stderr, "Usage: %s [-w window] [-b block] [-r rate] [-c channels] [-n blocks]\n"
+                     "          [-g gain] [-f audio_file] [-N] [-P] [-A fp32|fp16] [-G gate]\n"
+                     "          [-q quiet] [-S] [-O factor] [-I] [-j threads] [-R priority[,cpu]]\n"
+                     "          [-W output_file]\n"
+                     "  -w  window size, power of 2 (default 1024)\n"
+                     "  -b  frames per block, a multiple of window/2 (default 4096)\n"
+                     "  -r  sample rate for the deadline (default 44100, or the file's)\n"
+                     "  -c  channels of the synthetic source (default 1)\n"
+                     "  -n  blocks to run (default: 60 s of audio)\n"
+                     "  -g  2nd, 3rd and 5th order harmonics gain (default 0.00001)\n"
+                     "  -f  recorded source instead of the synthetic one\n"
+                     "  -N  leave out the visualization snapshot (harmonics2's chain)\n"
+                     "  -P  hardware counters per stage (HARMONICS_TRACE builds)\n"
+                     "  -A  cache the analysis of the looped source, fp32 or fp16\n"
+                     "  -G  silence gate, pass|zero|off[,floor_db[,flux]]\n"
+                     "  -q  near-silent fraction of the synthetic source (default 0)\n"
+                     "  -S  time-domain waveshaper instead of the spectral chain\n"
+                     "  -O  waveshaper oversampling, 2 or 4 (default 4)\n"
+                     "  -I  sparse harmonics of interpolated peaks\n"
+                     "  -j  harmonics threads for windows of 8192 and up (default 1)\n"
+                     "  -R  realtime mode: SCHED_FIFO priority, first CPU\n"
+                     "  -W  record the output, .wav, .flac or .raw\n", name );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: main()
+// desc: parse the options, set up the source and engine, time every
+//       block against its deadline and print the results
+//-----------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+    long window = 1024, block = 4096, blocks = 0, b, i;
+    double rate = 44100.0;
+    int channels = 1, opt;
+    bool snapshot = true, profile = false;
+    const char * path = NULL, * cached = NULL, * record = NULL;
+    double quiet = 0.0;
+    int oversampling = ENGINE_OVERSAMPLING, threads = 0;
+    realtime_config realtime;
+    realtime_status realtime_status;
+    bool rt = false;
+    engine_gate gate;
+    bool gated = false;
+    engine_params params = { .second = 0.00001f, .third = 0.00001f, .fifth = 0.00001f,
+                             .threshold = 0.0f, .toggle = true };
+    bench_source source;
+    harmonic_engine engine;
+    loop_cache cache;
+    engine_config config;
+    param_mailbox mailbox;
+    viz_channel viz;
+    recorder rec;
+    static latency_histogram hist;
+    float * out;
+    uint64_t deadline, misses = 0, start, busy;
+    unsigned long violations;
+    double audio, rtf;
+    const double ps[] = { 0.5, 0.99, 0.999 };
+    const char * names[] = { "p50", "p99", "p99.9" };
+    int k;
+
+    while( ( opt = getopt( argc, argv, "w:b:r:c:n:g:f:NPA:G:q:SO:Ij:R:W:" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'w': window = atol( optarg ); break;
+            case 'b': block = atol( optarg ); break;
+            case 'r': rate = atof( optarg ); break;
+            case 'c': channels = atoi( optarg ); break;
+            case 'n': blocks = atol( optarg ); break;
+            case 'g': params.second = params.third = params.fifth = atof( optarg ); break;
+            case 'f': path = optarg; break;
+            case 'N': snapshot = false; break;
+            case 'P': profile = true; break;
+            case 'A': cached = optarg; break;
+            case 'G':
+                if( engine_parse_gate( &gate, optarg ) != 0 )
+                {
+                    usage( argv[0] );
+                    return EXIT_FAILURE;
+                }
+                gated = true;
+                break;
+            case 'q': quiet = atof( optarg ); break;
+            case 'S': params.waveshaper = true; break;
+            case 'O': oversampling = atoi( optarg ); break;
+            case 'I': params.sparse = true; break;
+            case 'j': threads = atoi( optarg ); break;
+            case 'R':
+                if( realtime_parse( &realtime, optarg ) != 0 )
+                {
+                    usage( argv[0] );
+                    return EXIT_FAILURE;
+                }
+                rt = true;
+                break;
+            case 'W': record = optarg; break;
+            default: usage( argv[0] ); return EXIT_FAILURE;
+        }
+    }
+    if( window < 64 || ( window & ( window - 1 ) ) || block < window / 2 ||
+        block % ( window / 2 ) || rate <= 0.0 || channels < 1 || quiet < 0.0 || quiet > 1.0 ||
+        ( oversampling != 2 && oversampling != 4 ) ||
+        ( cached && strcmp( cached, "fp32" ) && strcmp( cached, "fp16" ) ) )
+    {
+        usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    // source
+    if( path )
+    {
+        SF_INFO sfinfo;
+        memset( &sfinfo, 0, sizeof(sfinfo) );
+        memset( &source, 0, sizeof(source) );
+        source.infile = sf_open( path, SFM_READ, &sfinfo );
+        if( source.infile == NULL )
+        {
+            fprintf( stderr, "Error: could not open file: %s\n", path );
+            return EXIT_FAILURE;
+        }
+        source.channels = channels = sfinfo.channels;
+        source.loop = (long)sfinfo.frames;
+        rate = sfinfo.samplerate;
+        if( source.loop < window / 2 )
+        {
+            fprintf( stderr, "Error: %s is shorter than one hop (%ld frames)\n", path, window / 2 );
+            return EXIT_FAILURE;
+        }
+    }
+    else if( synth_create( &source, rate, channels, quiet ) != 0 )
+    {
+        fprintf( stderr, "Error: could not allocate the synthetic source\n" );
+        return EXIT_FAILURE;
+    }
+    if( blocks <= 0 )
+        blocks = (long)( 60.0 * rate / block ) + 1;
+
+    // the same objects the players set up
+    config.window_size = window;
+    config.frames_per_buffer = block;
+    config.channels = channels;
+    config.huge_pages = false;
+    config.oversampling = oversampling;
+    config.threads = threads;
+    out = (float *)malloc( block * sizeof(float) );
+    if( !out || engine_create( &engine, &config ) != 0 ||
+        ( snapshot && viz_channel_create( &viz, block, window / 4, block / ( window / 2 ) ) != 0 ) )
+    {
+        fprintf( stderr, "Error: could not create the processing engine\n" );
+        return EXIT_FAILURE;
+    }
+    mailbox_init( &mailbox, &params );
+    histogram_init( &hist );
+
+    if( gated )
+        engine_set_gate( &engine, &gate );
+    memset( &cache, 0, sizeof(cache) );
+    if( cached )
+    {
+        source.loop = loopcache_frames( source.loop, engine.hop_size );
+        if( loopcache_create( &cache, source.loop, engine.hop_size, engine.nbins,
+                              strcmp( cached, "fp16" ) == 0 ) != 0 )
+        {
+            fprintf( stderr, "Error: could not create the analysis cache\n" );
+            return EXIT_FAILURE;
+        }
+        engine.cache = &cache;
+    }
+
+    memset( &realtime_status, 0, sizeof(realtime_status) );
+    // before realtime mode, so the writer does not share the bench's CPU
+    if( record && recorder_open( &rec, record, rate, 1, block ) != 0 )
+    {
+        fprintf( stderr, "Error: could not record to %s (.wav, .flac or .raw)\n", record );
+        return EXIT_FAILURE;
+    }
+
+    if( rt )
+    {
+        realtime_lock_memory( &realtime_status );
+        engine_realtime( &engine, &realtime, &realtime_status );
+        if( cached )
+            realtime_prefault( cache.mem.base, cache.mem.size );
+        realtime_thread( &realtime, 0, &realtime_status );
+        realtime_report( stderr, "bench and harmonics threads", &realtime_status );
+    }
+
+    if( profile )
+    {
+#ifdef HARMONICS_TRACE
+        if( perf_group_open( &g_perf ) == 0 || TRACE_SETUP( NULL ) != 0 )
+            return EXIT_FAILURE;
+        trace_set_hook( profile_hook );
+        perf_group_enable( &g_perf );
+#else
+        fprintf( stderr, "Error: -P needs a build with -DHARMONICS_TRACE\n" );
+        return EXIT_FAILURE;
+#endif
+    }
+
+    deadline = (uint64_t)( block / rate * 1e9 );
+    start = now_ns( );
+    for( b = 0; b < blocks; b++ )
+    {
+        uint64_t t0 = now_ns( ), t;
+        engine_params p;
+        long offset;
+
+#ifdef HARMONICS_TRACE
+        if( profile )
+            perf_group_read( &g_perf, g_perf_last );
+#endif
+
+        // paCallback
+        RTCHECK_ENTER( );
+        TRACE_START( total );
+        TRACE_START( mark );
+        memset( out, 0, block * sizeof(float) );
+        offset = source_read( &source, engine.file_buff, block + engine.hop_size, engine.hop_size );
+        for( i = 0; i < block + engine.hop_size; i++ )
+            engine.input[i] = engine.file_buff[engine.channels * i];
+        TRACE_MARK( mark, TRACE_IO );
+        mailbox_read( &mailbox, &p );
+        TRACE_MARK( mark, TRACE_PARAMS );
+        engine_process_looped( &engine, &p, engine.input, out, block, offset );
+        if( record )
+            recorder_push( &rec, out, block );
+        if( snapshot )
+        {
+            TRACE_RESTART( mark );
+            viz_channel_fill( &viz, &engine, out, block );
+            viz_channel_publish( &viz );
+            TRACE_MARK( mark, TRACE_SNAPSHOT );
+        }
+        TRACE_SPAN( total, TRACE_CALLBACK_TOTAL );
+        RTCHECK_LEAVE( );
+
+        t = now_ns( ) - t0;
+        histogram_record( &hist, t );
+        if( t > deadline )
+            misses++;
+    }
+    busy = now_ns( ) - start;
+    if( record )
+        recorder_close( &rec );
+
+    audio = blocks * block / rate;
+    rtf = audio / ( hist.sum * 1e-9 );
+
+    fprintf( stderr, "%ld blocks of %ld frames, window %ld, %d ch at %.0f Hz, %s source%s\n",
+             blocks, block, window, channels, rate, path ? "recorded" : "synthetic",
+             snapshot ? "" : ", no snapshot" );
+    if( params.waveshaper )
+        fprintf( stderr, "waveshaper at %dx, %.1f frames of latency\n", oversampling,
+                 WAVESHAPER_LATENCY( oversampling ) );
+    fprintf( stderr, "block time us: mean %.1f", histogram_mean( &hist ) * 1e-3 );
+    for( k = 0; k < 3; k++ )
+        fprintf( stderr, " %s %.1f", names[k], histogram_percentile( &hist, ps[k] ) * 1e-3 );
+    fprintf( stderr, " max %.1f (deadline %.1f)\n", hist.max * 1e-3, deadline * 1e-3 );
+    fprintf( stderr, "realtime factor %.1f (at p99: %.1f), %.1f s of audio in %.3f s\n", rtf,
+             (double)deadline / histogram_percentile( &hist, 0.99 ), audio, busy * 1e-9 );
+    fprintf( stderr, "deadline misses %lu of %ld (%.4f%%)\n", (unsigned long)misses, blocks,
+             100.0 * misses / blocks );
+    if( cached )
+        fprintf( stderr, "analysis cache %s, %.1f MB: %lu hits, %lu misses\n", cached,
+                 loopcache_bytes( source.loop, engine.hop_size, engine.nbins, cache.half ) / 1048576.0,
+                 cache.hits, cache.misses );
+    if( record )
+        recorder_report( stderr, &rec );
+    violations = RTCHECK_VIOLATIONS( );
+    if( RTCHECK_LOADED( ) )
+        fprintf( stderr, "rtcheck: %lu calls that are not realtime-safe in the callback%s\n", violations,
+                 violations ? " (sites reported at exit)" : "" );
+    if( gated )
+        fprintf( stderr, "silence gate: %lu of %ld hops gated, %lu masks reused\n", engine.gated_hops,
+                 blocks * ( block / engine.hop_size ), engine.reused_hops );
+
+    printf( "{\n  \"benchmark\": \"callbackbench\",\n" );
+    printf( "  \"window\": %ld, \"block\": %ld, \"channels\": %d, \"rate\": %.0f,\n",
+            window, block, channels, rate );
+    printf( "  \"source\": \"%s\", \"snapshot\": %s, \"blocks\": %ld,\n",
+            path ? "recorded" : "synthetic", snapshot ? "true" : "false", blocks );
+    if( params.waveshaper )
+        printf( "  \"waveshaper\": { \"oversampling\": %d, \"latency_frames\": %.1f },\n",
+                oversampling, WAVESHAPER_LATENCY( oversampling ) );
+    if( params.sparse )
+        printf( "  \"sparse\": true,\n" );
+    if( rt )
+        printf( "  \"realtime\": { \"priority\": %d, \"cpu\": %d, \"locked\": %s, \"fifo\": %s, "
+                "\"affinity\": %s, \"denormals\": %s },\n", realtime.priority, realtime.cpu,
+                realtime_status.lock ? "false" : "true", realtime_status.schedule ? "false" : "true",
+                realtime_status.affinity ? "false" : "true", realtime_status.denormals ? "false" : "true" );
+    printf( "  \"block_ns\": { \"mean\": %.0f, \"min\": %lu", histogram_mean( &hist ),
+            (unsigned long)hist.min );
+    for( k = 0; k < 3; k++ )
+        printf( ", \"%s\": %lu", names[k], (unsigned long)histogram_percentile( &hist, ps[k] ) );
+    printf( ", \"max\": %lu },\n", (unsigned long)hist.max );
+#ifdef HARMONICS_TRACE
+    if( profile )
+    {
+        trace_set_hook( NULL );
+        TRACE_SHUTDOWN( );
+        TRACE_REPORT( stderr );
+        profile_report( (double)blocks * ( block / engine.hop_size ) * engine.nbins );
+        perf_group_close( &g_perf );
+    }
+#endif
+    if( cached )
+        printf( "  \"analysis_cache\": { \"storage\": \"%s\", \"hits\": %lu, \"misses\": %lu },\n",
+                cached, cache.hits, cache.misses );
+    if( gated )
+        printf( "  \"gate\": { \"floor_db\": %.1f, \"flux\": %g, \"gated_hops\": %lu, \"reused_masks\": %lu },\n",
+                gate.floor_db, gate.flux, engine.gated_hops, engine.reused_hops );
+    if( record )
+        printf( "  \"record\": { \"path\": \"%s\", \"written_frames\": %lu, \"dropped_blocks\": %lu, "
+                "\"dropped_frames\": %lu, \"ring_peak\": %.3f, \"error\": %s },\n", record,
+                (unsigned long)rec.written, (unsigned long)rec.dropped_blocks,
+                (unsigned long)rec.dropped_frames, (double)rec.peak / rec.capacity,
+                rec.error ? "true" : "false" );
+    if( RTCHECK_LOADED( ) )
+        printf( "  \"rtcheck\": { \"violations\": %lu },\n", violations );
+    printf( "  \"deadline_ns\": %lu, \"deadline_misses\": %lu, \"miss_rate\": %.6f,\n",
+            (unsigned long)deadline, (unsigned long)misses, (double)misses / blocks );
+    printf( "  \"realtime_factor\": %.3f, \"realtime_factor_p99\": %.3f\n}\n", rtf,
+            (double)deadline / histogram_percentile( &hist, 0.99 ) );
+
+    if( snapshot )
+        viz_channel_destroy( &viz );
+    if( cached )
+        loopcache_destroy( &cache );
+    engine_destroy( &engine );
+    free( out );
+    if( source.infile )
+        sf_close( source.infile );
+    else
+        free( source.synth );
+
+    return violations ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,848 @@
+//-----------------------------------------------------------------------------
+// name: engine.c
+// desc: harmonic distortion engine - STFT analysis, harmonics generation and
+//       overlap-add resynthesis on split-complex spectra
+//-----------------------------------------------------------------------------
+#include "engine.h"
+#include "fft.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_layout()
+// desc: carve every per-stream buffer from the arena; run once on a
+//       measuring arena for the size, then on the real one
+//-----------------------------------------------------------------------------
+static void engine_layout( harmonic_engine * e, arena * a )
+{
+    const long W = e->window_size, nbins = e->nbins;
+    const long frames = e->frames_per_buffer + e->hop_size;
+    const long hops = ( e->frames_per_buffer + e->hop_size - 1 ) / e->hop_size;
+
+    e->file_buff = (float *)arena_alloc( a, e->channels * frames * sizeof(float) );
+    e->input = (float *)arena_alloc( a, frames * sizeof(float) );
+    e->window = (float *)arena_alloc( a, W * sizeof(float) );
+    e->curr_re = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->curr_im = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->curr_magnitude = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->curr_phase = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->prev_re = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->prev_im = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->prev_magnitude = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->prev_phase = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->curr_win = (float *)arena_alloc( a, W * sizeof(float) );
+    e->prev_win = (float *)arena_alloc( a, W * sizeof(float) );
+    e->prev_out = (float *)arena_alloc( a, W * sizeof(float) );
+    e->curr_adaptivecurve = (float *)arena_alloc( a, nbins / 2 * sizeof(float) );
+    e->prev_adaptivecurve = (float *)arena_alloc( a, nbins / 2 * sizeof(float) );
+    e->curr_harmonicsindex = (bool *)arena_alloc( a, nbins / 2 * sizeof(bool) );
+    e->prev_harmonicsindex = (bool *)arena_alloc( a, nbins / 2 * sizeof(bool) );
+    e->pre_magnitude = (float *)arena_alloc( a, nbins / 2 * sizeof(float) );
+    e->column_input = (float *)arena_alloc( a, hops * nbins / 2 * sizeof(float) );
+    e->column_output = (float *)arena_alloc( a, hops * nbins / 2 * sizeof(float) );
+    e->column_peaks = (bool *)arena_alloc( a, hops * nbins / 2 * sizeof(bool) );
+    e->curr_added = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->prev_added = (float *)arena_alloc( a, nbins * sizeof(float) );
+    e->mask_curr_magnitude = (float *)arena_alloc( a, nbins / 2 * sizeof(float) );
+    e->mask_prev_magnitude = (float *)arena_alloc( a, nbins / 2 * sizeof(float) );
+    e->shaper_out = (float *)arena_alloc( a, e->hop_size * sizeof(float) );
+    e->curr_partials = (partial *)arena_alloc( a, nbins / 4 * sizeof(partial) );
+    e->prev_partials = (partial *)arena_alloc( a, nbins / 4 * sizeof(partial) );
+    e->curr_active = (int *)arena_alloc( a, nbins / 2 * sizeof(int) );
+    e->prev_active = (int *)arena_alloc( a, nbins / 2 * sizeof(int) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_create()
+// desc: size the arena from the configuration, lay out buffers, plan the fft
+//-----------------------------------------------------------------------------
+int engine_create( harmonic_engine * e, const engine_config * config )
+{
+    const int factor = config->oversampling ? config->oversampling : ENGINE_OVERSAMPLING;
+    arena sizing;
+
+    memset( e, 0, sizeof(*e) );
+    e->window_size = config->window_size;
+    e->hop_size = config->window_size / 2;
+    e->nbins = config->window_size / 2;
+    e->frames_per_buffer = config->frames_per_buffer;
+    e->channels = config->channels;
+
+    arena_measure( &sizing );
+    engine_layout( e, &sizing );
+
+    if( arena_create( &e->mem, sizing.used + fft_plan_bytes( e->nbins ) +
+                      waveshaper_bytes( factor, e->hop_size ), config->huge_pages ) != 0 )
+        return -1;
+
+    engine_layout( e, &e->mem );
+
+    if( fft_plan_create_in( &e->plan, e->nbins, &e->mem ) != 0 ||
+        waveshaper_create_in( &e->shaper, factor, e->hop_size, &e->mem ) != 0 ||
+        ( config->threads > 1 && e->window_size >= ENGINE_PARALLEL_WINDOW &&
+          pool_create( &e->pool, config->threads ) != 0 ) )
+    {
+        engine_destroy( e );
+        return -1;
+    }
+
+    hanning( e->window, e->window_size );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_destroy()
+// desc: stop the workers, release the arena (and everything in it)
+//-----------------------------------------------------------------------------
+void engine_destroy( harmonic_engine * e )
+{
+    pool_destroy( &e->pool );
+    fft_plan_destroy( &e->plan );
+    arena_destroy( &e->mem );
+    memset( e, 0, sizeof(*e) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: realtime_task()
+// desc: set up each worker but the calling thread (share 0)
+//-----------------------------------------------------------------------------
+typedef struct
+{
+    const realtime_config * config;
+    realtime_status status[POOL_MAX_THREADS];
+} realtime_job;
+
+static void realtime_task( void * arg, int index, int count )
+{
+    realtime_job * job = (realtime_job *)arg;
+    (void)count;
+
+    if( index > 0 )
+        realtime_thread( job->config, index, &job->status[index] );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_realtime()
+// desc: prefault the engine's arena and set up every pool worker with
+//       realtime_thread(), folding their failures into status
+//-----------------------------------------------------------------------------
+void engine_realtime( harmonic_engine * e, const realtime_config * config,
+                      realtime_status * status )
+{
+    realtime_job job;
+    int k;
+
+    realtime_prefault( e->mem.base, e->mem.size );
+    if( e->pool.threads < 2 )
+        return;
+
+    memset( &job, 0, sizeof(job) );
+    job.config = config;
+    pool_run( &e->pool, realtime_task, &job );
+
+    for( k = 1; k < e->pool.threads; k++ )
+    {
+        if( !status->schedule ) status->schedule = job.status[k].schedule;
+        if( !status->affinity ) status->affinity = job.status[k].affinity;
+        if( !status->denormals ) status->denormals = job.status[k].denormals;
+        status->threads += job.status[k].threads;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_to_polar() / engine_to_cartesian()
+// desc: planar spectrum <-> magnitude and phase
+//-----------------------------------------------------------------------------
+void engine_to_polar( const float * restrict re, const float * restrict im,
+                     float * restrict magnitude, float * restrict phase,
+                     long nbins )
+{
+    long j;
+
+    for( j = 0; j < nbins; j++ )
+        magnitude[j] = sqrtf( re[j] * re[j] + im[j] * im[j] );
+
+    for( j = 0; j < nbins; j++ )
+        phase[j] = atan2f( im[j], re[j] );
+}
+
+void engine_to_cartesian( const float * restrict magnitude,
+                          const float * restrict phase, float * restrict re,
+                          float * restrict im, long nbins )
+{
+    long j;
+
+    for( j = 0; j < nbins; j++ )
+    {
+        re[j] = magnitude[j] * cosf( phase[j] );
+        im[j] = magnitude[j] * sinf( phase[j] );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: smooth_params()
+// desc: one-pole per-hop smoothing of gains and threshold; the toggle
+//       switches immediately
+//-----------------------------------------------------------------------------
+static void smooth_params( harmonic_engine * e, const engine_params * target )
+{
+    engine_params * p = &e->smoothed;
+
+    if( !e->smoothed_primed )
+    {
+        *p = *target;
+        e->smoothed_primed = true;
+        return;
+    }
+
+    p->second += ( target->second - p->second ) * ENGINE_GAIN_SMOOTHING;
+    p->third += ( target->third - p->third ) * ENGINE_GAIN_SMOOTHING;
+    p->fifth += ( target->fifth - p->fifth ) * ENGINE_GAIN_SMOOTHING;
+    p->threshold += ( target->threshold - p->threshold ) * ENGINE_GAIN_SMOOTHING;
+    p->toggle = target->toggle;
+    p->waveshaper = target->waveshaper;
+    p->sparse = target->sparse;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_set_gate()
+// desc: take a gate: floor_db becomes a mean-square threshold, and the
+//       gate opens with no mask to reuse
+//-----------------------------------------------------------------------------
+void engine_set_gate( harmonic_engine * e, const engine_gate * gate )
+{
+    e->gate = *gate;
+    e->gate_power = powf( 10.0f, gate->floor_db / 10.0f );
+    e->prev_power = 0.0f;
+    e->gate_closed = false;
+    e->mask_valid = false;
+    e->mask_reuses = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_parse_gate()
+// desc: parse pass|zero|off[,floor_db[,flux]], defaults for what is left
+//       out; -1 if malformed
+//-----------------------------------------------------------------------------
+int engine_parse_gate( engine_gate * gate, const char * spec )
+{
+    const char * rest = strchr( spec, ',' );
+    size_t n = rest ? (size_t)( rest - spec ) : strlen( spec );
+    char * end;
+
+    gate->floor_db = ENGINE_GATE_FLOOR_DB;
+    gate->flux = ENGINE_GATE_FLUX;
+    if( n == 4 && strncmp( spec, "pass", 4 ) == 0 )
+        gate->mode = ENGINE_GATE_PASS;
+    else if( n == 4 && strncmp( spec, "zero", 4 ) == 0 )
+        gate->mode = ENGINE_GATE_ZERO;
+    else if( n == 3 && strncmp( spec, "off", 3 ) == 0 )
+        gate->mode = ENGINE_GATE_OFF;
+    else
+        return -1;
+
+    if( !rest )
+        return 0;
+    gate->floor_db = strtof( rest + 1, &end );
+    if( end == rest + 1 || ( *end != '\0' && *end != ',' ) )
+        return -1;
+    if( *end == '\0' )
+        return 0;
+    rest = end;
+    gate->flux = strtof( rest + 1, &end );
+    if( end == rest + 1 || *end != '\0' || gate->flux < 0.0f )
+        return -1;
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: frame_power()
+// desc: mean square of n samples
+//-----------------------------------------------------------------------------
+static float frame_power( const float * x, long n )
+{
+    float sum = 0.0f;
+    long j;
+
+    for( j = 0; j < n; j++ )
+        sum += x[j] * x[j];
+
+    return sum / n;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: gated_output()
+// desc: what a gated hop outputs at frame offset j: the input as the
+//       harmonics-off chain would resynthesize it (overlap of two hanning
+//       halves), or silence
+//-----------------------------------------------------------------------------
+static inline float gated_output( const harmonic_engine * e, const float * in, long j )
+{
+    if( e->gate.mode == ENGINE_GATE_ZERO )
+        return 0.0f;
+    return in[j] * ( e->window[j] + e->window[j + e->hop_size] );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: gate_hop()
+// desc: a hop with the gate closed: no spectral work, the output and the
+//       frame the next hop reprocesses come straight from the input
+//-----------------------------------------------------------------------------
+static void gate_hop( harmonic_engine * e, const float * in, float * out, long c )
+{
+    const long W = e->window_size, hop = e->hop_size, nbins = e->nbins;
+    float * swap;
+    long j;
+
+    for( j = 0; j < hop; j++ )
+        out[j] = gated_output( e, in, j );
+    for( j = 0; j < W; j++ )
+        e->curr_win[j] = e->gate.mode == ENGINE_GATE_ZERO ? 0.0f : in[j] * e->window[j];
+
+    memset( e->pre_magnitude, 0, nbins / 2 * sizeof(float) );
+    memset( e->column_input + c * nbins / 2, 0, nbins / 2 * sizeof(float) );
+    memset( e->column_output + c * nbins / 2, 0, nbins / 2 * sizeof(float) );
+    memset( e->column_peaks + c * nbins / 2, 0, nbins / 2 * sizeof(bool) );
+    e->mask_valid = false;
+
+    swap = e->prev_win;
+    e->prev_win = e->curr_win;
+    e->curr_win = swap;
+    e->gated_hops++;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: spectral_flux()
+// desc: L1 distance of magnitude from reference, relative to reference
+//-----------------------------------------------------------------------------
+static float spectral_flux( const float * magnitude, const float * reference, long n )
+{
+    float diff = 0.0f, total = 0.0f;
+    long j;
+
+    for( j = 0; j < n; j++ )
+    {
+        diff += fabsf( magnitude[j] - reference[j] );
+        total += reference[j];
+    }
+
+    return total > 0.0f ? diff / total : ( diff > 0.0f ? INFINITY : 0.0f );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: apply_mask()
+// desc: harmonics() as a mask: bins in [1, W/4) that are not peaks go to
+//       zero, every other bin gets what was added the last time
+//-----------------------------------------------------------------------------
+static void apply_mask( float * magnitude, const bool * peaks, const float * added, long W )
+{
+    long j;
+
+    for( j = 0; j < W / 2; j++ )
+        magnitude[j] += added[j];
+    for( j = 1; j < W / 4; j++ )
+        if( !peaks[j] )
+            magnitude[j] = 0.0f;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: mask_matches()
+// desc: may the mask taken earlier stand in for peaks and harmonics now
+//-----------------------------------------------------------------------------
+static bool mask_matches( const harmonic_engine * e, const engine_params * p )
+{
+    const engine_params * m = &e->mask_params;
+
+    if( e->gate.flux <= 0.0f || !e->mask_valid || e->mask_reuses >= ENGINE_GATE_MAX_REUSE ||
+        p->second != m->second || p->third != m->third || p->fifth != m->fifth ||
+        p->threshold != m->threshold )
+        return false;
+
+    return spectral_flux( e->curr_magnitude, e->mask_curr_magnitude, e->nbins / 2 ) < e->gate.flux &&
+           spectral_flux( e->prev_magnitude, e->mask_prev_magnitude, e->nbins / 2 ) < e->gate.flux;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: active_bins()
+// desc: the peak bins in [1, W/4), ascending; returns how many
+//-----------------------------------------------------------------------------
+static long active_bins( const bool * peaks, int * active, long W )
+{
+    long j, count = 0;
+
+    for( j = 1; j < W / 4; j++ )
+        if( peaks[j] )
+            active[count++] = (int)j;
+
+    return count;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: harmonics_slice()
+// desc: harmonics() for orders 2, 3 and 5 in turn, restricted to the
+//       destination bins [lo, hi): each source j adds to its multiples k of
+//       order j below W/4 and to their mirrors W/2 - k; additions reach a
+//       bin in the same order as in the serial calls, and bins in [1, W/4)
+//       that are not peaks end up zero as there
+//-----------------------------------------------------------------------------
+static void harmonics_slice( float * magnitude, const bool * peaks, const int * active,
+                             long count, const float * gains, long W, long lo, long hi )
+{
+    static const int orders[3] = { 2, 3, 5 };
+    const long quarter = W / 4, half = W / 2;
+    const long mirror_first = half - hi + 1;
+    long direct_end = hi < quarter ? hi : quarter;
+    long mirror_last = half - lo < quarter - 1 ? half - lo : quarter - 1;
+    long n, j, k;
+    int o;
+
+    // a slice with no k or no mirrors of its own: stop on any source
+    if( lo >= direct_end )
+        direct_end = 0;
+    if( mirror_first > mirror_last )
+        mirror_last = 0;
+
+    for( o = 0; o < 3; o++ )
+    {
+        const float add = gains[o] / 2;
+
+        for( n = 0; n < count; n++ )
+        {
+            const long step = (long)orders[o] * active[n];
+            long first;
+
+            // sources ascend: past the slice's k and mirrors, so are the rest
+            if( step >= direct_end && step > mirror_last )
+                break;
+
+            // k itself; bins that are not peaks are zeroed below anyway
+            first = lo <= step ? step : ( lo + step - 1 ) / step * step;
+            for( k = first; k < direct_end; k += step )
+                magnitude[k] += add;
+
+            // its mirror, half - k in [lo, hi)
+            first = mirror_first > step ? ( mirror_first + step - 1 ) / step * step : step;
+            for( k = first; k <= mirror_last; k += step )
+                magnitude[half - k] += add;
+        }
+    }
+
+    for( j = lo > 1 ? lo : 1; j < direct_end; j++ )
+        if( !peaks[j] )
+            magnitude[j] = 0.0f;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: harmonics_task()
+// desc: one worker's slice of the current and previous frames, split on
+//       16 bins (a cache line of floats) so no two workers share a line
+//-----------------------------------------------------------------------------
+static void harmonics_task( void * arg, int index, int count )
+{
+    harmonic_engine * e = (harmonic_engine *)arg;
+    const engine_params * p = &e->smoothed;
+    const float gains[3] = { p->second, p->third, p->fifth };
+    const long lo = e->nbins * index / count & ~15L;
+    const long hi = index + 1 == count ? e->nbins : e->nbins * ( index + 1 ) / count & ~15L;
+
+    harmonics_slice( e->curr_magnitude, e->curr_harmonicsindex, e->curr_active,
+                     e->curr_active_count, gains, e->window_size, lo, hi );
+    harmonics_slice( e->prev_magnitude, e->prev_harmonicsindex, e->prev_active,
+                     e->prev_active_count, gains, e->window_size, lo, hi );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: shape_hop()
+// desc: one hop through the waveshaper into out
+//-----------------------------------------------------------------------------
+static void shape_hop( harmonic_engine * e, const engine_params * p, const float * in,
+                       float * out )
+{
+    waveshaper_process( &e->shaper, p->toggle ? p->second : 0.0f, p->toggle ? p->third : 0.0f,
+                        p->toggle ? p->fifth : 0.0f, in, out, e->hop_size );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: shaper_hop()
+// desc: a hop from the waveshaper alone; the frame the spectral chain
+//       reprocesses next is kept as the harmonics-off chain would leave it,
+//       for switching back
+//-----------------------------------------------------------------------------
+static void shaper_hop( harmonic_engine * e, const engine_params * p, const float * in,
+                        float * out, long c )
+{
+    const long W = e->window_size, nbins = e->nbins;
+    float * swap;
+    long j;
+
+    shape_hop( e, p, in, out );
+    for( j = 0; j < W; j++ )
+        e->curr_win[j] = in[j] * e->window[j];
+
+    memset( e->pre_magnitude, 0, nbins / 2 * sizeof(float) );
+    memset( e->column_input + c * nbins / 2, 0, nbins / 2 * sizeof(float) );
+    memset( e->column_output + c * nbins / 2, 0, nbins / 2 * sizeof(float) );
+    memset( e->column_peaks + c * nbins / 2, 0, nbins / 2 * sizeof(bool) );
+    e->mask_valid = false;
+
+    swap = e->prev_win;
+    e->prev_win = e->curr_win;
+    e->curr_win = swap;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_run()
+// desc: run the STFT chain over one block; the current frame's magnitude
+//       and phase come from analysis (frames/hop frames of nbins) if given,
+//       else from the loop cache or a forward fft of in
+//-----------------------------------------------------------------------------
+static void engine_run( harmonic_engine * e, const engine_params * params,
+                        const float * in, const float * magnitude, const float * phase,
+                        float * out, long frames, long offset )
+{
+    const long W = e->window_size, hop = e->hop_size, nbins = e->nbins;
+    const engine_params * p = &e->smoothed;
+    long i, j, c = 0;
+
+    for( i = 0; i < frames; i += hop, c++ )
+    {
+        float * swap;
+        long key = e->cache && offset >= 0 && !magnitude ? loopcache_key( e->cache, offset + i ) : -1;
+        bool cached, gated = e->gate.mode != ENGINE_GATE_OFF && in, quiet = false;
+
+        TRACE_START( t );
+
+        smooth_params( e, params );
+        TRACE_MARK( t, TRACE_PARAMS );
+
+        /* Time-domain waveshaper in place of the spectral chain */
+        if( in && p->waveshaper && e->shaper_active )
+        {
+            shaper_hop( e, p, in + i, out + i, c );
+            TRACE_MARK( t, TRACE_HARMONICS );
+            continue;
+        }
+
+        /* Silence gate: both frames this hop's output overlaps are quiet */
+        if( gated )
+        {
+            float power = frame_power( in + i, W );
+            quiet = power < e->gate_power && e->prev_power < e->gate_power;
+            e->prev_power = power;
+            if( quiet && e->gate_closed )
+            {
+                gate_hop( e, in + i, out + i, c );
+                TRACE_MARK( t, TRACE_OVERLAP_ADD );
+                continue;
+            }
+        }
+
+        /* The frame was analyzed before: by the caller, or on an earlier loop */
+        if( magnitude )
+        {
+            memcpy( e->curr_magnitude, magnitude + c * nbins, nbins * sizeof(float) );
+            memcpy( e->curr_phase, phase + c * nbins, nbins * sizeof(float) );
+            cached = true;
+        }
+        else
+            cached = key >= 0 && loopcache_load( e->cache, key, e->curr_magnitude, e->curr_phase );
+
+        /* FFT of the windowed input frame and of the previous output frame */
+        if( !cached )
+            rfft_split_forward( &e->plan, in + i, e->window, e->curr_re, e->curr_im );
+        rfft_split_forward( &e->plan, e->prev_win, NULL, e->prev_re, e->prev_im );
+        TRACE_MARK( t, TRACE_FFT );
+
+        /* Get Magnitude and Phase (polar coordinates) */
+        if( !cached )
+        {
+            engine_to_polar( e->curr_re, e->curr_im, e->curr_magnitude, e->curr_phase, nbins );
+            if( key >= 0 )
+                loopcache_store( e->cache, key, e->curr_magnitude, e->curr_phase );
+        }
+        engine_to_polar( e->prev_re, e->prev_im, e->prev_magnitude, e->prev_phase, nbins );
+
+        memcpy( e->pre_magnitude, e->curr_magnitude, nbins / 2 * sizeof(float) );
+        memcpy( e->column_input + c * nbins / 2, e->curr_magnitude, nbins / 2 * sizeof(float) );
+        TRACE_MARK( t, TRACE_POLAR );
+
+        if( p->toggle && !p->sparse && mask_matches( e, p ) )
+        {
+            /* Spectrum about where the mask was taken: apply it again */
+            apply_mask( e->curr_magnitude, e->curr_harmonicsindex, e->curr_added, W );
+            apply_mask( e->prev_magnitude, e->prev_harmonicsindex, e->prev_added, W );
+            e->mask_reuses++;
+            e->reused_hops++;
+            TRACE_MARK( t, TRACE_HARMONICS );
+
+            memcpy( e->column_peaks + c * nbins / 2, e->curr_harmonicsindex, nbins / 2 * sizeof(bool) );
+        }
+        else if( p->toggle && p->sparse )
+        {
+            adaptivecurve( e->curr_adaptivecurve, e->curr_magnitude, W, p->threshold );
+            adaptivecurve( e->prev_adaptivecurve, e->prev_magnitude, W, p->threshold );
+
+            findpeaks( e->curr_magnitude, e->curr_adaptivecurve, e->curr_harmonicsindex, W );
+            findpeaks( e->prev_magnitude, e->prev_adaptivecurve, e->prev_harmonicsindex, W );
+            e->curr_count = partials_find( e->curr_magnitude, e->curr_phase, e->curr_harmonicsindex,
+                                           nbins, e->curr_partials );
+            e->prev_count = partials_find( e->prev_magnitude, e->prev_phase, e->prev_harmonicsindex,
+                                           nbins, e->prev_partials );
+            TRACE_MARK( t, TRACE_PEAKS );
+
+            /* Attenuate as harmonics() does; the harmonics go in after polar */
+            for( j = 1; j < W / 4; j++ )
+            {
+                if( !e->curr_harmonicsindex[j] ) e->curr_magnitude[j] = 0.0f;
+                if( !e->prev_harmonicsindex[j] ) e->prev_magnitude[j] = 0.0f;
+            }
+            e->mask_valid = false;
+
+            memcpy( e->column_peaks + c * nbins / 2, e->curr_harmonicsindex, nbins / 2 * sizeof(bool) );
+        }
+        else if( p->toggle )
+        {
+            if( e->gate.flux > 0.0f )
+            {
+                memcpy( e->curr_added, e->curr_magnitude, nbins * sizeof(float) );
+                memcpy( e->prev_added, e->prev_magnitude, nbins * sizeof(float) );
+            }
+
+            adaptivecurve( e->curr_adaptivecurve, e->curr_magnitude, W, p->threshold );
+            adaptivecurve( e->prev_adaptivecurve, e->prev_magnitude, W, p->threshold );
+
+            findpeaks( e->curr_magnitude, e->curr_adaptivecurve, e->curr_harmonicsindex, W );
+            findpeaks( e->prev_magnitude, e->prev_adaptivecurve, e->prev_harmonicsindex, W );
+            TRACE_MARK( t, TRACE_PEAKS );
+
+            if( e->pool.threads > 1 )
+            {
+                /* Large window: each worker adds into its own slice of bins */
+                e->curr_active_count = active_bins( e->curr_harmonicsindex, e->curr_active, W );
+                e->prev_active_count = active_bins( e->prev_harmonicsindex, e->prev_active, W );
+                pool_run( &e->pool, harmonics_task, e );
+            }
+            else
+            {
+                harmonics( e->curr_harmonicsindex, e->prev_harmonicsindex, e->curr_magnitude,
+                           e->prev_magnitude, W, p->second, 2 );
+                harmonics( e->curr_harmonicsindex, e->prev_harmonicsindex, e->curr_magnitude,
+                           e->prev_magnitude, W, p->third, 3 );
+                harmonics( e->curr_harmonicsindex, e->prev_harmonicsindex, e->curr_magnitude,
+                           e->prev_magnitude, W, p->fifth, 5 );
+            }
+            TRACE_MARK( t, TRACE_HARMONICS );
+
+            /* Keep the gain mask: peaks stay in *_harmonicsindex */
+            if( e->gate.flux > 0.0f )
+            {
+                memcpy( e->mask_curr_magnitude, e->pre_magnitude, nbins / 2 * sizeof(float) );
+                memcpy( e->mask_prev_magnitude, e->prev_added, nbins / 2 * sizeof(float) );
+                for( j = 0; j < nbins; j++ )
+                {
+                    e->curr_added[j] = e->curr_magnitude[j] - e->curr_added[j];
+                    e->prev_added[j] = e->prev_magnitude[j] - e->prev_added[j];
+                }
+                e->mask_params = *p;
+                e->mask_valid = true;
+                e->mask_reuses = 0;
+            }
+
+            memcpy( e->column_peaks + c * nbins / 2, e->curr_harmonicsindex, nbins / 2 * sizeof(bool) );
+        }
+        else
+            memset( e->column_peaks + c * nbins / 2, 0, nbins / 2 * sizeof(bool) );
+
+        memcpy( e->column_output + c * nbins / 2, e->curr_magnitude, nbins / 2 * sizeof(float) );
+
+        /* Back to Cartesian coordinates */
+        engine_to_cartesian( e->curr_magnitude, e->curr_phase, e->curr_re, e->curr_im, nbins );
+        engine_to_cartesian( e->prev_magnitude, e->prev_phase, e->prev_re, e->prev_im, nbins );
+
+        /* Sparse harmonics: a main lobe at each multiple of each partial */
+        if( p->toggle && p->sparse )
+        {
+            partials_stamp( e->curr_partials, e->curr_count, 2, p->second, e->curr_re, e->curr_im, nbins );
+            partials_stamp( e->curr_partials, e->curr_count, 3, p->third, e->curr_re, e->curr_im, nbins );
+            partials_stamp( e->curr_partials, e->curr_count, 5, p->fifth, e->curr_re, e->curr_im, nbins );
+            partials_stamp( e->prev_partials, e->prev_count, 2, p->second, e->prev_re, e->prev_im, nbins );
+            partials_stamp( e->prev_partials, e->prev_count, 3, p->third, e->prev_re, e->prev_im, nbins );
+            partials_stamp( e->prev_partials, e->prev_count, 5, p->fifth, e->prev_re, e->prev_im, nbins );
+            for( j = 0; j < nbins / 2; j++ )
+                e->column_output[c * nbins / 2 + j] = sqrtf( e->curr_re[j] * e->curr_re[j] +
+                                                             e->curr_im[j] * e->curr_im[j] );
+        }
+        TRACE_MARK( t, TRACE_CARTESIAN );
+
+        /* Back to Time Domain */
+        rfft_split_inverse( &e->plan, e->curr_re, e->curr_im, e->curr_win );
+        rfft_split_inverse( &e->plan, e->prev_re, e->prev_im, e->prev_out );
+        TRACE_MARK( t, TRACE_IFFT );
+
+        /* Overlap-add */
+        for( j = 0; j < hop; j++ )
+            out[i+j] = e->prev_out[j+hop] + e->curr_win[j];
+
+        /* The gate opens or closes: crossfade over the hop */
+        if( gated && quiet != e->gate_closed )
+        {
+            for( j = 0; j < hop; j++ )
+            {
+                float r = ( j + 0.5f ) / hop;
+                if( !quiet ) r = 1.0f - r;
+                out[i+j] += ( gated_output( e, in + i, j ) - out[i+j] ) * r;
+            }
+            e->gate_closed = quiet;
+        }
+
+        /* Switching to or from the waveshaper: crossfade over the hop */
+        if( in && p->waveshaper != e->shaper_active )
+        {
+            if( p->waveshaper )
+                waveshaper_reset( &e->shaper );
+            shape_hop( e, p, in + i, e->shaper_out );
+            for( j = 0; j < hop; j++ )
+            {
+                float r = ( j + 0.5f ) / hop;
+                if( !p->waveshaper ) r = 1.0f - r;
+                out[i+j] += ( e->shaper_out[j] - out[i+j] ) * r;
+            }
+            e->shaper_active = p->waveshaper;
+        }
+
+        /* Current frame becomes the previous one */
+        swap = e->prev_win;
+        e->prev_win = e->curr_win;
+        e->curr_win = swap;
+        TRACE_MARK( t, TRACE_OVERLAP_ADD );
+    }
+
+    e->columns = c;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_process()
+// desc: one block of input through the STFT chain into out
+//-----------------------------------------------------------------------------
+void engine_process( harmonic_engine * e, const engine_params * params,
+                     const float * in, float * out, long frames )
+{
+    engine_run( e, params, in, NULL, NULL, out, frames, -1 );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_process_looped()
+// desc: engine_process() for a looped source, the current frame through
+//       the loop cache where offset is on its grid
+//-----------------------------------------------------------------------------
+void engine_process_looped( harmonic_engine * e, const engine_params * params,
+                            const float * in, float * out, long frames, long offset )
+{
+    engine_run( e, params, in, NULL, NULL, out, frames, offset );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_analyze()
+// desc: windowed forward fft and polar conversion of every hop of a block
+//-----------------------------------------------------------------------------
+void engine_analyze( harmonic_engine * e, const float * in, long frames,
+                     float * magnitude, float * phase )
+{
+    const long hop = e->hop_size, nbins = e->nbins;
+    long i, c = 0;
+
+    for( i = 0; i < frames; i += hop, c++ )
+    {
+        rfft_split_forward( &e->plan, in + i, e->window, e->curr_re, e->curr_im );
+        engine_to_polar( e->curr_re, e->curr_im, magnitude + c * nbins, phase + c * nbins, nbins );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: engine_process_analyzed()
+// desc: engine_process() on magnitude and phase from engine_analyze()
+//-----------------------------------------------------------------------------
+void engine_process_analyzed( harmonic_engine * e, const engine_params * params,
+                              const float * magnitude, const float * phase,
+                              float * out, long frames )
+{
+    engine_run( e, params, NULL, magnitude, phase, out, frames, -1 );
+}
@@ -0,0 +1,229 @@
+//-----------------------------------------------------------------------------
+// name: engine.h
+// desc: harmonic distortion engine - the STFT processing shared by the
+//       players (window, fft, polar, adaptive curve, peaks, harmonics, ifft,
+//       overlap-add)
+//
+//   spectra are kept split-complex planar end to end: re[], im[], mag[] and
+//   phase[] of window_size/2 bins each, as read and written by the fft_plan
+//   kernels.
+//-----------------------------------------------------------------------------
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include <stdbool.h>
+#include "fft_plan.h"
+#include "arena.h"
+#include "loopcache.h"
+#include "waveshaper.h"
+#include "partials.h"
+#include "pool.h"
+#include "realtime.h"
+
+// stream configuration; fixes every buffer size at creation
+typedef struct
+{
+    long window_size;       // analysis window (hop is half a window)
+    long frames_per_buffer; // largest block handed to engine_process()
+    int channels;           // interleaved channels of the source
+    bool huge_pages;        // back the arena with huge pages if possible
+    int oversampling;       // waveshaper factor, 2 or 4 (0: ENGINE_OVERSAMPLING)
+    int threads;            // harmonics workers, caller included (0 or 1: none)
+} engine_config;
+
+#define ENGINE_OVERSAMPLING     4
+
+// windows from this size up split harmonics across config.threads: each
+// thread owns a slice of destination bins and adds what every active
+// source bin puts there, in harmonics()' order, so the result is the
+// same bits whatever the thread count.  below it a hop is too short to
+// pay for waking the workers
+#define ENGINE_PARALLEL_WINDOW  8192
+
+// fraction of the remaining distance to a new gain covered per hop
+#define ENGINE_GAIN_SMOOTHING   0.3f
+
+// silence gate: hops whose input is below a noise floor skip the spectral
+// chain and pass the input through (or output zeros); the hop where the
+// gate opens or closes is processed and crossfaded with the gated output.
+// while the input spectrum stays within flux of the frame the gain mask
+// (peaks and what harmonics added) was last taken from, and so does the
+// previous frame's, that mask is applied again instead of running peaks
+// and harmonics, for at most ENGINE_GATE_MAX_REUSE hops in a row
+typedef enum
+{
+    ENGINE_GATE_OFF,
+    ENGINE_GATE_PASS,
+    ENGINE_GATE_ZERO
+} engine_gate_mode;
+
+typedef struct
+{
+    engine_gate_mode mode;
+    float floor_db;     // mean square of the input frame, dB re full scale
+    float flux;         // relative L1 spectral change; 0 never reuses
+} engine_gate;
+
+#define ENGINE_GATE_FLOOR_DB    -70.0f
+#define ENGINE_GATE_FLUX        0.05f
+#define ENGINE_GATE_MAX_REUSE   8
+
+// user parameters for one block
+typedef struct
+{
+    float second;       // 2nd order harmonics gain
+    float third;        // 3rd order harmonics gain
+    float fifth;        // 5th order harmonics gain
+    float threshold;    // adaptive curve offset
+    bool toggle;        // harmonics generation on/off
+    bool waveshaper;    // time-domain waveshaper instead of the spectral chain
+    bool sparse;        // harmonics of interpolated peaks (partials.h)
+} engine_params;
+
+typedef struct
+{
+    long window_size;
+    long hop_size;
+    long nbins;             // window_size / 2
+    long frames_per_buffer;
+    int channels;
+
+    // every buffer below lives in this one block
+    arena mem;
+
+    // source staging: interleaved reads and the mono frames processed,
+    // frames_per_buffer + hop_size frames each
+    float * file_buff;
+    float * input;
+
+    fft_plan plan;
+    float * window;         // analysis window
+
+    // current frame spectrum
+    float * curr_re;
+    float * curr_im;
+    float * curr_magnitude;
+    float * curr_phase;
+
+    // previous (processed) frame spectrum
+    float * prev_re;
+    float * prev_im;
+    float * prev_magnitude;
+    float * prev_phase;
+
+    // time domain frames
+    float * curr_win;       // current frame after processing
+    float * prev_win;       // previous frame after processing
+    float * prev_out;       // previous frame after reprocessing
+
+    float * curr_adaptivecurve;
+    float * prev_adaptivecurve;
+    bool * curr_harmonicsindex;
+    bool * prev_harmonicsindex;
+
+    // magnitude of the last analyzed frame before processing, nbins/2 bins
+    float * pre_magnitude;
+
+    // one column per hop of the last block, nbins/2 bins each: magnitude
+    // before and after processing, and the peaks harmonics were built from
+    long columns;
+    float * column_input;
+    float * column_output;
+    bool * column_peaks;
+
+    // parameters in effect, eased toward the block's parameters every hop
+    engine_params smoothed;
+    bool smoothed_primed;
+
+    // analysis of the current frame for looped sources, or NULL
+    loop_cache * cache;
+
+    // silence gate and gain mask reuse (engine_set_gate())
+    engine_gate gate;
+    float gate_power;       // floor_db as a mean square
+    float prev_power;       // mean square of the previous input frame
+    bool gate_closed;       // the last hop was gated
+    float * curr_added;     // nbins each: what harmonics added on the hop
+    float * prev_added;     // the mask was taken on
+    float * mask_curr_magnitude; // nbins/2 each: the spectra it was taken
+    float * mask_prev_magnitude; // from, before processing
+    engine_params mask_params;
+    bool mask_valid;
+    long mask_reuses;       // hops in a row the mask was applied again
+    unsigned long gated_hops, reused_hops; // counts, for reports
+
+    // time-domain alternative to the whole spectral chain, switched per
+    // block by params->waveshaper with a one-hop crossfade.  while it runs
+    // no spectra are computed: the column_* and pre_magnitude are zero
+    waveshaper shaper;
+    bool shaper_active;     // the last hop came from the waveshaper
+    float * shaper_out;     // hop_size, the waveshaper's side of a crossfade
+
+    // sparse mode (params->sparse): one partial per run of peaks, nbins/4
+    // room each; harmonics are stamped at exact multiples of their
+    // frequencies instead of harmonics()' multiples of bins.  the gain mask
+    // is not reused in this mode
+    partial * curr_partials;
+    partial * prev_partials;
+    long curr_count, prev_count;
+
+    // parallel harmonics (ENGINE_PARALLEL_WINDOW): the peak bins of each
+    // frame in ascending order, nbins/2 room each, for the pool's workers
+    worker_pool pool;
+    int * curr_active;
+    int * prev_active;
+    long curr_active_count, prev_active_count;
+} harmonic_engine;
+
+// lay out all buffers for a configuration in one 64-byte aligned arena;
+// returns 0 on success
+int  engine_create( harmonic_engine * e, const engine_config * config );
+void engine_destroy( harmonic_engine * e );
+
+// process frames samples; in must hold frames + hop_size samples.  params
+// are the block's targets: gains and threshold are eased toward them hop by
+// hop (see smoothed), the toggle takes effect at once.  leaves one column
+// per hop in column_*
+void engine_process( harmonic_engine * e, const engine_params * params,
+                     const float * in, float * out, long frames );
+
+// same, for a looped source with e->cache set: offset is in[0]'s frame in
+// the loop; hops on the cache's grid take the current frame's magnitude
+// and phase from the cache, or analyze and store them
+void engine_process_looped( harmonic_engine * e, const engine_params * params,
+                            const float * in, float * out, long frames, long offset );
+
+// realtime mode: touch every page of the arena and set up each pool
+// worker with realtime_thread() (offsets 1, 2, ... from the audio thread,
+// which sets itself up); failures are added to status
+void engine_realtime( harmonic_engine * e, const realtime_config * config,
+                      realtime_status * status );
+
+// configure the silence gate (off after engine_create())
+void engine_set_gate( harmonic_engine * e, const engine_gate * gate );
+// "pass|zero|off[,floor_db[,flux]]" into gate; returns 0 on success
+int  engine_parse_gate( engine_gate * gate, const char * spec );
+
+// the current frame's analysis of engine_process() on its own: windowed
+// forward fft and polar conversion of each hop of in (frames + hop_size
+// samples) into magnitude and phase, frames/hop_size frames of nbins each.
+// uses e's fft scratch only, so one analysis can feed several engines
+void engine_analyze( harmonic_engine * e, const float * in, long frames,
+                     float * magnitude, float * phase );
+
+// engine_process() on a block analyzed by engine_analyze(); the previous
+// frame is still e's own processed output
+void engine_process_analyzed( harmonic_engine * e, const engine_params * params,
+                              const float * magnitude, const float * phase,
+                              float * out, long frames );
+
+// the polar conversion stages of engine_process() on their own (the
+// accuracy harness checks them against the double-precision reference)
+void engine_to_polar( const float * restrict re, const float * restrict im,
+                     float * restrict magnitude, float * restrict phase,
+                     long nbins );
+void engine_to_cartesian( const float * restrict magnitude,
+                          const float * restrict phase, float * restrict re,
+                          float * restrict im, long nbins );
+
+#endif
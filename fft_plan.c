@@ -0,0 +1,379 @@
+//-----------------------------------------------------------------------------
+// name: fft_plan.c
+// desc: fft plans - size-specialized, split-complex versions of the CARL
+//       rfft()/cfft()
+//
+//   cfft() in fft.c keeps its stage bookkeeping (mmax, delta, twiddle
+//   recurrence) in runtime variables and works on interleaved re/im pairs.
+//   here the same radix-2 transform works on planar re[]/im[] arrays, is
+//   written once as an always-inlined kernel taking the size as a parameter,
+//   and is instantiated for each power-of-two size we ship, so the compiler
+//   sees constant trip counts and strides for every stage.  the first two
+//   stages are fused into unrolled radix-4 butterflies (their twiddles are 1
+//   and +-i), and twiddles come from per-stage tables read with unit stride
+//   instead of the sin() recurrence.
+//
+//   the real fft wrappers fold the even/odd deinterleave, the bit reversal
+//   and the analysis window into one gather on the way in, and the cfft
+//   scaling into the split step (forward) or the interleave (inverse).
+//
+//   sizes without a codelet run the same kernel with a runtime size.
+//-----------------------------------------------------------------------------
+#include "fft_plan.h"
+#include "fft.h"
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__GNUC__)
+  #define FFT_INLINE static inline __attribute__((always_inline))
+#else
+  #define FFT_INLINE static inline
+#endif
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: cfft_split_fixed()
+// desc: table-driven split-complex cfft() butterflies; NC is a compile-time
+//       constant in each codelet
+//-----------------------------------------------------------------------------
+FFT_INLINE void cfft_split_fixed( const fft_plan * plan, float * restrict re,
+                                  float * restrict im, const long NC,
+                                  unsigned int forward )
+{
+    const float sign = forward ? 1.f : -1.f ;
+    const float * restrict twr = plan->twr ;
+    const float * restrict twi = plan->twi ;
+    long half, span, i, k ;
+
+    // stages 1 and 2 as radix-4 butterflies; twiddles are 1 and +-i
+    for( i = 0 ; i < NC ; i += 4 )
+    {
+        float a0r = re[i]   + re[i+1], a0i = im[i]   + im[i+1] ;
+        float a1r = re[i]   - re[i+1], a1i = im[i]   - im[i+1] ;
+        float a2r = re[i+2] + re[i+3], a2i = im[i+2] + im[i+3] ;
+        float a3r = re[i+2] - re[i+3], a3i = im[i+2] - im[i+3] ;
+        float tr = -sign*a3i, ti = sign*a3r ;
+
+        re[i]   = a0r + a2r ; im[i]   = a0i + a2i ;
+        re[i+2] = a0r - a2r ; im[i+2] = a0i - a2i ;
+        re[i+1] = a1r + tr ;  im[i+1] = a1i + ti ;
+        re[i+3] = a1r - tr ;  im[i+3] = a1i - ti ;
+    }
+
+    // remaining stages
+    for( half = 4 ; half < NC ; half = span )
+    {
+        span = half<<1 ;
+
+        for( i = 0 ; i < NC ; i += span )
+        {
+            float * restrict ar = re + i, * restrict ai = im + i ;
+            float * restrict br = ar + half, * restrict bi = ai + half ;
+
+            for( k = 0 ; k < half ; k++ )
+            {
+                const float wr = twr[half+k] ;
+                const float wi = sign*twi[half+k] ;
+                float rtemp = wr*br[k] - wi*bi[k] ;
+                float itemp = wr*bi[k] + wi*br[k] ;
+
+                br[k] = ar[k] - rtemp ;
+                bi[k] = ai[k] - itemp ;
+                ar[k] += rtemp ;
+                ai[k] += itemp ;
+            }
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// codelets for the common sizes (N complex = window size / 2)
+//-----------------------------------------------------------------------------
+#define DEFINE_CFFT_CODELET( NC ) \
+static void cfft_##NC( const fft_plan * plan, float * re, float * im, \
+                       unsigned int forward ) \
+{ \
+    cfft_split_fixed( plan, re, im, NC, forward ) ; \
+}
+
+DEFINE_CFFT_CODELET( 128 )
+DEFINE_CFFT_CODELET( 256 )
+DEFINE_CFFT_CODELET( 512 )
+DEFINE_CFFT_CODELET( 1024 )
+DEFINE_CFFT_CODELET( 2048 )
+DEFINE_CFFT_CODELET( 4096 )
+DEFINE_CFFT_CODELET( 8192 )
+
+// any other power of 2
+static void cfft_generic( const fft_plan * plan, float * re, float * im,
+                          unsigned int forward )
+{
+    cfft_split_fixed( plan, re, im, plan->N, forward ) ;
+}
+
+static const struct
+{
+    long N ;
+    fft_codelet codelet ;
+} g_codelets[] = {
+    { 128,  cfft_128 },
+    { 256,  cfft_256 },
+    { 512,  cfft_512 },
+    { 1024, cfft_1024 },
+    { 2048, cfft_2048 },
+    { 4096, cfft_4096 },
+    { 8192, cfft_8192 },
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: fft_plan_bytes()
+// desc: table space needed by a plan of N complex points
+//-----------------------------------------------------------------------------
+size_t fft_plan_bytes( long N )
+{
+    return 2 * ARENA_ROUND( N * sizeof(float) )
+         + ARENA_ROUND( (N + 2) * sizeof(float) )
+         + 2 * ARENA_ROUND( N * sizeof(unsigned int) ) ;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: fft_plan_create()
+// desc: plan with its own table block
+//-----------------------------------------------------------------------------
+int fft_plan_create( fft_plan * plan, long N )
+{
+    arena a ;
+
+    plan->mem = NULL ;
+
+    // N must be a power of 2
+    if( N < 4 || ( N & (N-1) ) )
+        return -1 ;
+
+    if( arena_create( &a, fft_plan_bytes( N ), false ) != 0 )
+        return -1 ;
+
+    if( fft_plan_create_in( plan, N, &a ) != 0 )
+    {
+        arena_destroy( &a ) ;
+        return -1 ;
+    }
+
+    plan->mem = a.base ;
+    return 0 ;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: fft_plan_create_in()
+// desc: precompute tables and pick a codelet for a real fft of 2*N points
+//-----------------------------------------------------------------------------
+int fft_plan_create_in( fft_plan * plan, long N, arena * a )
+{
+    const double pi = 4.*atan( 1. ) ;
+    long i, j, m, k, half ;
+
+    plan->N = N ;
+    plan->twr = NULL ;
+    plan->twi = NULL ;
+    plan->rtwiddle = NULL ;
+    plan->bitrev = NULL ;
+    plan->swaps = NULL ;
+    plan->nswaps = 0 ;
+    plan->codelet = cfft_generic ;
+    plan->mem = NULL ;
+
+    // N must be a power of 2
+    if( N < 4 || ( N & (N-1) ) )
+        return -1 ;
+
+    for( k = 0 ; k < (long)(sizeof(g_codelets)/sizeof(g_codelets[0])) ; k++ )
+        if( g_codelets[k].N == N )
+            plan->codelet = g_codelets[k].codelet ;
+
+    plan->twr = (float *)arena_alloc( a, N * sizeof(float) ) ;
+    plan->twi = (float *)arena_alloc( a, N * sizeof(float) ) ;
+    plan->rtwiddle = (float *)arena_alloc( a, (N + 2) * sizeof(float) ) ;
+    plan->bitrev = (unsigned int *)arena_alloc( a, N * sizeof(unsigned int) ) ;
+    plan->swaps = (unsigned int *)arena_alloc( a, N * sizeof(unsigned int) ) ;
+    if( !plan->twr || !plan->twi || !plan->rtwiddle || !plan->bitrev ||
+        !plan->swaps )
+        return -1 ;
+
+    for( half = 4 ; half < N ; half <<= 1 )
+        for( k = 0 ; k < half ; k++ )
+        {
+            plan->twr[half+k] = (float)cos( pi*k/half ) ;
+            plan->twi[half+k] = (float)sin( pi*k/half ) ;
+        }
+
+    for( k = 0 ; k <= N/2 ; k++ )
+    {
+        plan->rtwiddle[2*k] = (float)cos( pi*k/N ) ;
+        plan->rtwiddle[2*k+1] = (float)sin( pi*k/N ) ;
+    }
+
+    // same walk as bit_reverse(), on complex indices
+    for( i = j = 0 ; i < N ; i++, j += m )
+    {
+        plan->bitrev[i] = (unsigned int)j ;
+        if( j > i )
+        {
+            plan->swaps[2*plan->nswaps] = (unsigned int)i ;
+            plan->swaps[2*plan->nswaps+1] = (unsigned int)j ;
+            plan->nswaps++ ;
+        }
+
+        for( m = N>>1 ; m >= 1 && j >= m ; m >>= 1 )
+            j -= m ;
+    }
+
+    return 0 ;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: fft_plan_destroy()
+// desc: release plan tables
+//-----------------------------------------------------------------------------
+void fft_plan_destroy( fft_plan * plan )
+{
+    // arena-backed tables go away with their arena
+    free( plan->mem ) ;
+    plan->mem = NULL ;
+    plan->twr = NULL ;
+    plan->twi = NULL ;
+    plan->rtwiddle = NULL ;
+    plan->bitrev = NULL ;
+    plan->swaps = NULL ;
+    plan->nswaps = 0 ;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: rfft_split()
+// desc: the real fft split/merge step of rfft(), on planar bins; bin N-i
+//       is read and written through re[N-i]/im[N-i], bin N through xr/xi
+//-----------------------------------------------------------------------------
+static void rfft_split( const fft_plan * plan, float * re, float * im,
+                        float c1, float c2, float xr, float xi, float sign )
+{
+    float h1r, h1i, h2r, h2i, wr, wi ;
+    long i, N = plan->N ;
+    const float * rtw = plan->rtwiddle ;
+
+    // i == 0 pairs with the Nyquist value
+    h1r =  c1*(re[0] + xr ) ;
+    h1i =  c1*(im[0] - xi ) ;
+    h2r = -c2*(im[0] + xi ) ;
+    h2i =  c2*(re[0] - xr ) ;
+    re[0] = h1r + h2r ;
+    im[0] = h1i + h2i ;
+    xr = h1r - h2r ;
+
+    for( i = 1 ; i <= N>>1 ; i++ )
+    {
+        wr = rtw[2*i] ;
+        wi = sign*rtw[2*i+1] ;
+        h1r =  c1*(re[i] + re[N-i] ) ;
+        h1i =  c1*(im[i] - im[N-i] ) ;
+        h2r = -c2*(im[i] + im[N-i] ) ;
+        h2i =  c2*(re[i] - re[N-i] ) ;
+        re[i] =  h1r + wr*h2r - wi*h2i ;
+        im[i] =  h1i + wr*h2i + wi*h2r ;
+        re[N-i] =  h1r - wr*h2r + wi*h2i ;
+        im[N-i] = -h1i + wr*h2i + wi*h2r ;
+    }
+
+    // forward: Nyquist goes to im[0]; inverse: rfft() drops it too
+    if( sign > 0 )
+        im[0] = xr ;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: rfft_split_forward()
+// desc: windowed forward real fft into planar bins
+//-----------------------------------------------------------------------------
+void rfft_split_forward( const fft_plan * plan, const float * x,
+                         const float * window, float * re, float * im )
+{
+    const unsigned int * rev = plan->bitrev ;
+    const float scale = (float)(1. / (plan->N<<1)) ;
+    long k, j, N = plan->N ;
+
+    // even/odd samples to re/im, in bit-reversed order
+    if( window )
+        for( k = 0 ; k < N ; k++ )
+        {
+            j = rev[k]<<1 ;
+            re[k] = x[j] * window[j] ;
+            im[k] = x[j+1] * window[j+1] ;
+        }
+    else
+        for( k = 0 ; k < N ; k++ )
+        {
+            j = rev[k]<<1 ;
+            re[k] = x[j] ;
+            im[k] = x[j+1] ;
+        }
+
+    plan->codelet( plan, re, im, FFT_FORWARD ) ;
+
+    // cfft()'s 1/ND output scaling rides on c1/c2
+    rfft_split( plan, re, im, 0.5f*scale, -0.5f*scale, re[0], im[0], 1.f ) ;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: rfft_split_inverse()
+// desc: inverse real fft from planar bins to interleaved time samples
+//-----------------------------------------------------------------------------
+void rfft_split_inverse( const fft_plan * plan, float * re, float * im,
+                         float * x )
+{
+    const unsigned int * sw = plan->swaps ;
+    float xr = im[0], temp ;
+    long k, i, j, N = plan->N ;
+
+    im[0] = 0. ;
+    rfft_split( plan, re, im, 0.5f, 0.5f, xr, 0.f, -1.f ) ;
+
+    for( k = 0 ; k < plan->nswaps ; k++ )
+    {
+        i = sw[2*k] ;
+        j = sw[2*k+1] ;
+        temp = re[i] ; re[i] = re[j] ; re[j] = temp ;
+        temp = im[i] ; im[i] = im[j] ; im[j] = temp ;
+    }
+
+    plan->codelet( plan, re, im, FFT_INVERSE ) ;
+
+    // cfft()'s inverse scaling of 2 rides on the interleave
+    for( k = 0 ; k < N ; k++ )
+    {
+        x[2*k] = 2.f * re[k] ;
+        x[2*k+1] = 2.f * im[k] ;
+    }
+}
@@ -0,0 +1,49 @@
+//-----------------------------------------------------------------------------
+// name: fft_plan.h
+// desc: fft plans - precomputed tables and size-specialized split-complex
+//       kernels for the window sizes we actually run (1024 and 16384 points)
+//-----------------------------------------------------------------------------
+#ifndef __FFT_PLAN_H__
+#define __FFT_PLAN_H__
+
+#include <stddef.h>
+#include "arena.h"
+
+typedef struct fft_plan fft_plan;
+
+// a split-complex cfft kernel (re[] and im[] planar) specialized for one
+// size; expects bit-reversed input and leaves the output unscaled
+typedef void (*fft_codelet)( const fft_plan * plan, float * re, float * im,
+                             unsigned int forward );
+
+struct fft_plan
+{
+    long N;                 // complex points (window size / 2)
+    float * twr;            // per-stage twiddles, stage of half-span h
+    float * twi;            //   stored at offset h: exp(i*pi*k/h), k < h
+    float * rtwiddle;       // exp(i*pi*k/N), k <= N/2, for the real fft split
+    unsigned int * bitrev;  // bit-reversed index of each complex point
+    unsigned int * swaps;   // bit-reverse exchange pairs, complex indices
+    long nswaps;            // number of exchange pairs
+    fft_codelet codelet;    // specialized kernel, or the generic one
+    void * mem;             // table block owned by the plan, if any
+};
+
+// plan a real fft of 2*N points (N complex); returns 0 on success
+int  fft_plan_create( fft_plan * plan, long N );
+// same, with the tables carved from an arena (fft_plan_bytes() of space)
+int  fft_plan_create_in( fft_plan * plan, long N, arena * a );
+size_t fft_plan_bytes( long N );
+void fft_plan_destroy( fft_plan * plan );
+
+// forward real fft of 2*N samples x (times window, if not NULL) into N
+// planar bins; same values and scaling as rfft(), with im[0] holding the
+// real part of the Nyquist value
+void rfft_split_forward( const fft_plan * plan, const float * x,
+                         const float * window, float * re, float * im );
+
+// inverse of rfft_split_forward() into 2*N samples x; re/im are clobbered
+void rfft_split_inverse( const fft_plan * plan, float * re, float * im,
+                         float * x );
+
+#endif
@@ -0,0 +1,460 @@
+//-----------------------------------------------------------------------------
+// name: fftbench.c
+// desc: microbenchmark for the fft.c kernels and the fft_plan split kernels
+//
+//   times rfft and cfft forward and inverse, the split-complex plan kernels
+//   that replace them, apply_window, adaptivecurve, findpeaks and harmonics
+//   for window sizes 256..65536.  reports ns per call, estimated GFLOPS and
+//   cycles per bin as a table on stderr and as JSON on stdout.
+//
+//   each case runs in batches until a batch takes min_time / 5; the best
+//   of 5 batches is kept.  kernels that work in place get a fresh copy of
+//   their input per call, and the time of the copies alone is subtracted.
+//   flop counts are the usual estimates (5 N log2 N per complex fft of N
+//   points, half that for a real one) and, for harmonics, the updates the
+//   generated peak pattern actually makes.  cycles are TSC ticks on x86
+//   and are left out elsewhere.
+//
+//   build:
+//     gcc -O2 -std=gnu99 -o fftbench fftbench.c fft.c fft_plan.c arena.c -lm
+//   run:
+//     ./fftbench [-m min_size] [-M max_size] [-t min_time] > results.json
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "fft.h"
+#include "fft_plan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC    1
+#else
+#define HAVE_TSC    0
+#endif
+
+#define BENCH_BATCHES       5
+#define BENCH_HARMONIC      0.00001f
+#define BENCH_ORDER         2
+
+// buffers for one window size
+typedef struct
+{
+    long W;                 // window size, real samples
+    fft_plan plan;
+    float * src;            // 2W floats of noise, never modified
+    float * work;           // 2W floats, reset from src
+    float * window;
+    float * re_src, * im_src, * re, * im;       // W/2 planar bins
+    float * mag_src, * prev_src, * mag, * prev; // W/2 + 1 magnitudes
+    float * curve;
+    bool * curr_index, * prev_index;
+    double harmonics_flops;
+} bench_ctx;
+
+typedef void (*bench_fn)( bench_ctx * c );
+
+// one benchmarked kernel
+typedef struct
+{
+    const char * kernel;
+    const char * direction; // "forward", "inverse" or NULL
+    bench_fn op;
+    bench_fn reset;         // restores op's input, or NULL
+} bench_kernel;
+
+// one result row
+typedef struct
+{
+    double ns;
+    double cycles;          // per call, < 0 if unknown
+} bench_time;
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: now() / ticks()
+// desc: monotonic seconds; TSC ticks on x86, 0 elsewhere
+//-----------------------------------------------------------------------------
+static double now( )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double ticks( )
+{
+#if HAVE_TSC
+    return (double)__rdtsc( );
+#else
+    return 0.0;
+#endif
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reset_*() / op_*()
+// desc: the kernels under test and their input resets
+//-----------------------------------------------------------------------------
+static void reset_real( bench_ctx * c ) { memcpy( c->work, c->src, c->W * sizeof(float) ); }
+static void reset_complex( bench_ctx * c ) { memcpy( c->work, c->src, 2 * c->W * sizeof(float) ); }
+static void reset_split( bench_ctx * c )
+{
+    memcpy( c->re, c->re_src, c->W / 2 * sizeof(float) );
+    memcpy( c->im, c->im_src, c->W / 2 * sizeof(float) );
+}
+static void reset_magnitude( bench_ctx * c )
+{
+    memcpy( c->mag, c->mag_src, ( c->W / 2 + 1 ) * sizeof(float) );
+    memcpy( c->prev, c->prev_src, ( c->W / 2 + 1 ) * sizeof(float) );
+}
+
+static void op_rfft_forward( bench_ctx * c ) { rfft( c->work, c->W / 2, FFT_FORWARD ); }
+static void op_rfft_inverse( bench_ctx * c ) { rfft( c->work, c->W / 2, FFT_INVERSE ); }
+static void op_cfft_forward( bench_ctx * c ) { cfft( c->work, c->W, FFT_FORWARD ); }
+static void op_cfft_inverse( bench_ctx * c ) { cfft( c->work, c->W, FFT_INVERSE ); }
+static void op_split_forward( bench_ctx * c )
+{
+    rfft_split_forward( &c->plan, c->src, NULL, c->re, c->im );
+}
+static void op_split_inverse( bench_ctx * c )
+{
+    rfft_split_inverse( &c->plan, c->re, c->im, c->work );
+}
+static void op_apply_window( bench_ctx * c ) { apply_window( c->work, c->window, c->W ); }
+static void op_adaptivecurve( bench_ctx * c )
+{
+    adaptivecurve( c->curve, c->mag_src, c->W, 0.0f );
+}
+static void op_findpeaks( bench_ctx * c )
+{
+    findpeaks( c->mag_src, c->curve, c->curr_index, c->W );
+}
+static void op_harmonics( bench_ctx * c )
+{
+    harmonics( c->curr_index, c->prev_index, c->mag, c->prev, c->W, BENCH_HARMONIC, BENCH_ORDER );
+}
+
+static const bench_kernel g_kernels[] =
+{
+    { "rfft", "forward", op_rfft_forward, reset_real },
+    { "rfft", "inverse", op_rfft_inverse, reset_real },
+    { "cfft", "forward", op_cfft_forward, reset_complex },
+    { "cfft", "inverse", op_cfft_inverse, reset_complex },
+    { "rfft_split", "forward", op_split_forward, NULL },
+    { "rfft_split", "inverse", op_split_inverse, reset_split },
+    { "apply_window", NULL, op_apply_window, reset_real },
+    { "adaptivecurve", NULL, op_adaptivecurve, NULL },
+    { "findpeaks", NULL, op_findpeaks, NULL },
+    { "harmonics", NULL, op_harmonics, reset_magnitude },
+};
+#define NUM_KERNELS ( sizeof(g_kernels) / sizeof(g_kernels[0]) )
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: ctx_create()
+// desc: noise, its spectrum and the peaks the player would find in it
+//-----------------------------------------------------------------------------
+static int ctx_create( bench_ctx * c, long W )
+{
+    long i, j;
+
+    memset( c, 0, sizeof(*c) );
+    c->W = W;
+
+    if( fft_plan_create( &c->plan, W / 2 ) != 0 )
+        return -1;
+
+    c->src = (float *)malloc( 2 * W * sizeof(float) );
+    c->work = (float *)malloc( 2 * W * sizeof(float) );
+    c->window = (float *)malloc( W * sizeof(float) );
+    c->re_src = (float *)malloc( W / 2 * sizeof(float) );
+    c->im_src = (float *)malloc( W / 2 * sizeof(float) );
+    c->re = (float *)malloc( W / 2 * sizeof(float) );
+    c->im = (float *)malloc( W / 2 * sizeof(float) );
+    c->mag_src = (float *)malloc( ( W / 2 + 1 ) * sizeof(float) );
+    c->prev_src = (float *)malloc( ( W / 2 + 1 ) * sizeof(float) );
+    c->mag = (float *)malloc( ( W / 2 + 1 ) * sizeof(float) );
+    c->prev = (float *)malloc( ( W / 2 + 1 ) * sizeof(float) );
+    c->curve = (float *)malloc( W / 4 * sizeof(float) );
+    c->curr_index = (bool *)malloc( W / 4 * sizeof(bool) );
+    c->prev_index = (bool *)malloc( W / 4 * sizeof(bool) );
+    if( !c->src || !c->work || !c->window || !c->re_src || !c->im_src || !c->re ||
+        !c->im || !c->mag_src || !c->prev_src || !c->mag || !c->prev || !c->curve ||
+        !c->curr_index || !c->prev_index )
+        return -1;
+
+    srand( 1 );
+    for( i = 0; i < 2 * W; i++ )
+        c->src[i] = 2.0f * rand( ) / (float)RAND_MAX - 1.0f;
+    hanning( c->window, W );
+
+    // magnitudes of two windowed noise frames, as the engine would see them
+    rfft_split_forward( &c->plan, c->src, c->window, c->re_src, c->im_src );
+    for( i = 0; i < W / 2; i++ )
+        c->mag_src[i] = sqrtf( c->re_src[i] * c->re_src[i] + c->im_src[i] * c->im_src[i] );
+    rfft_split_forward( &c->plan, c->src + W, c->window, c->re, c->im );
+    for( i = 0; i < W / 2; i++ )
+        c->prev_src[i] = sqrtf( c->re[i] * c->re[i] + c->im[i] * c->im[i] );
+    c->mag_src[W / 2] = c->prev_src[W / 2] = 0.0f;
+
+    adaptivecurve( c->curve, c->mag_src, W, 0.0f );
+    findpeaks( c->mag_src, c->curve, c->curr_index, W );
+    adaptivecurve( c->curve, c->prev_src, W, 0.0f );
+    findpeaks( c->prev_src, c->curve, c->prev_index, W );
+
+    // two adds per step of the inner loops harmonics() will run
+    for( j = 1; j < W / 4; j++ )
+    {
+        long steps = j * BENCH_ORDER < W / 4 ? ( W / 4 - 1 - j * BENCH_ORDER ) / ( BENCH_ORDER * j ) + 1 : 0;
+        c->harmonics_flops += 2.0 * steps * ( c->curr_index[j] + c->prev_index[j] );
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: ctx_destroy()
+// desc: free a window size's plan and buffers
+//-----------------------------------------------------------------------------
+static void ctx_destroy( bench_ctx * c )
+{
+    fft_plan_destroy( &c->plan );
+    free( c->src ); free( c->work ); free( c->window );
+    free( c->re_src ); free( c->im_src ); free( c->re ); free( c->im );
+    free( c->mag_src ); free( c->prev_src ); free( c->mag ); free( c->prev );
+    free( c->curve ); free( c->curr_index ); free( c->prev_index );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: run_batches()
+// desc: best of BENCH_BATCHES batches of reps calls, per call
+//-----------------------------------------------------------------------------
+static bench_time run_batches( bench_ctx * c, bench_fn op, bench_fn reset, long reps )
+{
+    bench_time best = { 1e30, 1e30 };
+    int b;
+    long r;
+
+    for( b = 0; b < BENCH_BATCHES; b++ )
+    {
+        double t0 = now( ), k0 = ticks( ), t, k;
+
+        for( r = 0; r < reps; r++ )
+        {
+            if( reset ) reset( c );
+            if( op ) op( c );
+        }
+
+        k = ticks( ) - k0;
+        t = now( ) - t0;
+        if( t * 1e9 / reps < best.ns )
+        {
+            best.ns = t * 1e9 / reps;
+            best.cycles = k / reps;
+        }
+    }
+
+    return best;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: time_kernel()
+// desc: calibrate the batch length, then time op with its reset and the
+//       reset alone
+//-----------------------------------------------------------------------------
+static bench_time time_kernel( bench_ctx * c, const bench_kernel * k, double min_time )
+{
+    bench_time with, without = { 0.0, 0.0 };
+    long reps = 1;
+
+    // warm up and find a batch that takes min_time / BENCH_BATCHES
+    for( ;; )
+    {
+        double t0 = now( );
+        long r;
+        for( r = 0; r < reps; r++ )
+        {
+            if( k->reset ) k->reset( c );
+            k->op( c );
+        }
+        if( now( ) - t0 >= min_time / BENCH_BATCHES || reps > ( 1L << 30 ) )
+            break;
+        reps *= 2;
+    }
+
+    with = run_batches( c, k->op, k->reset, reps );
+    if( k->reset )
+        without = run_batches( c, NULL, k->reset, reps );
+
+    with.ns -= without.ns;
+    with.cycles -= without.cycles;
+    if( with.ns < 0.0 ) with.ns = 0.0;
+    if( !HAVE_TSC || with.cycles < 0.0 ) with.cycles = -1.0;
+
+    return with;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: estimate()
+// desc: flops and bins of one call of kernel k at window size W
+//-----------------------------------------------------------------------------
+static void estimate( const bench_ctx * c, const bench_kernel * k, double * flops, long * bins )
+{
+    const long W = c->W;
+    const double lg = log2( (double)W );
+
+    if( !strcmp( k->kernel, "cfft" ) )
+    {
+        *flops = 5.0 * W * lg;
+        *bins = W;
+    }
+    else if( !strcmp( k->kernel, "rfft" ) || !strcmp( k->kernel, "rfft_split" ) )
+    {
+        *flops = 2.5 * W * lg;
+        *bins = W / 2;
+    }
+    else if( !strcmp( k->kernel, "apply_window" ) )
+    {
+        *flops = W;
+        *bins = W;
+    }
+    else if( !strcmp( k->kernel, "adaptivecurve" ) )
+    {
+        // per 8 bins: 7 adds and a divide for the average, then 3 per bin
+        *flops = W / 4 * 4.0;
+        *bins = W / 4;
+    }
+    else if( !strcmp( k->kernel, "findpeaks" ) )
+    {
+        *flops = W / 4;
+        *bins = W / 4;
+    }
+    else
+    {
+        *flops = c->harmonics_flops;
+        *bins = W / 4;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: usage()
+// desc: print the options to stderr
+//-----------------------------------------------------------------------------
+static void usage( const char * name )
+{
+    fprintf( stderr, "Usage: %s [-m min_size] [-M max_size] [-t min_time]\n"
+                     "  -m, -M  window sizes, powers of 2 (default 256 and 65536)\n"
+                     "  -t      seconds per case (default 0.2)\n", name );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: main()
+// desc: every case at every window size from min to max, table to
+//       stderr and JSON to stdout
+//-----------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+    long min_size = 256, max_size = 65536, W;
+    double min_time = 0.2;
+    bool first = true;
+    int opt;
+    size_t k;
+
+    while( ( opt = getopt( argc, argv, "m:M:t:" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'm': min_size = atol( optarg ); break;
+            case 'M': max_size = atol( optarg ); break;
+            case 't': min_time = atof( optarg ); break;
+            default: usage( argv[0] ); return EXIT_FAILURE;
+        }
+    }
+    if( min_size < 32 || ( min_size & ( min_size - 1 ) ) || max_size < min_size || min_time <= 0.0 )
+    {
+        usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    fprintf( stderr, "%-14s %-8s %6s %12s %8s %10s\n",
+             "kernel", "dir", "size", "ns", "GFLOPS", "cyc/bin" );
+
+    printf( "{\n  \"benchmark\": \"fftbench\",\n  \"min_time_s\": %g,\n"
+            "  \"cycles\": \"%s\",\n  \"results\": [\n", min_time, HAVE_TSC ? "tsc" : "none" );
+
+    for( W = min_size; W <= max_size; W *= 2 )
+    {
+        bench_ctx c;
+
+        if( ctx_create( &c, W ) != 0 )
+        {
+            fprintf( stderr, "Error: could not set up size %ld\n", W );
+            return EXIT_FAILURE;
+        }
+
+        for( k = 0; k < NUM_KERNELS; k++ )
+        {
+            const bench_kernel * kernel = &g_kernels[k];
+            bench_time t = time_kernel( &c, kernel, min_time );
+            double flops, gflops, cycles_per_bin;
+            long bins;
+
+            estimate( &c, kernel, &flops, &bins );
+            gflops = t.ns > 0.0 ? flops / t.ns : 0.0;
+            cycles_per_bin = t.cycles >= 0.0 ? t.cycles / bins : -1.0;
+
+            fprintf( stderr, "%-14s %-8s %6ld %12.1f %8.3f %10.2f\n", kernel->kernel,
+                     kernel->direction ? kernel->direction : "-", W, t.ns, gflops,
+                     cycles_per_bin );
+
+            printf( "%s    { \"kernel\": \"%s\", \"direction\": ", first ? "" : ",\n",
+                    kernel->kernel );
+            if( kernel->direction )
+                printf( "\"%s\"", kernel->direction );
+            else
+                printf( "null" );
+            printf( ", \"size\": %ld, \"bins\": %ld, \"ns\": %.2f, \"flops\": %.0f, "
+                    "\"gflops\": %.4f, \"cycles_per_bin\": ", W, bins, t.ns, flops, gflops );
+            if( cycles_per_bin >= 0.0 )
+                printf( "%.3f }", cycles_per_bin );
+            else
+                printf( "null }" );
+            first = false;
+        }
+
+        ctx_destroy( &c );
+    }
+
+    printf( "\n  ]\n}\n" );
+
+    return EXIT_SUCCESS;
+}
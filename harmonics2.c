@@ -7,6 +7,7 @@
 #define STEREO              2
 #define INCREMENT           0.000001
 #define threshINCREMENT     0.0001
+#define HUGE_PAGES          false
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -18,30 +19,59 @@
 #include <string.h> /* for memset */
 #include <ncurses.h>
 #include "fft.h"
+#include "engine.h"
+#include "mailbox.h"
+#include "recorder.h"
+#include "trace.h"
+#include "rtcheck.h"
 
 typedef struct {
     float sampleRate;
     SNDFILE *infile;
     SF_INFO sfinfo_in;
-    float file_buff[STEREO * (FRAMES_PER_BUFFER + HOP_SIZE)];
-    float window[WINDOW_SIZE];
-    float prev_win[WINDOW_SIZE];
-    float curr_win[WINDOW_SIZE];
-    float second;
-    float third;
-    float fifth;
-    float threshold;
+    long loop_frames;       /* frames looped over (whole hops with the cache) */
+    long position;          /* loop frame the next read starts at */
+    harmonic_engine engine;
+    engine_params params;   /* UI thread's copy */
+    param_mailbox mailbox;  /* published to the callback */
+    bool realtime;          /* HARMONICS_REALTIME: the callback sets itself up */
+    realtime_config realtime_config;
+    realtime_status realtime_status;
+    int realtime_done;      /* set by the callback once it has */
+    bool recording;         /* HARMONICS_RECORD: the output is tapped */
+    recorder recorder;
 } paData;
 
+/*
+ *  Description:  Read frames from the looped file, wrapping at loop_frames;
+ *                returns the loop offset of the first frame
+ */
+static long loop_read( paData *data, float *buff, long frames )
+{
+    long offset = data->position, done = 0, want, got;
+
+    while ( done < frames ) {
+        want = frames - done;
+        if ( want > data->loop_frames - data->position )
+            want = data->loop_frames - data->position;
+        got = sf_readf_float( data->infile, buff + done * data->sfinfo_in.channels, want );
+        done += got;
+        data->position += got;
+
+        /* End of the loop (or of a file shorter than it said): start again */
+        if ( got < want || data->position >= data->loop_frames ) {
+            if ( got == 0 && data->position == 0 ) {
+                memset( buff + done * data->sfinfo_in.channels, 0,
+                        ( frames - done ) * data->sfinfo_in.channels * sizeof(float) );
+                break;
+            }
+            sf_seek( data->infile, 0, SEEK_SET );
+            data->position = 0;
+        }
+    }
 
-float curr_magnitude[WINDOW_SIZE/2];
-float curr_phase[WINDOW_SIZE/2];
-
-float prev_magnitude[WINDOW_SIZE/2];
-float prev_phase[WINDOW_SIZE/2];
-
-bool  curr_harmonicsindex[WINDOW_SIZE/4];
-bool  prev_harmonicsindex[WINDOW_SIZE/4];
+    return offset;
+}
 
 /*
  *  Description:  Callback for Port Audio
@@ -51,142 +81,53 @@ static int paCallback( const void *inputBuffer,
 			 const PaStreamCallbackTimeInfo* timeInfo,
 			 PaStreamCallbackFlags statusFlags, void *userData )
 {
-    int i, j, k, readcount;
+    int i;
+    long offset;
 
     /* Cast void pointers */
     float *out = (float*)outputBuffer;
     paData *data = (paData*)userData;
+    harmonic_engine *engine = &data->engine;
+    TRACE_START( total );
+    TRACE_START( t );
 
-    /* Read frames of float type into our buffer */
-    readcount = sf_readf_float( data->infile, data->file_buff, framesPerBuffer + HOP_SIZE);
+    TRACE_CALLBACK( statusFlags, timeInfo->currentTime, timeInfo->outputBufferDacTime );
+    RTCHECK_ENTER( );
 
-    /* If we're at the end of the file, let's start again */
-    if ( readcount < framesPerBuffer ) {
-        sf_seek( data->infile, 0, SEEK_SET );
-        readcount = sf_readf_float( data->infile, data->file_buff + readcount * data->sfinfo_in.channels, framesPerBuffer - readcount + HOP_SIZE );
+    /* Realtime mode: priority, CPU and denormals of the callback thread */
+    if ( data->realtime && !data->realtime_done ) {
+        realtime_thread( &data->realtime_config, 0, &data->realtime_status );
+        __atomic_store_n( &data->realtime_done, 1, __ATOMIC_RELEASE );
     }
 
+    /* Read frames of float type into our buffer, looping at the end */
+    offset = loop_read( data, engine->file_buff, framesPerBuffer + HOP_SIZE );
+
     /* Rewind the hop size */
-    sf_seek( data->infile, -HOP_SIZE, SEEK_CUR );
+    data->position = ( ( data->position - HOP_SIZE ) % data->loop_frames + data->loop_frames ) % data->loop_frames;
+    sf_seek( data->infile, data->position, SEEK_SET );
 
     /* Separate left channel */
-    float left[framesPerBuffer+HOP_SIZE];
     for (i = 0; i < framesPerBuffer + HOP_SIZE; ++i)
     {
-        left[i] = data->file_buff[2*i];
+        engine->input[i] = engine->file_buff[engine->channels*i];
     }
+    TRACE_MARK( t, TRACE_IO );
 
-    /* STFT */
-    for (i = 0; i < framesPerBuffer; i+=HOP_SIZE)
-    {
-        /* Apply window to current frame */
-        for (j = 0; j < WINDOW_SIZE; j++) {
-            data->curr_win[j] = left[i+j];
-        }
-        apply_window(data->curr_win, data->window, WINDOW_SIZE);
-
-        /* FFT */
-        rfft( data->curr_win, WINDOW_SIZE/2, FFT_FORWARD );
-        complex * curr_cbuf = (complex *)data->curr_win;
-        rfft( data->prev_win, WINDOW_SIZE/2, FFT_FORWARD );
-        complex * prev_cbuf = (complex *)data->prev_win;
-
-        /* Get Magnitude and Phase (polar coordinates) */
-        for (j = 0; j < WINDOW_SIZE/2; ++j)
-        {
-            curr_magnitude[j] = cmp_abs(curr_cbuf[j]);
-            curr_phase[j] = atan2f(curr_cbuf[j].im, curr_cbuf[j].re);
-
-            prev_magnitude[j] = cmp_abs(prev_cbuf[j]);
-            prev_phase[j] = atan2f(prev_cbuf[j].im, prev_cbuf[j].re);
-        }
-
-        findpeaks(curr_magnitude, curr_harmonicsindex, WINDOW_SIZE, data->threshold);
-        findpeaks(prev_magnitude, prev_harmonicsindex, WINDOW_SIZE, data->threshold);
-
-        for (j = 1; j < WINDOW_SIZE/4; j++)
-        {
-            if (curr_harmonicsindex[j] == true)
-            {
-                for (k = j*2; k < WINDOW_SIZE/4; k+=2*j)
-                {
-                    curr_magnitude[k] += ((1-k/4096) * data->second)/2;
-                    curr_magnitude[WINDOW_SIZE/2-k] += ((1-k/4096) * data->second)/2;
-                }
-            }
-            if (prev_harmonicsindex[j] == true)
-            {
-                for (k = j*2; k < WINDOW_SIZE/4; k+=2*j)
-                {
-                    prev_magnitude[k] += ((1-k/4096) * data->second)/2;
-                    prev_magnitude[WINDOW_SIZE/2-k] += ((1-k/4096) * data->second)/2;
-                }
-            }
-        }
-
-        for (j = 1; j < WINDOW_SIZE/4; j++)
-        {
-            if (curr_harmonicsindex[j] == true)
-            {
-                for (k = j*3; k < WINDOW_SIZE/4; k+=3*j)
-                {
-                    curr_magnitude[k] += ((1-k/4096) * data->third)/2;
-                    curr_magnitude[WINDOW_SIZE/2-k] += ((1-k/4096) * data->third)/2;
-                }
-            }
-            if (prev_harmonicsindex[j] == true)
-            {
-                for (k = j*3; k < WINDOW_SIZE/4; k+=3*j)
-                {
-                    prev_magnitude[k] += ((1-k/4096) * data->third)/2;
-                    prev_magnitude[WINDOW_SIZE/2-k] += ((1-k/4096) * data->third)/2;
-                }
-            }
-        }
+    /* Pick up the latest parameters from the UI thread */
+    engine_params params;
+    mailbox_read( &data->mailbox, &params );
+    TRACE_MARK( t, TRACE_PARAMS );
 
-        for (j = 1; j < WINDOW_SIZE/4; j++)
-        {
-            if (curr_harmonicsindex[j] == true)
-            {
-                for (k = j*5; k < WINDOW_SIZE/4; k+=5*j)
-                {
-                    curr_magnitude[k] += ((1-k/4096) * data->fifth)/2;
-                    curr_magnitude[WINDOW_SIZE/2-k] += ((1-k/4096) * data->fifth)/2;
-                }
-            }
-            if (prev_harmonicsindex[j] == true)
-            {
-                for (k = j*5; k < WINDOW_SIZE/4; k+=5*j)
-                {
-                    prev_magnitude[k] += ((1-k/4096) * data->fifth)/2;
-                    prev_magnitude[WINDOW_SIZE/2-k] += ((1-k/4096) * data->fifth)/2;
-                }
-            }
-        }
+    /* STFT, harmonics generation and overlap-add */
+    engine_process_looped( engine, &params, engine->input, out, framesPerBuffer, offset );
 
-        /* Back to Cartesian coordinates */
-        for (j = 0; j < WINDOW_SIZE/2; j++) {
-            curr_cbuf[j].re = curr_magnitude[j] * cosf(curr_phase[j]);
-            curr_cbuf[j].im = curr_magnitude[j] * sinf(curr_phase[j]);
-            prev_cbuf[j].re = prev_magnitude[j] * cosf(prev_phase[j]);
-            prev_cbuf[j].im = prev_magnitude[j] * sinf(prev_phase[j]);
-        }
-
-        // /* Back to Time Domain */
-        rfft( (float*)curr_cbuf, WINDOW_SIZE/2, FFT_INVERSE );
-        rfft( (float*)prev_cbuf, WINDOW_SIZE/2, FFT_INVERSE );
-
-        /* Assign to the output */
-        for (j = 0; j < HOP_SIZE; j++) {
-            out[i+j] = data->prev_win[j+HOP_SIZE] + data->curr_win[j];
-        }
-
-        /* Update previous window */
-        for (j = 0; j < WINDOW_SIZE; j++) {
-            data->prev_win[j] = data->curr_win[j];
-        }
-    }
+    /* Queue the block for the recording writer; dropped if it is behind */
+    if ( data->recording )
+        recorder_push( &data->recorder, out, framesPerBuffer );
 
+    TRACE_SPAN( total, TRACE_CALLBACK_TOTAL );
+    RTCHECK_LEAVE( );
     return paContinue;
 }
 
@@ -200,6 +141,9 @@ int main( int argc, char **argv ) {
     PaStreamParameters inputParameters;
     PaError err;
     paData data;
+    loop_cache cache;
+    const char *cache_mode, *gate_spec, *threads, *realtime, *record;
+    int waited;
 
     /* Check arguments */
     if ( argc != 2 ) {
@@ -218,15 +162,94 @@ int main( int argc, char **argv ) {
             (int)data.sfinfo_in.frames, (int)data.sfinfo_in.channels,
             (int)data.sfinfo_in.samplerate);
 
-    /* Init Windows */
-    hanning(data.window, WINDOW_SIZE);
-    memset(&data.prev_win, 0, WINDOW_SIZE*sizeof(float));
+    /* Init the processing engine (all stream buffers in one arena) */
+    engine_config config = { .window_size = WINDOW_SIZE, .frames_per_buffer = FRAMES_PER_BUFFER,
+                             .channels = data.sfinfo_in.channels, .huge_pages = HUGE_PAGES };
+    /* Opt-in harmonics workers: the window is large enough to split */
+    if (( threads = getenv( "HARMONICS_THREADS" ) ) != NULL )
+        config.threads = atoi( threads );
+    if ( engine_create( &data.engine, &config ) != 0 ) {
+        printf("Error, couldn't create the processing engine\n");
+        return EXIT_FAILURE;
+    }
+    printf("Engine memory: %lu bytes (%s)\n", (unsigned long)data.engine.mem.size,
+            arena_backing_name( &data.engine.mem ));
+
+    /* Opt-in silence gate: quiet hops skip the spectral chain */
+    if (( gate_spec = getenv( "HARMONICS_GATE" ) ) != NULL ) {
+        engine_gate gate;
+        if ( engine_parse_gate( &gate, gate_spec ) != 0 ) {
+            printf("Error, HARMONICS_GATE is pass|zero|off[,floor_db[,flux]]\n");
+            return EXIT_FAILURE;
+        }
+        engine_set_gate( &data.engine, &gate );
+    }
 
-    /* Init lowpass and highpass */
-    data.second = 0.000000f;
-    data.third = 0.000000f;
-    data.fifth = 0.000000f;
-    data.threshold = 0.0001f;
+    /* Opt-in analysis cache: passes after the first skip the input analysis */
+    data.loop_frames = data.sfinfo_in.frames;
+    data.position = 0;
+    if ( data.loop_frames < HOP_SIZE ) {
+        printf("Error, the file is shorter than one hop (%d frames)\n", HOP_SIZE);
+        return EXIT_FAILURE;
+    }
+    memset( &cache, 0, sizeof(cache) );
+    if (( cache_mode = getenv( "HARMONICS_LOOP_CACHE" ) ) != NULL ) {
+        bool half = strcmp( cache_mode, "fp16" ) == 0;
+        if ( !half && strcmp( cache_mode, "fp32" ) != 0 ) {
+            printf("Error, HARMONICS_LOOP_CACHE is fp32 or fp16\n");
+            return EXIT_FAILURE;
+        }
+        /* Keys repeat every pass only over whole hops */
+        data.loop_frames = loopcache_frames( data.sfinfo_in.frames, HOP_SIZE );
+        if ( loopcache_create( &cache, data.loop_frames, HOP_SIZE, data.engine.nbins, half ) != 0 ) {
+            printf("Error, couldn't allocate the analysis cache\n");
+            return EXIT_FAILURE;
+        }
+        data.engine.cache = &cache;
+        printf("Analysis cache: %lu bytes (%s), loop of %ld frames\n",
+                (unsigned long)cache.mem.size, cache_mode, data.loop_frames);
+    }
+
+    /* Init harmonics and threshold */
+    data.params.second = 0.000000f;
+    data.params.third = 0.000000f;
+    data.params.fifth = 0.000000f;
+    data.params.threshold = 0.0001f;
+    data.params.toggle = true;
+    data.params.waveshaper = false;
+    data.params.sparse = false;
+    mailbox_init( &data.mailbox, &data.params );
+
+    /* Opt-in realtime mode: locked memory, SCHED_FIFO, affinity, FTZ/DAZ */
+    data.realtime = false;
+    data.realtime_done = 0;
+    memset( &data.realtime_status, 0, sizeof(data.realtime_status) );
+    if (( realtime = getenv( "HARMONICS_REALTIME" ) ) != NULL ) {
+        if ( realtime_parse( &data.realtime_config, realtime ) != 0 ) {
+            printf("Error, HARMONICS_REALTIME is priority[,cpu]\n");
+            return EXIT_FAILURE;
+        }
+        realtime_lock_memory( &data.realtime_status );
+        engine_realtime( &data.engine, &data.realtime_config, &data.realtime_status );
+        if ( data.engine.cache )
+            realtime_prefault( cache.mem.base, cache.mem.size );
+        data.realtime = true;
+    }
+
+    /* Opt-in recording of the output: .wav, .flac or .raw */
+    data.recording = false;
+    if (( record = getenv( "HARMONICS_RECORD" ) ) != NULL ) {
+        if ( recorder_open( &data.recorder, record, SAMPLE_RATE, NUM_OUT_CHANNELS, FRAMES_PER_BUFFER ) != 0 ) {
+            printf("Error, couldn't record to %s (HARMONICS_RECORD is a .wav, .flac or .raw path)\n", record);
+            return EXIT_FAILURE;
+        }
+        printf("Recording to %s\n", record);
+        data.recording = true;
+    }
+
+    /* Per-stage callback timing (-DHARMONICS_TRACE builds only) */
+    if ( TRACE_SETUP( getenv( "HARMONICS_TRACE_FILE" ) ) != 0 )
+        return 1;
 
     /* Initialize PortAudio */
     Pa_Initialize();
@@ -264,6 +287,16 @@ int main( int argc, char **argv ) {
         printf(  "PortAudio error: start stream: %s\n", Pa_GetErrorText(err));
     }
 
+    /* Report what realtime mode could not apply, once the callback has run */
+    if ( data.realtime ) {
+        for ( waited = 0; waited < 100 && !__atomic_load_n( &data.realtime_done, __ATOMIC_ACQUIRE ); waited++ )
+            Pa_Sleep( 10 );
+        if ( __atomic_load_n( &data.realtime_done, __ATOMIC_ACQUIRE ) )
+            realtime_report( stdout, "audio and harmonics threads", &data.realtime_status );
+        else
+            printf("Realtime: the audio callback has not run yet, its thread is not set up\n");
+    }
+
     /**************************************************************************/
     /* Main loop */
     /**************************************************************************/
@@ -280,79 +313,92 @@ int main( int argc, char **argv ) {
              "[d/f/c] decreases/increases/resets 3rd order harmonics\n" \
              "[g/h/b] decreases/increases/resets 5th order harmonics\n" \
              "[l/;/.] decreases/increases/resets sensitivity threshold\n"
-             "[q] to quit\n", data.second, data.third, data.fifth, data.threshold);
+             "[m] switches between the spectral chain and the waveshaper\n"
+             "[k] toggles sparse harmonics of interpolated peaks\n"
+             "[q] to quit\n", data.params.second, data.params.third, data.params.fifth, data.params.threshold);
 
     while (ch != 'q') {
         ch = getch(); /* If cbreak hadn't been called, you would have to press enter
                        before it gets to the program */
         switch (ch) {
             case 'a':
-                data.second -= INCREMENT;
-                if (data.second < 0) {
-                    data.second = 0;
+                data.params.second -= INCREMENT;
+                if (data.params.second < 0) {
+                    data.params.second = 0;
                 }
                 break;
             case 's':
-                data.second += INCREMENT;
-                if (data.second > 1) {
-                    data.second = 1;
+                data.params.second += INCREMENT;
+                if (data.params.second > 1) {
+                    data.params.second = 1;
                 }
                 break;
             case 'z':
-                data.second = 0.000000f;
+                data.params.second = 0.000000f;
                 break;
             case 'd':
-                data.third -= INCREMENT;
-                if (data.third < 0) {
-                    data.third = 0;
+                data.params.third -= INCREMENT;
+                if (data.params.third < 0) {
+                    data.params.third = 0;
                 }
                 break;
             case 'f':
-                data.third += INCREMENT;
-                if (data.third > 1) {
-                    data.third = 1;
+                data.params.third += INCREMENT;
+                if (data.params.third > 1) {
+                    data.params.third = 1;
                 }
                 break;
             case 'c':
-                data.third = 0.000000f;
+                data.params.third = 0.000000f;
                 break;
             case 'g':
-                data.fifth -= INCREMENT;
-                if (data.fifth < 0) {
-                    data.fifth = 0;
+                data.params.fifth -= INCREMENT;
+                if (data.params.fifth < 0) {
+                    data.params.fifth = 0;
                 }
                 break;
             case 'h':
-                data.fifth += INCREMENT;
-                if (data.fifth > 1) {
-                    data.fifth = 1;
+                data.params.fifth += INCREMENT;
+                if (data.params.fifth > 1) {
+                    data.params.fifth = 1;
                 }
                 break;
             case 'b':
-                data.fifth = 0.000000f;
+                data.params.fifth = 0.000000f;
                 break;
             case 'l':
-                data.threshold -= threshINCREMENT;
-                if (data.threshold < 0) {
-                    data.threshold = 0;
+                data.params.threshold -= threshINCREMENT;
+                if (data.params.threshold < 0) {
+                    data.params.threshold = 0;
                 }
                 break;
             case ';':
-                data.threshold += threshINCREMENT;
-                if (data.threshold > 1) {
-                    data.threshold = 1;
+                data.params.threshold += threshINCREMENT;
+                if (data.params.threshold > 1) {
+                    data.params.threshold = 1;
                 }
                 break;
             case '.':
-                data.threshold = 0.000100f;
+                data.params.threshold = 0.000100f;
+                break;
+            case 'm':
+                data.params.waveshaper = !data.params.waveshaper;
+                break;
+            case 'k':
+                data.params.sparse = !data.params.sparse;
                 break;
         }
+        /* hand the new parameters to the audio callback */
+        mailbox_write( &data.mailbox, &data.params );
+
         /* use ncurses function mvprintw(x, y, printf args..)  to a location on the terminal */
         mvprintw(0, 0, "2nd Order: %1.6f 3rd Order: %1.6f\n5th Order: %1.6f Threshold: %1.6f\n[a/s/z] decreases/increases/resets 2nd order harmonics\n" \
              "[d/f/c] decreases/increases/resets 3rd order harmonics\n" \
              "[g/h/b] decreases/increases/resets 5th order harmonics\n" \
              "[l/;/.] decreases/increases/resets sensitivity threshold\n"
-             "[q] to quit\n", data.second, data.third, data.fifth, data.threshold);
+             "[m] switches between the spectral chain and the waveshaper\n"
+             "[k] toggles sparse harmonics of interpolated peaks\n"
+             "[q] to quit\n", data.params.second, data.params.third, data.params.fifth, data.params.threshold);
 
     }
     /* End curses mode  */
@@ -375,5 +421,21 @@ int main( int argc, char **argv ) {
         printf("PortAudio error: terminate: %s\n", Pa_GetErrorText(err));
     }
 
+    TRACE_SHUTDOWN( );
+    TRACE_REPORT( stdout );
+
+    if ( data.recording ) {
+        recorder_close( &data.recorder );
+        recorder_report( stdout, &data.recorder );
+    }
+
+    if ( data.engine.cache )
+        printf("Analysis cache: %lu hits, %lu misses\n", cache.hits, cache.misses);
+    if ( getenv( "HARMONICS_GATE" ) )
+        printf("Silence gate: %lu hops gated, %lu masks reused\n",
+                data.engine.gated_hops, data.engine.reused_hops);
+    loopcache_destroy( &cache );
+    engine_destroy( &data.engine );
+
     return 0;
 }
@@ -13,6 +13,15 @@
 #include <string.h>
 #include <ncurses.h>
 #include "fft.h"
+#include "engine.h"
+#include "mailbox.h"
+#include "recorder.h"
+#include "snapshot.h"
+#include "views.h"
+#include "spectrogram.h"
+#include "pacer.h"
+#include "trace.h"
+#include "rtcheck.h"
 
 // OpenGL
 #ifdef __MACOSX_CORE__
@@ -53,7 +62,10 @@
 #define INIT_HEIGHT             600
 #define BUFFER_SIZE		FRAMES_PER_BUFFER
 #define SCROLL_BUFFER_SIZE (FRAMES_PER_BUFFER * 60)
-#define G_SCROLL_WRITER (SCROLL_BUFFER_SIZE - BUFFER_SIZE)
+#define HOPS_PER_BUFFER         (FRAMES_PER_BUFFER / HOP_SIZE)
+#define SPECTROGRAM_COLUMNS     512
+#define HUGE_PAGES              false
+#define FRAME_RATE              30
 
 typedef double  MY_TYPE;
 typedef char BYTE;   // 8-bit unsigned entity.
@@ -66,55 +78,41 @@ GLsizei g_last_height = INIT_HEIGHT;
 
 // global audio vars
 GLint g_buffer_size = BUFFER_SIZE;
-SAMPLE g_buffer[BUFFER_SIZE*2];
-SAMPLE pre_g_buffer[BUFFER_SIZE*2];
 unsigned int g_channels = MONO;
-GLint g_scroll_buffer_size = SCROLL_BUFFER_SIZE;
-SAMPLE g_scroll_buffer[SCROLL_BUFFER_SIZE];
-int g_scroll_reader = 0;
-int g_scroll_writer = G_SCROLL_WRITER;
-SAMPLE pre_fft_buffer[WINDOW_SIZE/4];
-SAMPLE g_adaptive_curve[WINDOW_SIZE/4];
+
+// processed blocks handed from the audio callback to displayFunc()
+viz_channel g_viz;
+
+// redraw only for new blocks or window changes, at most g_fps per second
+double g_fps = FRAME_RATE;
+frame_pacer g_pacer;
+
+// show the spectrogram
+GLboolean g_waterfall = true;
+
+// opt-in (HARMONICS_LOOP_CACHE=fp32|fp16) analysis of the looped input
+loop_cache g_cache;
 
 //define paData struct
 typedef struct{
     float sampleRate;
     SNDFILE *infile;
     SF_INFO sfinfo;
-    float file_buff[STEREO * (FRAMES_PER_BUFFER + HOP_SIZE)];
-    float window[WINDOW_SIZE];
-    float prev_win[WINDOW_SIZE];
-    float curr_win[WINDOW_SIZE];
-    float second;
-    float third;
-    float fifth;
-    float threshold;
+    long loop_frames;       // frames looped over (whole hops with the cache)
+    long position;          // loop frame the next read starts at
+    harmonic_engine engine;
+    engine_params params;   // GUI thread's copy
+    param_mailbox mailbox;  // published to the audio callback
+    bool realtime;          // HARMONICS_REALTIME: the callback sets itself up
+    realtime_config realtime_config;
+    realtime_status realtime_status;
+    int realtime_done;      // set by the callback once it has
+    bool recording;         // HARMONICS_RECORD: the output is tapped
+    recorder recorder;
 } paData;
 
 paData data;
 
-//define curr magnitude bins
-float curr_magnitude[WINDOW_SIZE/2];
-float curr_phase[WINDOW_SIZE/2];
-
-//define prev magnitude bins
-float prev_magnitude[WINDOW_SIZE/2];
-float prev_phase[WINDOW_SIZE/2];
-
-//define harmonics indices
-bool  curr_harmonicsindex[WINDOW_SIZE/4];
-bool  prev_harmonicsindex[WINDOW_SIZE/4];
-
-//define adaptive curves
-float curr_adaptivecurve[WINDOW_SIZE/4];
-float prev_adaptivecurve[WINDOW_SIZE/4];
-
-//turn phase vocoding on and off
-bool toggle = true;
-
-// Threads Management
-GLboolean g_ready = false;
-
 // fill mode
 GLenum g_fillmode = GL_FILL;
 
@@ -164,13 +162,50 @@ void help()
              "[g/h/b] decreases/increases/resets 5th order harmonics\n" \
              "[l/;] decreases/increases adaptive curve\n"
              "[.] toggles phase vocoding effect\n"
+             "[m] switches between the spectral chain and the waveshaper\n"
+             "[k] toggles sparse harmonics of interpolated peaks\n"
              "[/] reset adaptive curve\n"
-             "[q] to quit\n", data.second, data.third, data.fifth, data.threshold);
+             "[p] prints frame timing\n"
+             "[w] toggles the spectrogram\n"
+             "[q] to quit\n", data.params.second, data.params.third, data.params.fifth, data.params.threshold);
   printf( "----------------------------------------------------\n" );
   printf( "\n" );
 }
 
 
+//-----------------------------------------------------------------------------
+// Name: loop_read( )
+// Desc: read frames from the looped file, wrapping at loop_frames; returns
+//       the loop offset of the first frame
+//-----------------------------------------------------------------------------
+static long loop_read( paData *data, float *buff, long frames )
+{
+  long offset = data->position, done = 0, want, got;
+
+  while (done < frames) {
+    want = frames - done;
+    if (want > data->loop_frames - data->position)
+      want = data->loop_frames - data->position;
+    got = sf_readf_float(data->infile, buff + done * data->sfinfo.channels, want);
+    done += got;
+    data->position += got;
+
+    // end of the loop (or of a file shorter than it said): start again
+    if (got < want || data->position >= data->loop_frames) {
+      if (got == 0 && data->position == 0) {
+        memset(buff + done * data->sfinfo.channels, 0,
+               (frames - done) * data->sfinfo.channels * sizeof(float));
+        break;
+      }
+      sf_seek(data->infile, 0, SEEK_SET);
+      data->position = 0;
+    }
+  }
+
+  return offset;
+}
+
+
 //-----------------------------------------------------------------------------
 // Name: paCallback( )
 // Desc: callback from portAudio
@@ -182,109 +217,59 @@ static int paCallback( const void *inputBuffer,
 {
   SAMPLE * out = (SAMPLE *)outputBuffer;
   paData *data = (paData*)userData;
+  harmonic_engine *engine = &data->engine;
+  TRACE_START( total );
+  TRACE_START( t );
+
+  TRACE_CALLBACK( statusFlags, timeInfo->currentTime, timeInfo->outputBufferDacTime );
+  RTCHECK_ENTER( );
+
+  // realtime mode: priority, CPU and denormals of the callback thread
+  if (data->realtime && !data->realtime_done) {
+    realtime_thread(&data->realtime_config, 0, &data->realtime_status);
+    __atomic_store_n(&data->realtime_done, 1, __ATOMIC_RELEASE);
+  }
 
   // Zero-out the outputbuffer (silence)
   memset( out, 0.0f, sizeof(SAMPLE)*framesPerBuffer);
   
-  int i, j, k, readcount;
+  int i;
+  long offset;
 
-  // read data from file
-  readcount = sf_readf_float (data->infile, data->file_buff, framesPerBuffer + HOP_SIZE);  
-  
-  // if end of file reached, rewind
-  if (readcount < framesPerBuffer) {
-    sf_seek(data->infile, 0, SEEK_SET);
-    readcount = sf_readf_float (data->infile, data->file_buff+(readcount*data->sfinfo.channels), framesPerBuffer-readcount + HOP_SIZE);  
-  }
+  // read data from file, wrapping at the end of the loop
+  offset = loop_read( data, engine->file_buff, framesPerBuffer + HOP_SIZE );
 
   /* Rewind the hop size */
-  sf_seek( data->infile, -HOP_SIZE, SEEK_CUR );
+  data->position = ( ( data->position - HOP_SIZE ) % data->loop_frames + data->loop_frames ) % data->loop_frames;
+  sf_seek( data->infile, data->position, SEEK_SET );
 
   /* Separate left channel */
-  float left[framesPerBuffer+HOP_SIZE];
   for (i = 0; i < framesPerBuffer + HOP_SIZE; ++i)
   {
-      left[i] = data->file_buff[2*i];
-      pre_g_buffer[i] = left[i];
+      engine->input[i] = engine->file_buff[engine->channels*i];
   }
+  TRACE_MARK( t, TRACE_IO );
 
-  /* STFT */
-  for (i = 0; i < framesPerBuffer; i+=HOP_SIZE)
-  {
-      /* Apply window to current frame */
-      for (j = 0; j < WINDOW_SIZE; j++) {
-          data->curr_win[j] = left[i+j];
-      }
-      apply_window(data->curr_win, data->window, WINDOW_SIZE);
-
-      /* FFT */
-      rfft( data->curr_win, WINDOW_SIZE/2, FFT_FORWARD );
-      complex * curr_cbuf = (complex *)data->curr_win;
-      rfft( data->prev_win, WINDOW_SIZE/2, FFT_FORWARD );
-      complex * prev_cbuf = (complex *)data->prev_win;
-      /* Get Magnitude and Phase (polar coordinates) */
-      for (j = 0; j < WINDOW_SIZE/2; ++j)
-      {
-          curr_magnitude[j] = cmp_abs(curr_cbuf[j]);
-          curr_phase[j] = atan2f(curr_cbuf[j].im, curr_cbuf[j].re);
-
-          prev_magnitude[j] = cmp_abs(prev_cbuf[j]);
-          prev_phase[j] = atan2f(prev_cbuf[j].im, prev_cbuf[j].re);
-      }
-
-      for(j = 0; j < WINDOW_SIZE/4; ++j)
-      {
-        pre_fft_buffer[j] = curr_magnitude[j];
-      }
-
-      //toggle signal processing
-      if (toggle == true){
+  /* Pick up the latest parameters from the GUI thread */
+  engine_params params;
+  mailbox_read( &data->mailbox, &params );
+  TRACE_MARK( t, TRACE_PARAMS );
 
-        //call function to generate and update adaptive curve
-        adaptivecurve(curr_adaptivecurve, curr_magnitude, WINDOW_SIZE, data->threshold);
-        adaptivecurve(prev_adaptivecurve, prev_magnitude, WINDOW_SIZE, data->threshold);
+  /* STFT, harmonics generation and overlap-add */
+  engine_process_looped( engine, &params, engine->input, out, framesPerBuffer, offset );
 
-        //call findpeaks function to calculate which frequency bins to modify
-        findpeaks(curr_magnitude, curr_adaptivecurve, curr_harmonicsindex, WINDOW_SIZE);
-        findpeaks(prev_magnitude, prev_adaptivecurve, prev_harmonicsindex, WINDOW_SIZE);
-      
-        //2nd order harmonics generation
-        harmonics(curr_harmonicsindex, prev_harmonicsindex, curr_magnitude, prev_magnitude, WINDOW_SIZE, data->second, 2);
-
-        //3rd order harmonics generation
-        harmonics(curr_harmonicsindex, prev_harmonicsindex, curr_magnitude, prev_magnitude, WINDOW_SIZE, data->third, 3);
+  // queue the block for the recording writer; dropped if it is behind
+  if (data->recording)
+    recorder_push(&data->recorder, out, framesPerBuffer);
 
-        //5th order harmonics generation
-        harmonics(curr_harmonicsindex, prev_harmonicsindex, curr_magnitude, prev_magnitude, WINDOW_SIZE, data->fifth, 5);
-      }
-
-      /* Back to Cartesian coordinates */
-      for (j = 0; j < WINDOW_SIZE/2; j++) {
-          curr_cbuf[j].re = curr_magnitude[j] * cosf(curr_phase[j]);
-          curr_cbuf[j].im = curr_magnitude[j] * sinf(curr_phase[j]);
-          prev_cbuf[j].re = prev_magnitude[j] * cosf(prev_phase[j]);
-          prev_cbuf[j].im = prev_magnitude[j] * sinf(prev_phase[j]);
-      }
+  // hand the block to the renderer
+  TRACE_RESTART( t );   // the engine marked its own stages
+  viz_channel_fill( &g_viz, engine, out, framesPerBuffer );
+  viz_channel_publish( &g_viz );
+  TRACE_MARK( t, TRACE_SNAPSHOT );
 
-      // /* Back to Time Domain */
-      rfft( (float*)curr_cbuf, WINDOW_SIZE/2, FFT_INVERSE );
-      rfft( (float*)prev_cbuf, WINDOW_SIZE/2, FFT_INVERSE );
-
-      /* Assign to the output */
-      for (j = 0; j < HOP_SIZE; j++) {
-          out[i+j] = data->prev_win[j+HOP_SIZE] + data->curr_win[j];
-          g_buffer[i+j] = out[i+j];
-          //printf("i+j: %d, bufsize: %d\n", i+j, BUFFER_SIZE*2); 
-      }
-
-      /* Update previous window */
-      for (j = 0; j < WINDOW_SIZE; j++) {
-          data->prev_win[j] = data->curr_win[j];
-      }
-    }
-  
-  // set flag
-  g_ready = true;
+  TRACE_SPAN( total, TRACE_CALLBACK_TOTAL );
+  RTCHECK_LEAVE( );
 
   return paContinue;
 }
@@ -340,8 +325,8 @@ void initialize_audio( int argc, PaStream **stream, char *argv[], void *userData
     memset(&data->sfinfo, 0, sizeof(data->sfinfo));
 
     // check for usage
-    if ( argc != 2 ) {
-        printf("Usage: %s audio_file\n", argv[0]);
+    if ( argc != 2 && argc != 3 ) {
+        printf("Usage: %s audio_file [fps, 0 = new blocks/vsync only]\n", argv[0]);
         exit(1);
     }
     
@@ -353,15 +338,94 @@ void initialize_audio( int argc, PaStream **stream, char *argv[], void *userData
       exit(1);
     }
     //printf("No of channels: %d", data->sfinfo.channels);
-    /* Init Windows */
-    hanning(data->window, WINDOW_SIZE);
-    memset(&data->prev_win, 0, WINDOW_SIZE*sizeof(float));
+    /* Snapshots for the renderer */
+    if (viz_channel_create(&g_viz, BUFFER_SIZE, WINDOW_SIZE/4, HOPS_PER_BUFFER) != 0) {
+      printf ("Error: could not allocate visualization buffers\n") ;
+      exit(1);
+    }
+
+    /* Init the processing engine (all stream buffers in one arena) */
+    engine_config config = { .window_size = WINDOW_SIZE, .frames_per_buffer = FRAMES_PER_BUFFER,
+                             .channels = data->sfinfo.channels, .huge_pages = HUGE_PAGES };
+    if (engine_create(&data->engine, &config) != 0) {
+      printf ("Error: could not create the processing engine\n") ;
+      exit(1);
+    }
+    printf("Engine memory: %lu bytes (%s)\n", (unsigned long)data->engine.mem.size,
+           arena_backing_name(&data->engine.mem));
+
+    /* Opt-in silence gate: quiet hops skip the spectral chain */
+    const char *gate_spec = getenv("HARMONICS_GATE");
+    if (gate_spec) {
+      engine_gate gate;
+      if (engine_parse_gate(&gate, gate_spec) != 0) {
+        printf("Error: HARMONICS_GATE is pass|zero|off[,floor_db[,flux]]\n");
+        exit(1);
+      }
+      engine_set_gate(&data->engine, &gate);
+    }
+
+    /* Opt-in analysis cache: passes after the first skip the input analysis */
+    data->loop_frames = data->sfinfo.frames;
+    data->position = 0;
+    if (data->loop_frames < HOP_SIZE) {
+      printf("Error: the file is shorter than one hop (%d frames)\n", HOP_SIZE);
+      exit(1);
+    }
+    const char *cache_mode = getenv("HARMONICS_LOOP_CACHE");
+    if (cache_mode) {
+      bool half = strcmp(cache_mode, "fp16") == 0;
+      if (!half && strcmp(cache_mode, "fp32") != 0) {
+        printf("Error: HARMONICS_LOOP_CACHE is fp32 or fp16\n");
+        exit(1);
+      }
+      // keys repeat every pass only over whole hops
+      data->loop_frames = loopcache_frames(data->sfinfo.frames, HOP_SIZE);
+      if (loopcache_create(&g_cache, data->loop_frames, HOP_SIZE, data->engine.nbins, half) != 0) {
+        printf("Error: could not allocate the analysis cache\n");
+        exit(1);
+      }
+      data->engine.cache = &g_cache;
+      printf("Analysis cache: %lu bytes (%s), loop of %ld frames\n",
+             (unsigned long)g_cache.mem.size, cache_mode, data->loop_frames);
+    }
 
     /* Init harmonics and threshold */
-    data->second = 0.000000f;
-    data->third = 0.000000f;
-    data->fifth = 0.000000f;
-    data->threshold = 0.0000f;
+    data->params.second = 0.000000f;
+    data->params.third = 0.000000f;
+    data->params.fifth = 0.000000f;
+    data->params.threshold = 0.0000f;
+    data->params.toggle = true;
+    mailbox_init(&data->mailbox, &data->params);
+
+    /* Opt-in realtime mode: locked memory, SCHED_FIFO, affinity, FTZ/DAZ */
+    const char *realtime = getenv("HARMONICS_REALTIME");
+    if (realtime) {
+      if (realtime_parse(&data->realtime_config, realtime) != 0) {
+        printf("Error: HARMONICS_REALTIME is priority[,cpu]\n");
+        exit(1);
+      }
+      realtime_lock_memory(&data->realtime_status);
+      engine_realtime(&data->engine, &data->realtime_config, &data->realtime_status);
+      if (data->engine.cache)
+        realtime_prefault(g_cache.mem.base, g_cache.mem.size);
+      data->realtime = true;
+    }
+
+    /* Opt-in recording of the output: .wav, .flac or .raw */
+    const char *record = getenv("HARMONICS_RECORD");
+    if (record) {
+      if (recorder_open(&data->recorder, record, SAMPLING_RATE, g_channels, g_buffer_size) != 0) {
+        printf("Error: couldn't record to %s (HARMONICS_RECORD is a .wav, .flac or .raw path)\n", record);
+        exit(1);
+      }
+      printf("Recording to %s\n", record);
+      data->recording = true;
+    }
+
+    /* Per-stage callback timing (-DHARMONICS_TRACE builds only) */
+    if (TRACE_SETUP(getenv("HARMONICS_TRACE_FILE")) != 0)
+        exit(1);
 
     /* Initialize PortAudio */
     Pa_Initialize();
@@ -399,6 +463,17 @@ void initialize_audio( int argc, PaStream **stream, char *argv[], void *userData
     if (err != paNoError) {
         printf(  "PortAudio error: start stream: %s\n", Pa_GetErrorText(err));
     }
+
+    /* Report what realtime mode could not apply, once the callback has run */
+    if (data->realtime) {
+      int waited;
+      for (waited = 0; waited < 100 && !__atomic_load_n(&data->realtime_done, __ATOMIC_ACQUIRE); waited++)
+        Pa_Sleep(10);
+      if (__atomic_load_n(&data->realtime_done, __ATOMIC_ACQUIRE))
+        realtime_report(stdout, "audio thread", &data->realtime_status);
+      else
+        printf("Realtime: the audio callback has not run yet, its thread is not set up\n");
+    }
 }
 
 void stop_portAudio(PaStream **stream) {
@@ -430,6 +505,11 @@ int main( int argc, char *argv[] )
 
   /* Initialize interactive character input */
 
+  // frame rate cap
+  if (argc == 3)
+    g_fps = atof(argv[2]);
+  pacer_init(&g_pacer, g_fps);
+
   // Initialize Glut
   initialize_glut(argc, argv);
   
@@ -453,8 +533,10 @@ int main( int argc, char *argv[] )
 //-----------------------------------------------------------------------------
 void idleFunc( )
 {
-  // render the scene
-  glutPostRedisplay( );
+  // render the scene only if there is something new to show; the pacer
+  // sleeps otherwise so this thread does not spin
+  if( pacer_due( &g_pacer, viz_channel_pending( &g_viz ) ) )
+    glutPostRedisplay( );
 }
 
 //-----------------------------------------------------------------------------
@@ -463,7 +545,6 @@ void idleFunc( )
 //-----------------------------------------------------------------------------
 void keyboardFunc( unsigned char key, int x, int y )
 {
-  int i;
   //printf("key: %c\n", key);
   switch( key )
   {
@@ -485,6 +566,18 @@ void keyboardFunc( unsigned char key, int x, int y )
     case 'q':
       // Close Stream before exiting
       stop_portAudio(&g_stream);
+      if (data.recording) {
+        recorder_close(&data.recorder);
+        recorder_report(stdout, &data.recorder);
+      }
+      TRACE_SHUTDOWN();
+      pacer_report(&g_pacer, stdout);
+      TRACE_REPORT(stdout);
+      engine_destroy(&data.engine);
+      loopcache_destroy(&g_cache);
+      viz_channel_destroy(&g_viz);
+      views_shutdown();
+      spectrogram_shutdown();
       endwin();
       exit( 0 );
       break;
@@ -492,9 +585,9 @@ void keyboardFunc( unsigned char key, int x, int y )
       // decrease the 2nd order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.second -= INCREMENT;
-      if (data.second < 0) {
-        data.second = 0;
+      data.params.second -= INCREMENT;
+      if (data.params.second < 0) {
+        data.params.second = 0;
       }
       help();
       break;
@@ -502,9 +595,9 @@ void keyboardFunc( unsigned char key, int x, int y )
       // increase the 2nd order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.second += INCREMENT;
-      if (data.second > 1) {
-        data.second = 1;
+      data.params.second += INCREMENT;
+      if (data.params.second > 1) {
+        data.params.second = 1;
       }
       help();
       break;
@@ -512,16 +605,16 @@ void keyboardFunc( unsigned char key, int x, int y )
       // reset the 2nd order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.second = 0.000000f;
+      data.params.second = 0.000000f;
       help();
       break;
     case 'd':
       // decrease the 3rd order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.third -= INCREMENT;
-      if (data.third < 0) {
-        data.third = 0;
+      data.params.third -= INCREMENT;
+      if (data.params.third < 0) {
+        data.params.third = 0;
       }
       help();
       break;
@@ -529,9 +622,9 @@ void keyboardFunc( unsigned char key, int x, int y )
       // increase the 3rd order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.third += INCREMENT;
-      if (data.third > 1) {
-         data.third = 1;
+      data.params.third += INCREMENT;
+      if (data.params.third > 1) {
+         data.params.third = 1;
       }
       help();
       break;
@@ -539,16 +632,16 @@ void keyboardFunc( unsigned char key, int x, int y )
       // reset the 3rd order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.third = 0.000000f;
+      data.params.third = 0.000000f;
       help();
       break;
     case 'g':
       // decrease 5th order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.fifth -= INCREMENT;
-      if (data.fifth < 0) {
-        data.fifth = 0;
+      data.params.fifth -= INCREMENT;
+      if (data.params.fifth < 0) {
+        data.params.fifth = 0;
       }
       help();
       break;
@@ -556,9 +649,9 @@ void keyboardFunc( unsigned char key, int x, int y )
       // increase 5th order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.fifth += INCREMENT;
-      if (data.fifth > 1) {
-        data.fifth = 1;
+      data.params.fifth += INCREMENT;
+      if (data.params.fifth > 1) {
+        data.params.fifth = 1;
       }
       help();
       break;
@@ -566,60 +659,66 @@ void keyboardFunc( unsigned char key, int x, int y )
       // reset the 5th order harmonics and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.fifth = 0.000000f;
+      data.params.fifth = 0.000000f;
       help();
       break;
     case 'l':
       // shift the adaptive curve down and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      for(i = 0 ; i < WINDOW_SIZE/4 ; i++)
-        {
-          curr_adaptivecurve[i] -= threshINCREMENT;
-          if (curr_adaptivecurve[i] < 0) {
-            curr_adaptivecurve[i] = 0;
-          }
-          prev_adaptivecurve[i] -= threshINCREMENT;
-          if (prev_adaptivecurve[i] < 0) {
-            prev_adaptivecurve[i] = 0;
-          }
-        }
-      data.threshold -= threshINCREMENT;
+      data.params.threshold -= threshINCREMENT;
       help();
       break;
     case ';':
       // shift the adaptive curve up and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      for(i = 0 ; i < WINDOW_SIZE/4 ; i++)
-        {
-          curr_adaptivecurve[i] += threshINCREMENT;
-          if (curr_adaptivecurve[i] > 1) {
-            curr_adaptivecurve[i] = 1;
-          }
-          prev_adaptivecurve[i] += threshINCREMENT;
-          if (prev_adaptivecurve[i] > 1) {
-            prev_adaptivecurve[i] = 1;
-          }     
-        }
-      data.threshold += threshINCREMENT;
+      data.params.threshold += threshINCREMENT;
       help();
       break;
     case '.':
       // toggle the phase vocoding
-      if (toggle == true)
-        toggle = false;
+      if (data.params.toggle == true)
+        data.params.toggle = false;
       else
-        toggle = true;
+        data.params.toggle = true;
+      break;
+    case 'm':
+      // spectral chain or time-domain waveshaper
+      data.params.waveshaper = !data.params.waveshaper;
+      break;
+    case 'k':
+      // harmonics at exact multiples of interpolated peaks
+      data.params.sparse = !data.params.sparse;
+      break;
+    case 'w':
+      // show or hide the spectrogram
+      g_waterfall = !g_waterfall;
+      pacer_invalidate(&g_pacer);
+      break;
+    case 'p':
+      // frame timing so far
+      pacer_report(&g_pacer, stdout);
+      TRACE_REPORT(stdout);
+      if (data.engine.cache)
+        printf("analysis cache: %lu hits, %lu misses\n", g_cache.hits, g_cache.misses);
+      if (getenv("HARMONICS_GATE"))
+        printf("silence gate: %lu hops gated, %lu masks reused\n",
+               data.engine.gated_hops, data.engine.reused_hops);
+      if (data.recording)
+        recorder_report(stdout, &data.recorder);
       break;
     case '/':
       //reset the adaptive curve and refresh the terminal
       printf("\033[2J");
       printf("\033[%d;%dH", 0, 0);
-      data.threshold = 0.0f;
+      data.params.threshold = 0.0f;
       help();
       break;
   }
+
+  // hand the new parameters to the audio callback
+  mailbox_write(&data.mailbox, &data.params);
 }
 
 //-----------------------------------------------------------------------------
@@ -667,36 +766,12 @@ void reshapeFunc( int w, int h )
 {
   // save the new window size
   g_width = w; g_height = h;
-  // map the view port to the client area
-  glViewport( 0, 0, w, h );
-  // set the matrix mode to project
-  glMatrixMode( GL_PROJECTION );
-  // load the identity matrix
-  glLoadIdentity( );
-  // create the viewing frustum
-  //gluPerspective( 45.0, (GLfloat) w / (GLfloat) h, .05, 50.0 );
-  gluPerspective( 45.0, (GLfloat) w / (GLfloat) h, 1.0, 1000.0 );
-  // set the matrix mode to modelview
-  glMatrixMode( GL_MODELVIEW );
-  // load the identity matrix
-  glLoadIdentity( );
-  
-  // position the view point
-  //  void gluLookAt( GLdouble eyeX,
-  //                 GLdouble eyeY,
-  //                 GLdouble eyeZ,
-  //                 GLdouble centerX,
-  //                 GLdouble centerY,
-  //                 GLdouble centerZ,
-  //                 GLdouble upX,
-  //                 GLdouble upY,
-  //                 GLdouble upZ )
-  
-  gluLookAt( 0.0f, 0.0f, 10.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f );
-  /*gluLookAt( 0.0f, 3.5f * sin( 0.0f ), 3.5f * cos( 0.0f ), 
-            0.0f, 0.0f, 0.0f, 
-            0.0f, 1.0f , 0.0f );*/
-   
+  // match the scroll view's detail to the width
+  views_resize( w, h );
+  // and draw at the new size
+  pacer_invalidate( &g_pacer );
+  // viewport, projection and camera
+  views_project( w, h );
 }
 
 
@@ -736,147 +811,18 @@ void initialize_graphics()
   glLightfv( GL_LIGHT1, GL_DIFFUSE, g_light1_diffuse );
   glLightfv( GL_LIGHT1, GL_SPECULAR, g_light1_specular );
   glEnable( GL_LIGHT1 );
-}
-
-//-----------------------------------------------------------------------------
-// Name: void drawWindowedTimeDomain(SAMPLE *buffer)
-// Desc: Draws the Windowed Time Domain signal in the top of the screen
-//-----------------------------------------------------------------------------
-void drawWindowedTimeDomain(SAMPLE *buffer) {
-  // Initialize initial x
-  GLfloat x = -6.8;
-  
-  // Calculate increment x
-  GLfloat xinc = fabs((2.1*x)/g_buffer_size);
-  
-  glPushMatrix();
-  {
-    glTranslatef(0,2.5f,0.0f);
-    glColor3f(0., .2, 0.0);
-    
-    glBegin(GL_LINE_STRIP);
-    
-    // Draw Pre-processing Windowed Time Domain
-    for (int i=0; i<g_buffer_size; i++)
-    {
-      glVertex3f(x, pre_g_buffer[i], 0.0f);
-      x += xinc;
-    }
-    
-    glEnd();
-    
-  }
-  glPopMatrix();
-
-  x = -6.8;
-
-  glPushMatrix();
-  {
-    glTranslatef(0,2.5f,0.0f);
-    glColor3f(.2, 0.0, 0.0);
-    
-    glBegin(GL_LINE_STRIP);
-    
-    // Draw Post-processing Windowed Time Domain
-    for (int i=0; i<g_buffer_size; i++)
-    {
-      glVertex3f(x, buffer[i], 0.0f);
-      x += xinc;
-    }
-    
-    glEnd();
-    
-  }
-  glPopMatrix();
-
-}
-
-void drawScrollingTimeDomain(SAMPLE *buffer) {
-    //increment g_scroll_writer
-    g_scroll_writer += g_buffer_size;
-    g_scroll_writer %= g_scroll_buffer_size;
-    
-    // Initialize initial x
-    GLfloat x = -6.8;
-    
-    // Calculate increment x
-    GLfloat xinc = fabs((2.5*x)/g_scroll_buffer_size);
-    
-    
-    // Scroll Time Domain signal
-    glPushMatrix();
-    {
-        glTranslatef(0.0, -3.0f, 0.0f);
-        glColor3f(0.2, 0.2, 1.0);
-
-        glBegin(GL_LINE_STRIP);
-        
-        for (int i = 0; i < g_scroll_buffer_size; i++) {
-            glVertex2f (x, 0.7*g_scroll_buffer[g_scroll_reader]);
-            x += xinc;
-            // Increment the reader buffer_size
-            g_scroll_reader++;
-            g_scroll_reader %= g_scroll_buffer_size;
-        }
-        
-        // Increment the scroll reader index
-        g_scroll_reader += g_buffer_size;
-        g_scroll_reader %= g_scroll_buffer_size;
-        
-        glEnd();
-    }
-    glPopMatrix();
-}
-
-void drawFrequencyDomain(SAMPLE *buffer)
-{
-// Initialize initial x
-  GLfloat x = -6.8;
 
-  // Calculate increment x
-  GLfloat xinc = fabs((2.7*x)/(WINDOW_SIZE/4.));
-  
-  glPushMatrix();
+  // vertex buffers and shader for the views
+  if( views_init( BUFFER_SIZE, SCROLL_BUFFER_SIZE, WINDOW_SIZE/4 ) != 0 )
   {
-    glTranslatef(0,5.2f,0.0f);
-    glColor3f(1., .2, 0.0);
-    
-    glBegin(GL_LINE_STRIP);
-    
-    // Draw Windowed Time Domain
-    for (int i=0; i<WINDOW_SIZE/4; i++)
-    {
-      glVertex3f(x, 3*log10(pre_fft_buffer[i]+0.01), 0.0f);
-      // glVertex3f(x, 0.0, 0.0f);
-      x += xinc;
-    }
-    
-    glEnd();
-    
+    printf( "Error: could not initialize the views (needs OpenGL 2.0)\n" );
+    exit( 1 );
   }
-  glPopMatrix();
-
-  x = -6.8;
-
-  glPushMatrix();
+  if( spectrogram_init( SPECTROGRAM_COLUMNS, WINDOW_SIZE/4 ) != 0 )
   {
-    glTranslatef(0,5.2f,0.0f);
-    glColor3f(.2, 0.0, 0.0);
-    
-    glBegin(GL_LINE_STRIP);
-    
-    // Draw Windowed Time Domain
-    for (int i=0; i<WINDOW_SIZE/4; i++)
-    {
-      glVertex3f(x, 3*log10(curr_adaptivecurve[i]+0.01), 0.0f);
-      x += xinc;
-    }
-    
-    glEnd();
-    
+    printf( "Error: could not initialize the spectrogram\n" );
+    exit( 1 );
   }
-  glPopMatrix();
-
 }
 
 //-----------------------------------------------------------------------------
@@ -885,44 +831,26 @@ void drawFrequencyDomain(SAMPLE *buffer)
 //-----------------------------------------------------------------------------
 void displayFunc( )
 {
-  // local state
-  static GLfloat zrot = 0.0f, c = 0.0f;
-  
-  GLfloat x, xinc;
-  
   // local variables
-  SAMPLE buffer[g_buffer_size];
+  const viz_frame *frame;
   
-  // wait for data
-//  while( !g_ready ) usleep( 1000 );
-  int i;
-  // copy currently playing audio into buffer
-  for(i = 0; i < g_buffer_size; i++)
-    buffer[i] = g_buffer[i];
+  pacer_begin( &g_pacer );
 
-  // copy buffer to the last part of the g_scroll_buffer
-  for (int i = g_scroll_writer, j = 0; i<g_scroll_writer+g_buffer_size; i++, j++) {
-    g_scroll_buffer[i] = buffer[j];
+  // take the newest block from the audio callback and upload it; the views
+  // keep drawing the last upload until another block is published
+  if (viz_channel_acquire(&g_viz, &frame)) {
+    views_upload(frame);
+    spectrogram_upload(frame);
   }
   
-  // Hand off to audio callback thread
-  g_ready = false;
-  
-  // clear the color and depth buffers
-  glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-  
-  // Windowed Time Domain
-  drawWindowedTimeDomain(buffer);
-  
-  // Scrolling Time Domain
-  drawScrollingTimeDomain(buffer);
-
-  // draw magnitude and adaptive curve
-  drawFrequencyDomain(buffer);
+  // clear and draw the views (time domain, scroll, spectrum, spectrogram)
+  views_draw( g_waterfall, NULL );
 
   // flush gl commands
   glFlush( );
 
   // swap the buffers
   glutSwapBuffers( );
-}
\ No newline at end of file
+
+  pacer_end( &g_pacer );
+}
@@ -0,0 +1,350 @@
+//-----------------------------------------------------------------------------
+// name: harmonicsHeadless.c
+// desc: offscreen render benchmark for the harmonicsGL2 views
+//
+//   runs the engine over an audio file without a sound device, passes each
+//   block through the same snapshot channel as the audio callback and draws
+//   it with views_draw() into an EGL pbuffer, so it needs neither a display
+//   nor a GPU (Mesa's llvmpipe will do).  prints per-view frame times and
+//   can write every frame as a PNG.
+//
+//   build:
+//     gcc -O2 -std=gnu99 -o harmonicsHeadless harmonicsHeadless.c views.c
+//         spectrogram.c pyramid.c logmap.c snapshot.c engine.c fft.c
+//         fft_plan.c arena.c loopcache.c waveshaper.c partials.c pool.c
+//         realtime.c -lEGL -lGL -lGLU -lpng -lsndfile -lpthread -lm
+//   run:
+//     ./harmonicsHeadless [-n blocks] [-s WxH] [-g gain] [-W] [-o dir] audio_file
+//-----------------------------------------------------------------------------
+#define GL_GLEXT_PROTOTYPES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <sndfile.h>
+#include <png.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include "engine.h"
+#include "snapshot.h"
+#include "views.h"
+#include "spectrogram.h"
+
+// the same stream harmonicsGL2 plays
+#define FRAMES_PER_BUFFER   4096
+#define WINDOW_SIZE         (FRAMES_PER_BUFFER/4)
+#define HOP_SIZE            (WINDOW_SIZE/2)
+#define HOPS_PER_BUFFER     (FRAMES_PER_BUFFER / HOP_SIZE)
+#define BUFFER_SIZE         FRAMES_PER_BUFFER
+#define SCROLL_BUFFER_SIZE  (FRAMES_PER_BUFFER * 60)
+#define SPECTROGRAM_COLUMNS 512
+#define INIT_WIDTH          800
+#define INIT_HEIGHT         600
+
+// per-view frame times
+typedef struct
+{
+  double sum, min, max;
+} view_stats;
+
+static const char * g_view_names[VIEW_COUNT + 1] =
+  { "windowed", "scrolling", "frequency", "spectrogram", "upload" };
+
+//-----------------------------------------------------------------------------
+// Name: usage( )
+// Desc: ...
+//-----------------------------------------------------------------------------
+static void usage( const char * name )
+{
+  printf( "Usage: %s [-n blocks] [-s WxH] [-g gain] [-W] [-o dir] audio_file\n"
+          "  -n  blocks to render (default: the whole file)\n"
+          "  -s  pbuffer size (default %dx%d)\n"
+          "  -g  2nd, 3rd and 5th order harmonics gain (default 0)\n"
+          "  -W  leave out the spectrogram\n"
+          "  -o  write every frame to dir/frameNNNNN.png\n",
+          name, INIT_WIDTH, INIT_HEIGHT );
+}
+
+//-----------------------------------------------------------------------------
+// Name: seconds( )
+// Desc: ...
+//-----------------------------------------------------------------------------
+static double seconds( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//-----------------------------------------------------------------------------
+// Name: initialize_egl( )
+// Desc: a width x height pbuffer with a desktop GL context, current
+//-----------------------------------------------------------------------------
+static int initialize_egl( int width, int height )
+{
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay;
+  EGLDisplay display;
+  EGLConfig config;
+  EGLSurface surface;
+  EGLContext context;
+  EGLint major, minor, count;
+  EGLint config_attribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                              EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                              EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8,
+                              EGL_BLUE_SIZE, 8, EGL_DEPTH_SIZE, 16, EGL_NONE };
+  EGLint surface_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+
+  // no window system needed where Mesa offers a surfaceless platform
+  getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+    eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+  display = getPlatformDisplay ?
+    getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL ) :
+    EGL_NO_DISPLAY;
+  if( display == EGL_NO_DISPLAY )
+    display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+  if( !eglInitialize( display, &major, &minor ) )
+  {
+    printf( "Error: could not initialize EGL (0x%x)\n", eglGetError( ) );
+    return -1;
+  }
+  if( !eglChooseConfig( display, config_attribs, &config, 1, &count ) || count == 0 )
+  {
+    printf( "Error: no EGL config with a desktop GL pbuffer\n" );
+    return -1;
+  }
+
+  surface = eglCreatePbufferSurface( display, config, surface_attribs );
+  eglBindAPI( EGL_OPENGL_API );
+  context = eglCreateContext( display, config, EGL_NO_CONTEXT, NULL );
+  if( surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent( display, surface, surface, context ) )
+  {
+    printf( "Error: could not make an EGL pbuffer current (0x%x)\n", eglGetError( ) );
+    return -1;
+  }
+
+  printf( "GL: %s, %s\n", glGetString( GL_VERSION ), glGetString( GL_RENDERER ) );
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: write_png( )
+// Desc: read back the frame and write it, top row first
+//-----------------------------------------------------------------------------
+static int write_png( const char * path, int width, int height, unsigned char * pixels )
+{
+  FILE * file;
+  png_structp png;
+  png_infop info;
+  int y;
+
+  glReadPixels( 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels );
+
+  file = fopen( path, "wb" );
+  if( !file )
+  {
+    printf( "Error: could not open %s\n", path );
+    return -1;
+  }
+
+  png = png_create_write_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+  info = png ? png_create_info_struct( png ) : NULL;
+  if( !info || setjmp( png_jmpbuf( png ) ) )
+  {
+    printf( "Error: could not write %s\n", path );
+    png_destroy_write_struct( &png, &info );
+    fclose( file );
+    return -1;
+  }
+
+  png_init_io( png, file );
+  png_set_IHDR( png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT );
+  png_write_info( png, info );
+  for( y = height - 1; y >= 0; y-- )
+    png_write_row( png, pixels + (long)y * width * 3 );
+  png_write_end( png, NULL );
+
+  png_destroy_write_struct( &png, &info );
+  fclose( file );
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: main
+// Desc: ...
+//-----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+  SNDFILE *infile;
+  SF_INFO sfinfo;
+  harmonic_engine engine;
+  engine_config config;
+  engine_params params = { .second = 0.0f, .third = 0.0f, .fifth = 0.0f,
+                           .threshold = 0.0f, .toggle = true };
+  viz_channel viz;
+  const viz_frame *frame;
+  view_stats stats[VIEW_COUNT + 1];
+  float out[FRAMES_PER_BUFFER];
+  unsigned char *pixels = NULL;
+  const char *png_dir = NULL;
+  bool spectrogram = true;
+  long blocks = 0, b, i;
+  int width = INIT_WIDTH, height = INIT_HEIGHT, opt, v;
+  double start, elapsed;
+
+  while( ( opt = getopt( argc, argv, "n:s:g:Wo:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'n': blocks = atol( optarg ); break;
+      case 's':
+        if( sscanf( optarg, "%dx%d", &width, &height ) != 2 || width < 1 || height < 1 )
+        {
+          usage( argv[0] );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'g': params.second = params.third = params.fifth = atof( optarg ); break;
+      case 'W': spectrogram = false; break;
+      case 'o': png_dir = optarg; break;
+      default:
+        usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+  }
+  if( optind != argc - 1 )
+  {
+    usage( argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  // Open Audio file
+  memset( &sfinfo, 0, sizeof(sfinfo) );
+  infile = sf_open( argv[optind], SFM_READ, &sfinfo );
+  if( infile == NULL )
+  {
+    printf( "Error: could not open file: %s\n", argv[optind] );
+    puts( sf_strerror( NULL ) );
+    return EXIT_FAILURE;
+  }
+  if( blocks <= 0 )
+    blocks = sfinfo.frames / FRAMES_PER_BUFFER > 0 ? sfinfo.frames / FRAMES_PER_BUFFER : 1;
+
+  config.window_size = WINDOW_SIZE;
+  config.frames_per_buffer = FRAMES_PER_BUFFER;
+  config.channels = sfinfo.channels;
+  config.huge_pages = false;
+  config.oversampling = 0;
+  config.threads = 0;
+  if( engine_create( &engine, &config ) != 0 ||
+      viz_channel_create( &viz, BUFFER_SIZE, WINDOW_SIZE/4, HOPS_PER_BUFFER ) != 0 )
+  {
+    printf( "Error: could not create the processing engine\n" );
+    return EXIT_FAILURE;
+  }
+
+  // the GL state initialize_graphics() sets up for the views
+  if( initialize_egl( width, height ) != 0 )
+    return EXIT_FAILURE;
+  glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
+  glEnable( GL_DEPTH_TEST );
+  glLineWidth( 1.0f );
+  if( views_init( BUFFER_SIZE, SCROLL_BUFFER_SIZE, WINDOW_SIZE/4 ) != 0 ||
+      spectrogram_init( SPECTROGRAM_COLUMNS, WINDOW_SIZE/4 ) != 0 )
+  {
+    printf( "Error: could not initialize the views (needs OpenGL 2.0)\n" );
+    return EXIT_FAILURE;
+  }
+  views_resize( width, height );
+  views_project( width, height );
+
+  if( png_dir )
+    pixels = (unsigned char *)malloc( (size_t)width * height * 3 );
+
+  for( v = 0; v <= VIEW_COUNT; v++ )
+  {
+    stats[v].sum = stats[v].max = 0.0;
+    stats[v].min = 1e9;
+  }
+
+  start = seconds( );
+  for( b = 0; b < blocks; b++ )
+  {
+    double times[VIEW_COUNT] = { 0.0 };
+    double t0, upload;
+    sf_count_t readcount;
+
+    // read a block and a hop as the callback does, looping at the end
+    readcount = sf_readf_float( infile, engine.file_buff, FRAMES_PER_BUFFER + HOP_SIZE );
+    if( readcount < FRAMES_PER_BUFFER + HOP_SIZE )
+    {
+      sf_seek( infile, 0, SEEK_SET );
+      sf_readf_float( infile, engine.file_buff + readcount * engine.channels,
+                      FRAMES_PER_BUFFER + HOP_SIZE - readcount );
+    }
+    sf_seek( infile, -HOP_SIZE, SEEK_CUR );
+    for( i = 0; i < FRAMES_PER_BUFFER + HOP_SIZE; i++ )
+      engine.input[i] = engine.file_buff[engine.channels * i];
+
+    engine_process( &engine, &params, engine.input, out, FRAMES_PER_BUFFER );
+    viz_channel_fill( &viz, &engine, out, FRAMES_PER_BUFFER );
+    viz_channel_publish( &viz );
+
+    // what displayFunc() does with a fresh snapshot
+    t0 = seconds( );
+    if( viz_channel_acquire( &viz, &frame ) )
+    {
+      views_upload( frame );
+      if( spectrogram )
+        spectrogram_upload( frame );
+    }
+    glFinish( );
+    upload = seconds( ) - t0;
+    stats[VIEW_COUNT].sum += upload;
+    if( upload < stats[VIEW_COUNT].min ) stats[VIEW_COUNT].min = upload;
+    if( upload > stats[VIEW_COUNT].max ) stats[VIEW_COUNT].max = upload;
+
+    views_draw( spectrogram, times );
+
+    for( v = 0; v < VIEW_COUNT; v++ )
+    {
+      stats[v].sum += times[v];
+      if( times[v] < stats[v].min ) stats[v].min = times[v];
+      if( times[v] > stats[v].max ) stats[v].max = times[v];
+    }
+
+    if( pixels )
+    {
+      char path[4096];
+      snprintf( path, sizeof(path), "%s/frame%05ld.png", png_dir, b );
+      if( write_png( path, width, height, pixels ) != 0 )
+        return EXIT_FAILURE;
+    }
+  }
+  elapsed = seconds( ) - start;
+
+  printf( "Rendered %ld blocks at %dx%d in %.3f s (%.1f frames/s%s)\n", blocks,
+          width, height, elapsed, blocks / elapsed, pixels ? ", with PNG output" : "" );
+  printf( "%-12s %10s %10s %10s\n", "view", "min ms", "mean ms", "max ms" );
+  for( v = 0; v <= VIEW_COUNT; v++ )
+  {
+    if( v == VIEW_SPECTROGRAM && !spectrogram )
+      continue;
+    printf( "%-12s %10.3f %10.3f %10.3f\n", g_view_names[v], stats[v].min * 1e3,
+            stats[v].sum / blocks * 1e3, stats[v].max * 1e3 );
+  }
+
+  free( pixels );
+  spectrogram_shutdown( );
+  views_shutdown( );
+  viz_channel_destroy( &viz );
+  engine_destroy( &engine );
+  sf_close( infile );
+
+  return EXIT_SUCCESS;
+}
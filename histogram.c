@@ -0,0 +1,114 @@
+//-----------------------------------------------------------------------------
+// name: histogram.c
+// desc: log-linear latency histogram (HdrHistogram style)
+//-----------------------------------------------------------------------------
+#include "histogram.h"
+#include <string.h>
+
+#define SUB_COUNT   ( 1u << HISTOGRAM_SUB_BITS )
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: bucket_of() / bucket_top()
+// desc: value -> bucket, and the largest value a bucket holds
+//-----------------------------------------------------------------------------
+static unsigned int bucket_of( uint64_t v )
+{
+    unsigned int msb, shift, index;
+
+    if( v < SUB_COUNT )
+        return (unsigned int)v;
+
+    msb = 63 - __builtin_clzll( v );
+    shift = msb - HISTOGRAM_SUB_BITS;
+    index = ( ( shift + 1 ) << HISTOGRAM_SUB_BITS ) + (unsigned int)( ( v >> shift ) - SUB_COUNT );
+
+    return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+static uint64_t bucket_top( unsigned int index )
+{
+    unsigned int shift;
+    uint64_t sub;
+
+    if( index < SUB_COUNT )
+        return index;
+
+    shift = ( index >> HISTOGRAM_SUB_BITS ) - 1;
+    sub = ( index & ( SUB_COUNT - 1 ) ) + SUB_COUNT;
+    return ( ( sub + 1 ) << shift ) - 1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: histogram_init()
+// desc: empty histogram; min starts above any value
+//-----------------------------------------------------------------------------
+void histogram_init( latency_histogram * h )
+{
+    memset( h, 0, sizeof(*h) );
+    h->min = UINT64_MAX;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: histogram_record()
+// desc: count one value: a few integer operations, never allocates;
+//       values past the range land in the top bucket, max stays exact
+//-----------------------------------------------------------------------------
+void histogram_record( latency_histogram * h, uint64_t value )
+{
+    h->count[bucket_of( value )]++;
+    h->total++;
+    h->sum += (double)value;
+    if( value < h->min ) h->min = value;
+    if( value > h->max ) h->max = value;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: histogram_percentile()
+// desc: walk the buckets up to the p-th value; never past the exact max
+//-----------------------------------------------------------------------------
+uint64_t histogram_percentile( const latency_histogram * h, double p )
+{
+    uint64_t rank, seen = 0, top;
+    unsigned int i;
+
+    if( h->total == 0 )
+        return 0;
+
+    rank = (uint64_t)( p * h->total + 0.5 );
+    if( rank < 1 ) rank = 1;
+    if( rank > h->total ) rank = h->total;
+
+    for( i = 0; i < HISTOGRAM_BUCKETS; i++ )
+    {
+        seen += h->count[i];
+        if( seen >= rank )
+            break;
+    }
+
+    top = bucket_top( i < HISTOGRAM_BUCKETS ? i : HISTOGRAM_BUCKETS - 1 );
+    return top < h->max ? top : h->max;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: histogram_mean()
+// desc: exact mean of the recorded values, 0 if none
+//-----------------------------------------------------------------------------
+double histogram_mean( const latency_histogram * h )
+{
+    return h->total ? h->sum / h->total : 0.0;
+}
@@ -0,0 +1,37 @@
+//-----------------------------------------------------------------------------
+// name: histogram.h
+// desc: log-linear latency histogram (HdrHistogram style)
+//
+//   values below 2^HISTOGRAM_SUB_BITS are counted exactly; above that every
+//   power of two is split into 2^HISTOGRAM_SUB_BITS equal buckets, so a
+//   reported value is within 1 / 2^HISTOGRAM_SUB_BITS of the true one at
+//   any magnitude.  recording is a few integer operations and never
+//   allocates.
+//-----------------------------------------------------------------------------
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS      7
+#define HISTOGRAM_MAX_BITS      44      // values up to ~4.8 hours in ns
+#define HISTOGRAM_BUCKETS       ( ( HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1 ) << HISTOGRAM_SUB_BITS )
+
+typedef struct
+{
+    uint64_t count[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t min, max;
+    double sum;
+} latency_histogram;
+
+void     histogram_init( latency_histogram * h );
+// larger values are clamped to the top bucket (max stays exact)
+void     histogram_record( latency_histogram * h, uint64_t value );
+// smallest recorded value v such that a fraction p (0..1) of values are <= v,
+// as the upper edge of its bucket
+uint64_t histogram_percentile( const latency_histogram * h, double p );
+double   histogram_mean( const latency_histogram * h );
+
+#endif
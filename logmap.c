@@ -0,0 +1,130 @@
+//-----------------------------------------------------------------------------
+// name: logmap.c
+// desc: log-frequency bin-to-pixel map and fast dB conversion for the
+//       spectrum view
+//-----------------------------------------------------------------------------
+#include "logmap.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: logmap_create()
+// desc: split bins 1..bins into pixels log-spaced columns of at least one
+//       bin each; -1 on bad sizes or no memory
+//-----------------------------------------------------------------------------
+int logmap_create( logmap * m, long bins, long pixels )
+{
+    double kmin = 1.0, ratio;
+    long p;
+
+    m->bins = bins;
+    m->pixels = pixels;
+
+    if( bins < 2 || pixels < 1 )
+        return -1;
+
+    if( arena_create( &m->mem, 2 * ARENA_ROUND( pixels * sizeof(int) ), false ) != 0 )
+        return -1;
+
+    m->first = (int *)arena_alloc( &m->mem, pixels * sizeof(int) );
+    m->count = (int *)arena_alloc( &m->mem, pixels * sizeof(int) );
+
+    ratio = (double)bins / kmin;
+    for( p = 0; p < pixels; p++ )
+    {
+        long lo = (long)( kmin * pow( ratio, (double)p / pixels ) );
+        long hi = (long)( kmin * pow( ratio, (double)( p + 1 ) / pixels ) );
+
+        if( lo > bins - 1 ) lo = bins - 1;
+        if( hi > bins ) hi = bins;
+        if( hi <= lo ) hi = lo + 1;
+
+        m->first[p] = (int)lo;
+        m->count[p] = (int)( hi - lo );
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: logmap_destroy()
+// desc: free the column table
+//-----------------------------------------------------------------------------
+void logmap_destroy( logmap * m )
+{
+    arena_destroy( &m->mem );
+    m->pixels = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: logmap_reduce()
+// desc: max over each column's bins
+//-----------------------------------------------------------------------------
+void logmap_reduce( const logmap * m, const float * magnitude, long valid,
+                    float * out )
+{
+    long p;
+    int j;
+
+    for( p = 0; p < m->pixels; p++ )
+    {
+        const float * bin = magnitude + m->first[p];
+        int count = m->count[p];
+        float peak;
+
+        if( m->first[p] >= valid )
+        {
+            out[p] = 0.0f;
+            continue;
+        }
+        if( m->first[p] + count > valid )
+            count = (int)( valid - m->first[p] );
+
+        peak = bin[0];
+        for( j = 1; j < count; j++ )
+            peak = bin[j] > peak ? bin[j] : peak;
+        out[p] = peak;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: fast_log10()
+// desc: log2 of the exponent plus a degree-6 fit of log2 on the mantissa in
+//       [1, 2), scaled to log10; in and out may be the same array
+//-----------------------------------------------------------------------------
+void fast_log10( const float * in, float * out, long n,
+                 float scale, float offset )
+{
+    const float to_log10 = 0.30102999566f * scale;
+    long i;
+
+    for( i = 0; i < n; i++ )
+    {
+        union { float f; int32_t i; } v;
+        float e, x, y;
+
+        v.f = in[i] + offset;
+        e = (float)( ( ( v.i >> 23 ) & 255 ) - 127 );
+        v.i = ( v.i & 0x007fffff ) | 0x3f800000;
+        x = v.f - 1.0f;
+
+        // log2(1 + x) on [0, 1)
+        y = x * ( 1.44254f + x * ( -0.71761f + x * ( 0.45689f +
+            x * ( -0.27906f + x * ( 0.12149f + x * -0.02508f ) ) ) ) );
+
+        out[i] = ( e + y ) * to_log10;
+    }
+}
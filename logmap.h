@@ -0,0 +1,40 @@
+//-----------------------------------------------------------------------------
+// name: logmap.h
+// desc: log-frequency bin-to-pixel map and fast dB conversion for the
+//       spectrum view
+//
+//   pixel column p covers the bins between kmin * (kmax/kmin)^(p/pixels)
+//   and the next column's start, so every octave gets the same width.
+//   columns narrower than a bin repeat the bin under them; wider ones keep
+//   the loudest bin they cover.  built once per window width and bin
+//   count, after which a frame costs O(bins + pixels).
+//-----------------------------------------------------------------------------
+#ifndef __LOGMAP_H__
+#define __LOGMAP_H__
+
+#include "arena.h"
+
+typedef struct
+{
+    long bins;              // spectrum length the map was built for
+    long pixels;            // output columns
+    int * first;            // first bin of each column
+    int * count;            // bins in each column, at least 1
+    arena mem;
+} logmap;
+
+// map bins 1..bins-1 (dc is left out) onto pixels columns; returns 0 on
+// success
+int  logmap_create( logmap * m, long bins, long pixels );
+void logmap_destroy( logmap * m );
+
+// out[p] = largest of magnitude[] over column p; columns starting past
+// valid bins read 0
+void logmap_reduce( const logmap * m, const float * magnitude, long valid,
+                    float * out );
+
+// out[i] = scale * log10( in[i] + offset ), within 3e-4 * scale;
+// a polynomial on the float's mantissa, written to vectorize
+void fast_log10( const float * in, float * out, long n, float scale, float offset );
+
+#endif
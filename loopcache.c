@@ -0,0 +1,253 @@
+//-----------------------------------------------------------------------------
+// name: loopcache.c
+// desc: analysis cache for looped playback
+//-----------------------------------------------------------------------------
+#include "loopcache.h"
+#include <string.h>
+#include <math.h>
+
+#define PHASE_STEP  ( 2.0f * (float)M_PI / 65536.0f )
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: to_half() / from_half()
+// desc: ieee binary16 <-> float, round to nearest even; only finite
+//       non-negative values come through here
+//-----------------------------------------------------------------------------
+static uint16_t to_half( float value )
+{
+    uint32_t bits, mantissa;
+    int exponent;
+
+    memcpy( &bits, &value, sizeof(bits) );
+    bits &= 0x7fffffffu;
+    exponent = (int)( bits >> 23 ) - 127 + 15;
+    mantissa = bits & 0x7fffffu;
+
+    if( exponent >= 31 )
+        return 0x7bff;                      // clamp to the largest half
+
+    if( exponent <= 0 )
+    {
+        // subnormal half, or zero
+        uint32_t shift, half, rest;
+        if( exponent < -10 )
+            return 0;
+        mantissa |= 0x800000u;
+        shift = (uint32_t)( 14 - exponent );
+        half = mantissa >> shift;
+        rest = mantissa & ( ( 1u << shift ) - 1 );
+        if( rest > ( 1u << ( shift - 1 ) ) || ( rest == ( 1u << ( shift - 1 ) ) && ( half & 1 ) ) )
+            half++;
+        return (uint16_t)half;
+    }
+
+    {
+        uint32_t half = ( (uint32_t)exponent << 10 ) | ( mantissa >> 13 );
+        uint32_t rest = mantissa & 0x1fffu;
+        if( rest > 0x1000u || ( rest == 0x1000u && ( half & 1 ) ) )
+            half++;                         // may carry into the exponent, as it should
+        return (uint16_t)( half > 0x7bff ? 0x7bff : half );
+    }
+}
+
+static float from_half( uint16_t half )
+{
+    uint32_t exponent = ( half >> 10 ) & 0x1f, mantissa = half & 0x3ff, bits;
+    float value;
+
+    if( exponent == 0 )
+        return ldexpf( (float)mantissa, -24 );
+
+    bits = ( ( exponent - 15 + 127 ) << 23 ) | ( mantissa << 13 );
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: layout()
+// desc: carve the cache from an arena (or measure it)
+//-----------------------------------------------------------------------------
+static void layout( loop_cache * c, arena * a )
+{
+    const size_t values = (size_t)c->entries * c->bins;
+
+    if( c->half )
+    {
+        c->magnitude16 = (uint16_t *)arena_alloc( a, values * sizeof(uint16_t) );
+        c->phase16 = (uint16_t *)arena_alloc( a, values * sizeof(uint16_t) );
+        c->scale = (float *)arena_alloc( a, c->entries * sizeof(float) );
+    }
+    else
+    {
+        c->magnitude = (float *)arena_alloc( a, values * sizeof(float) );
+        c->phase = (float *)arena_alloc( a, values * sizeof(float) );
+    }
+    c->valid = (bool *)arena_alloc( a, c->entries * sizeof(bool) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_frames()
+// desc: loop length trimmed down to a whole number of hops
+//-----------------------------------------------------------------------------
+long loopcache_frames( long frames, long hop )
+{
+    return frames / hop * hop;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_bytes()
+// desc: arena size of a cache, from a dry run of its layout
+//-----------------------------------------------------------------------------
+size_t loopcache_bytes( long frames, long hop, long bins, bool half )
+{
+    loop_cache c;
+    arena sizing;
+
+    memset( &c, 0, sizeof(c) );
+    c.entries = frames / hop;
+    c.bins = bins;
+    c.half = half;
+    arena_measure( &sizing );
+    layout( &c, &sizing );
+
+    return sizing.used;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_create()
+// desc: one entry per hop of frames, all invalid; -1 if frames is not a
+//       positive multiple of hop
+//-----------------------------------------------------------------------------
+int loopcache_create( loop_cache * c, long frames, long hop, long bins, bool half )
+{
+    memset( c, 0, sizeof(*c) );
+    if( frames < hop || frames % hop )
+        return -1;
+
+    c->entries = frames / hop;
+    c->hop = hop;
+    c->bins = bins;
+    c->half = half;
+
+    // zeroed, so every entry starts invalid
+    if( arena_create( &c->mem, loopcache_bytes( frames, hop, bins, half ), false ) != 0 )
+        return -1;
+    layout( c, &c->mem );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_destroy()
+// desc: free the storage; the cache may be created again
+//-----------------------------------------------------------------------------
+void loopcache_destroy( loop_cache * c )
+{
+    arena_destroy( &c->mem );
+    memset( c, 0, sizeof(*c) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_key()
+// desc: hop index of a loop offset, wrapping at entries; -1 off the grid
+//-----------------------------------------------------------------------------
+long loopcache_key( const loop_cache * c, long offset )
+{
+    if( offset < 0 || offset % c->hop )
+        return -1;
+
+    return offset / c->hop % c->entries;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_load()
+// desc: copy an entry out (expanding 16-bit storage) and count the hit,
+//       or count the miss
+//-----------------------------------------------------------------------------
+bool loopcache_load( loop_cache * c, long key, float * magnitude, float * phase )
+{
+    const size_t base = (size_t)key * c->bins;
+    long j;
+
+    if( !c->valid[key] )
+    {
+        c->misses++;
+        return false;
+    }
+    c->hits++;
+
+    if( !c->half )
+    {
+        memcpy( magnitude, c->magnitude + base, c->bins * sizeof(float) );
+        memcpy( phase, c->phase + base, c->bins * sizeof(float) );
+        return true;
+    }
+
+    for( j = 0; j < c->bins; j++ )
+    {
+        magnitude[j] = from_half( c->magnitude16[base + j] ) * c->scale[key];
+        phase[j] = ( (int)c->phase16[base + j] - 32768 ) * PHASE_STEP;
+    }
+
+    return true;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: loopcache_store()
+// desc: keep a hop's magnitude and phase, as fp32 or scaled to the
+//       frame peak as 16 bits, and mark the entry valid
+//-----------------------------------------------------------------------------
+void loopcache_store( loop_cache * c, long key, const float * magnitude, const float * phase )
+{
+    const size_t base = (size_t)key * c->bins;
+    float peak = 0.0f;
+    long j;
+
+    if( !c->half )
+    {
+        memcpy( c->magnitude + base, magnitude, c->bins * sizeof(float) );
+        memcpy( c->phase + base, phase, c->bins * sizeof(float) );
+        c->valid[key] = true;
+        return;
+    }
+
+    for( j = 0; j < c->bins; j++ )
+        if( magnitude[j] > peak ) peak = magnitude[j];
+    c->scale[key] = peak;
+
+    for( j = 0; j < c->bins; j++ )
+    {
+        // +pi lands on 65536, which wraps to the same angle at -pi
+        long step = lrintf( phase[j] / PHASE_STEP ) + 32768;
+        c->magnitude16[base + j] = peak > 0.0f ? to_half( magnitude[j] / peak ) : 0;
+        c->phase16[base + j] = (uint16_t)( step & 0xffff );
+    }
+    c->valid[key] = true;
+}
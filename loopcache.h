@@ -0,0 +1,60 @@
+//-----------------------------------------------------------------------------
+// name: loopcache.h
+// desc: analysis cache for looped playback
+//
+//   a looped file feeds the engine the same input frames on every pass, so
+//   the current frame's windowed forward fft and polar conversion (about
+//   half of engine_process()) give the same magnitude and phase every time.
+//   the cache keeps them per hop of the loop, keyed by the hop's frame
+//   offset, filled on the first pass and read on every later one.  the
+//   previous-frame analysis works on processed output and is never cached.
+//
+//   keys repeat only if the loop is a whole number of hops long; the
+//   players trim the loop to loopcache_frames() when the cache is on.
+//   storage is fp32, or 16 bits per value: magnitude as fp16 relative to
+//   the frame's peak (a float scale per entry, so quiet frames keep their
+//   precision) and phase as fixed point over -pi..pi (1e-4 rad steps).
+//   the round trip is accuracy's loopcache16 row, about 76 dB snr.
+//-----------------------------------------------------------------------------
+#ifndef __LOOPCACHE_H__
+#define __LOOPCACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arena.h"
+
+typedef struct
+{
+    long entries;           // hops in the loop
+    long hop;
+    long bins;              // values per entry (engine nbins)
+    bool half;              // 16-bit storage
+
+    float * magnitude;      // entries * bins, fp32 storage
+    float * phase;
+    uint16_t * magnitude16; // entries * bins, 16-bit storage
+    uint16_t * phase16;
+    float * scale;          // per entry, 16-bit storage
+    bool * valid;           // per entry
+
+    unsigned long hits, misses; // written by the audio thread only
+
+    arena mem;
+} loop_cache;
+
+// loop length the cache can serve: frames trimmed to whole hops
+long loopcache_frames( long frames, long hop );
+
+// cache for a loop of frames (a multiple of hop); returns 0 on success
+int  loopcache_create( loop_cache * c, long frames, long hop, long bins, bool half );
+void loopcache_destroy( loop_cache * c );
+size_t loopcache_bytes( long frames, long hop, long bins, bool half );
+
+// entry for the hop starting at loop frame offset, or -1 if offset is not
+// on the hop grid
+long loopcache_key( const loop_cache * c, long offset );
+// copy an entry out; false (a miss) if it was never stored
+bool loopcache_load( loop_cache * c, long key, float * magnitude, float * phase );
+void loopcache_store( loop_cache * c, long key, const float * magnitude, const float * phase );
+
+#endif
@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------------------
+// name: mailbox.c
+// desc: lock-free parameter mailbox
+//-----------------------------------------------------------------------------
+#include "mailbox.h"
+#include <sched.h>
+
+#define MAILBOX_SLOT        1u
+#define MAILBOX_READING     2u
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: mailbox_init()
+// desc: both slots start with the initial parameters
+//-----------------------------------------------------------------------------
+void mailbox_init( param_mailbox * mb, const engine_params * initial )
+{
+    mb->slot[0] = *initial;
+    mb->slot[1] = *initial;
+    atomic_init( &mb->state, 0 );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: mailbox_write()
+// desc: fill the unpublished slot, then flip the published index
+//-----------------------------------------------------------------------------
+void mailbox_write( param_mailbox * mb, const engine_params * params )
+{
+    unsigned int state = atomic_load_explicit( &mb->state, memory_order_relaxed );
+    unsigned int target = ( state & MAILBOX_SLOT ) ^ MAILBOX_SLOT;
+
+    // a read that began before our last flip may still hold the target slot;
+    // once the reading bit has been seen clear, every later read takes the
+    // published one
+    while( atomic_load_explicit( &mb->state, memory_order_acquire ) & MAILBOX_READING )
+        sched_yield();
+
+    mb->slot[target] = *params;
+
+    atomic_fetch_xor_explicit( &mb->state, MAILBOX_SLOT, memory_order_release );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: mailbox_read()
+// desc: wait-free copy of the published slot
+//-----------------------------------------------------------------------------
+void mailbox_read( param_mailbox * mb, engine_params * params )
+{
+    unsigned int state = atomic_fetch_or_explicit( &mb->state, MAILBOX_READING,
+                                                   memory_order_acquire );
+
+    *params = mb->slot[state & MAILBOX_SLOT];
+
+    atomic_fetch_and_explicit( &mb->state, ~MAILBOX_READING, memory_order_release );
+}
@@ -0,0 +1,29 @@
+//-----------------------------------------------------------------------------
+// name: mailbox.h
+// desc: lock-free parameter mailbox from the UI thread to the audio callback
+//
+//   two slots and one atomic word: bit 0 names the published slot, bit 1 is
+//   set while the callback copies it.  the callback's read is wait-free; the
+//   UI thread fills the unpublished slot and flips bit 0, waiting only if a
+//   read that started before its previous flip is still copying.
+//   one writer, one reader.
+//-----------------------------------------------------------------------------
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+
+#include <stdatomic.h>
+#include "engine.h"
+
+typedef struct
+{
+    engine_params slot[2];
+    atomic_uint state;
+} param_mailbox;
+
+void mailbox_init( param_mailbox * mb, const engine_params * initial );
+// UI thread: publish a new parameter set
+void mailbox_write( param_mailbox * mb, const engine_params * params );
+// audio thread: copy the latest published set, once per block
+void mailbox_read( param_mailbox * mb, engine_params * params );
+
+#endif
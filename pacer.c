@@ -0,0 +1,157 @@
+//-----------------------------------------------------------------------------
+// name: pacer.c
+// desc: render-on-demand frame pacing for the GLUT idle loop
+//-----------------------------------------------------------------------------
+#include "pacer.h"
+#include <time.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: clock_seconds()
+// desc: a clock (wall or thread cpu) in seconds
+//-----------------------------------------------------------------------------
+static double clock_seconds( clockid_t id )
+{
+    struct timespec ts;
+    clock_gettime( id, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: sleep_seconds()
+// desc: nanosleep for s seconds
+//-----------------------------------------------------------------------------
+static void sleep_seconds( double s )
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)s;
+    ts.tv_nsec = (long)( ( s - ts.tv_sec ) * 1e9 );
+    nanosleep( &ts, NULL );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pacer_init()
+// desc: cap at fps, or no cap at all if fps <= 0 (frames then follow new
+//       snapshots and vsync); the first frame is due at once
+//-----------------------------------------------------------------------------
+void pacer_init( frame_pacer * p, double fps )
+{
+    p->interval = fps > 0 ? 1.0 / fps : 0.0;
+    p->next = 0.0;
+    p->dirty = true;
+
+    p->frames = 0;
+    p->started = clock_seconds( CLOCK_MONOTONIC );
+    p->cpu_started = clock_seconds( CLOCK_THREAD_CPUTIME_ID );
+    p->begin = p->last_begin = 0.0;
+    p->draw_sum = p->draw_max = 0.0;
+    p->draw_min = 1e9;
+    p->gap_sum = p->gap_max = 0.0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pacer_invalidate()
+// desc: make the next frame due, as a new snapshot would
+//-----------------------------------------------------------------------------
+void pacer_invalidate( frame_pacer * p )
+{
+    p->dirty = true;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pacer_due()
+// desc: sleep for the cap when work is waiting, for the poll period when not
+//-----------------------------------------------------------------------------
+bool pacer_due( frame_pacer * p, bool pending )
+{
+    double now = clock_seconds( CLOCK_MONOTONIC );
+    double wait;
+
+    if( pending || p->dirty )
+    {
+        if( now >= p->next )
+            return true;
+        wait = p->next - now;
+    }
+    else
+        wait = PACER_POLL;
+
+    sleep_seconds( wait );
+    return false;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pacer_begin() / pacer_end()
+// desc: also called for frames glut asks for on its own (expose)
+//-----------------------------------------------------------------------------
+void pacer_begin( frame_pacer * p )
+{
+    p->begin = clock_seconds( CLOCK_MONOTONIC );
+    p->next = p->begin + p->interval;
+    p->dirty = false;
+}
+
+void pacer_end( frame_pacer * p )
+{
+    double draw = clock_seconds( CLOCK_MONOTONIC ) - p->begin;
+
+    if( p->frames > 0 )
+    {
+        double gap = p->begin - p->last_begin;
+        p->gap_sum += gap;
+        if( gap > p->gap_max ) p->gap_max = gap;
+    }
+    p->last_begin = p->begin;
+
+    p->draw_sum += draw;
+    if( draw < p->draw_min ) p->draw_min = draw;
+    if( draw > p->draw_max ) p->draw_max = draw;
+    p->frames++;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pacer_report()
+// desc: frames drawn and fps over the run, whether the cap was on, draw
+//       time min/mean/max, mean and max interval between frames, and the
+//       GUI thread's cpu share
+//-----------------------------------------------------------------------------
+void pacer_report( const frame_pacer * p, FILE * out )
+{
+    double wall = clock_seconds( CLOCK_MONOTONIC ) - p->started;
+    double cpu = clock_seconds( CLOCK_THREAD_CPUTIME_ID ) - p->cpu_started;
+
+    if( p->frames == 0 )
+    {
+        fprintf( out, "Frames: none drawn\n" );
+        return;
+    }
+
+    fprintf( out, "Frames: %lu in %.1f s (%.1f fps, cap %s)\n", p->frames, wall,
+             p->frames / wall, p->interval > 0 ? "on" : "off" );
+    fprintf( out, "Draw ms: min %.3f mean %.3f max %.3f\n", p->draw_min * 1e3,
+             p->draw_sum / p->frames * 1e3, p->draw_max * 1e3 );
+    if( p->frames > 1 )
+        fprintf( out, "Interval ms: mean %.3f max %.3f\n",
+                 p->gap_sum / ( p->frames - 1 ) * 1e3, p->gap_max * 1e3 );
+    fprintf( out, "GUI thread cpu: %.1f%%\n", wall > 0 ? 100.0 * cpu / wall : 0.0 );
+}
@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// name: pacer.h
+// desc: render-on-demand frame pacing for the GLUT idle loop
+//
+//   a frame is due only when something changed (a new snapshot or a
+//   reshape) and the frame-rate cap allows it; otherwise the idle callback
+//   sleeps instead of posting a redisplay.  keeps draw and interval times
+//   and the GUI thread's cpu time for a report.
+//-----------------------------------------------------------------------------
+#ifndef __PACER_H__
+#define __PACER_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// how often an idle pacer looks for new work, in seconds
+#define PACER_POLL          0.002
+
+typedef struct
+{
+    double interval;        // seconds between frames, 0 = uncapped
+    double next;            // earliest start of the next frame
+    bool dirty;             // window changed since the last frame
+
+    // statistics
+    unsigned long frames;
+    double started;         // wall and thread cpu clock at init
+    double cpu_started;
+    double begin;           // start of the frame being drawn
+    double last_begin;      // start of the previous one
+    double draw_sum, draw_min, draw_max;
+    double gap_sum, gap_max;
+} frame_pacer;
+
+// fps <= 0 leaves the rate to new snapshots and the driver's vsync
+void pacer_init( frame_pacer * p, double fps );
+
+// something other than a snapshot needs a redraw
+void pacer_invalidate( frame_pacer * p );
+
+// idle side: true if a frame should be drawn now, otherwise sleeps until
+// one could be; pending says a new snapshot is waiting
+bool pacer_due( frame_pacer * p, bool pending );
+
+// bracket the drawing in the display callback
+void pacer_begin( frame_pacer * p );
+void pacer_end( frame_pacer * p );
+
+void pacer_report( const frame_pacer * p, FILE * out );
+
+#endif
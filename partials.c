@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------------------
+// name: partials.c
+// desc: interpolated peaks and sparse harmonic synthesis
+//-----------------------------------------------------------------------------
+#include "partials.h"
+#include <math.h>
+
+#define LOBE_BINS   4       // main lobe of the hann window, in bins
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: hann_lobe()
+// desc: (-1)^m times the hann window transform m bins below bin, relative
+//       to its peak: sinc(d) / (1 - d^2) at d = bin - m.  sin(pi d) is
+//       (-1)^m sin(pi bin), so with the sign folded in every bin of the
+//       lobe shares s = sin(pi bin)
+//-----------------------------------------------------------------------------
+static inline float hann_lobe( float s, float bin, long m )
+{
+    const float pi = 3.14159265358979f;
+    float d = bin - m;
+
+    if( fabsf( d ) < 1e-4f )
+        return m & 1 ? -1.0f : 1.0f;
+    if( fabsf( fabsf( d ) - 1.0f ) < 1e-4f )
+        return m & 1 ? -0.5f : 0.5f;
+    return s / ( pi * d * ( 1.0f - d * d ) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: partials_find()
+// desc: one partial per local maximum of the marked bins: frequency and
+//       magnitude from a parabola through the log magnitudes, phase
+//       referred to the frame start; returns how many
+//-----------------------------------------------------------------------------
+long partials_find( const float * magnitude, const float * phase, const bool * peaks,
+                    long nbins, partial * out )
+{
+    const float pi = 3.14159265358979f;
+    long k, count = 0;
+
+    for( k = 1; k < nbins / 2 - 1; k++ )
+    {
+        float p, slope, curve;
+
+        // a local maximum of a marked run
+        if( !peaks[k] || magnitude[k] < magnitude[k-1] || magnitude[k] <= magnitude[k+1] ||
+            magnitude[k-1] <= 0.0f || magnitude[k+1] <= 0.0f )
+            continue;
+
+        // parabola through the log magnitudes a, b, c of k-1, k, k+1: its vertex
+        // is p = (a - c) / 2(a - 2b + c) bins off k, at b - (a - c) p / 4
+        slope = logf( magnitude[k-1] / magnitude[k+1] );
+        curve = logf( magnitude[k-1] * ( magnitude[k+1] / magnitude[k] ) / magnitude[k] );
+        p = curve < 0.0f ? 0.5f * slope / curve : 0.0f;
+
+        out[count].bin = k + p;
+        out[count].magnitude = magnitude[k] * expf( -0.25f * slope * p );
+        // X(k) ~ e^-i(theta - pi k) for a frame starting at 0: theta is
+        // the same from any bin of the main lobe
+        out[count].phase = pi * ( k & 1 ) - phase[k];
+        out[count].cos_phase = cosf( out[count].phase );
+        out[count].sin_phase = sinf( out[count].phase );
+        out[count].cos_bin = cosf( pi * p ) * ( k & 1 ? -1.0f : 1.0f );
+        out[count].sin_bin = sinf( pi * p ) * ( k & 1 ? -1.0f : 1.0f );
+        count++;
+    }
+
+    return count;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: partials_stamp()
+// desc: add gain/2 of each partial's order-th multiple as a main lobe over
+//       the bins around it; multiples too near the top are left out
+//-----------------------------------------------------------------------------
+void partials_stamp( const partial * partials, long count, int order, float gain,
+                     float * re, float * im, long nbins )
+{
+    long n, m;
+    int k;
+
+    if( gain == 0.0f )
+        return;
+
+    for( n = 0; n < count; n++ )
+    {
+        const partial * q = &partials[n];
+        const float bin = order * q->bin;
+        const long whole = (long)bin;
+        float cr = q->cos_phase, ci = q->sin_phase, sr = q->cos_bin, si = q->sin_bin;
+
+        if( bin >= nbins - LOBE_BINS / 2 )
+            continue;
+
+        // e^i order phase and e^i pi order bin
+        for( k = 1; k < order; k++ )
+        {
+            float t = cr * q->cos_phase - ci * q->sin_phase;
+            ci = cr * q->sin_phase + ci * q->cos_phase;
+            cr = t;
+            t = sr * q->cos_bin - si * q->sin_bin;
+            si = sr * q->sin_bin + si * q->cos_bin;
+            sr = t;
+        }
+        cr *= 0.5f * gain;
+        ci *= -0.5f * gain;
+
+        // e^-i order phase times the signed lobe, bins within two of bin
+        for( m = whole - 1; m <= whole + 2; m++ )
+        {
+            float w;
+            if( m < 1 || m <= bin - LOBE_BINS / 2 )
+                continue;
+            w = hann_lobe( si, bin, m );
+            re[m] += w * cr;
+            im[m] += w * ci;
+        }
+    }
+}
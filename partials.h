@@ -0,0 +1,44 @@
+//-----------------------------------------------------------------------------
+// name: partials.h
+// desc: interpolated peaks and sparse harmonic synthesis
+//
+//   harmonics() adds to bins j*order, so the harmonics of a partial that
+//   sits between bins land on the wrong bins, and it walks every multiple
+//   of every bin above the adaptive curve.  here each run of bins
+//   findpeaks() marked gives one partial: its local maximum, refined by
+//   quadratic interpolation of the log magnitude (QIFFT), with the phase
+//   it has at the centre of the frame.  each harmonic is then stamped into
+//   the split spectrum at exactly order times the partial's frequency, as
+//   the main lobe of a hann windowed sinusoid (4 bins) with order times
+//   its phase, so the cost is a few bins per partial and order; the only
+//   transcendentals are taken once per partial, in partials_find().
+//
+//   the stamp's peak magnitude is gain/2, what harmonics() adds per bin.
+//-----------------------------------------------------------------------------
+#ifndef __PARTIALS_H__
+#define __PARTIALS_H__
+
+#include <stdbool.h>
+
+typedef struct
+{
+    float bin;          // frequency in bins, fractional
+    float magnitude;    // interpolated peak magnitude
+    float phase;        // phase at the centre of the frame
+    float cos_phase, sin_phase; // e^i phase, and e^i pi bin: the stamps
+    float cos_bin, sin_bin;     //   raise them to the order's power
+} partial;
+
+// partials of a spectrum (nbins bins of magnitude and phase) from the
+// peak flags of its first nbins/2 bins; out needs room for nbins/4.
+// returns how many were found
+long partials_find( const float * magnitude, const float * phase, const bool * peaks,
+                    long nbins, partial * out );
+
+// add the order-th harmonic of count partials to a split spectrum of
+// nbins bins, peak magnitude gain/2; harmonics that would reach past
+// nbins - 2 are left out
+void partials_stamp( const partial * partials, long count, int order, float gain,
+                     float * re, float * im, long nbins );
+
+#endif
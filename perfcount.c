@@ -0,0 +1,176 @@
+//-----------------------------------------------------------------------------
+// name: perfcount.c
+// desc: hardware performance counters of the calling thread
+//-----------------------------------------------------------------------------
+#include "perfcount.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const char * g_names[PERF_COUNTERS] =
+{
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+};
+
+static const struct { uint32_t type; uint64_t config; } g_events[PERF_COUNTERS] =
+{
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) |
+                          ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_group_open()
+// desc: open each counter into one group led by the first that opens;
+//       the reason goes to stderr if none does
+//-----------------------------------------------------------------------------
+int perf_group_open( perf_group * g )
+{
+    int i, err = 0;
+
+    g->leader = -1;
+    g->open = 0;
+    g->enabled = g->running = 0;
+
+    for( i = 0; i < PERF_COUNTERS; i++ )
+    {
+        struct perf_event_attr attr;
+
+        memset( &attr, 0, sizeof(attr) );
+        attr.size = sizeof(attr);
+        attr.type = g_events[i].type;
+        attr.config = g_events[i].config;
+        attr.disabled = g->leader < 0;      // the leader starts the group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        g->fd[i] = (int)syscall( __NR_perf_event_open, &attr, 0, -1, g->leader, 0 );
+        if( g->fd[i] < 0 )
+        {
+            err = errno;
+            continue;
+        }
+
+        if( g->leader < 0 )
+            g->leader = g->fd[i];
+        g->slot[i] = g->open++;
+    }
+
+    if( g->open == 0 )
+        fprintf( stderr, "Error: no hardware counters (%s); check perf_event_paranoid and that "
+                 "the pmu is exposed to this machine\n", strerror( err ) );
+
+    return g->open;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_group_close()
+// desc: close every counter that was opened
+//-----------------------------------------------------------------------------
+void perf_group_close( perf_group * g )
+{
+    int i;
+
+    for( i = 0; i < PERF_COUNTERS; i++ )
+        if( g->fd[i] >= 0 )
+            close( g->fd[i] );
+
+    g->leader = -1;
+    g->open = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_group_enable()
+// desc: reset the whole group to zero and start it
+//-----------------------------------------------------------------------------
+void perf_group_enable( perf_group * g )
+{
+    if( g->leader < 0 )
+        return;
+
+    ioctl( g->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+    ioctl( g->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_group_read()
+// desc: all counters and the enabled/running times in one read(); zeros
+//       and -1 if the group is not open
+//-----------------------------------------------------------------------------
+int perf_group_read( perf_group * g, uint64_t * values )
+{
+    // nr, time_enabled, time_running, then one value per counter
+    uint64_t buffer[3 + PERF_COUNTERS];
+    int i;
+
+    if( g->leader < 0 || read( g->leader, buffer, sizeof(buffer) ) < (ssize_t)( 3 * sizeof(uint64_t) ) )
+    {
+        memset( values, 0, PERF_COUNTERS * sizeof(uint64_t) );
+        return -1;
+    }
+
+    g->enabled = buffer[1];
+    g->running = buffer[2];
+    for( i = 0; i < PERF_COUNTERS; i++ )
+        values[i] = g->fd[i] >= 0 ? buffer[3 + g->slot[i]] : 0;
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_group_has()
+// desc: true if the counter opened on this machine
+//-----------------------------------------------------------------------------
+bool perf_group_has( const perf_group * g, int counter )
+{
+    return g->fd[counter] >= 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_group_coverage()
+// desc: running over enabled time of the last read; below 1 when the
+//       kernel multiplexed the group
+//-----------------------------------------------------------------------------
+double perf_group_coverage( const perf_group * g )
+{
+    return g->enabled ? (double)g->running / g->enabled : 0.0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: perf_counter_name()
+// desc: json key of a counter
+//-----------------------------------------------------------------------------
+const char * perf_counter_name( int counter )
+{
+    return g_names[counter];
+}
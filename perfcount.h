@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// name: perfcount.h
+// desc: hardware performance counters of the calling thread (Linux
+//       perf_event_open)
+//
+//   the counters are opened as one group so they are always scheduled
+//   together and one read() returns all of them.  user space only, which
+//   works with the default perf_event_paranoid of 2.  counters the cpu or
+//   hypervisor does not provide are left out and read as 0; if the pmu has
+//   fewer slots than the group needs the kernel multiplexes it, and
+//   perf_group_coverage() drops below 1.
+//-----------------------------------------------------------------------------
+#ifndef __PERFCOUNT_H__
+#define __PERFCOUNT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,        // l1 data cache read misses
+    PERF_LLC_MISSES,        // last level cache misses
+    PERF_COUNTERS
+};
+
+typedef struct
+{
+    int fd[PERF_COUNTERS];      // -1 where the counter is not available
+    int slot[PERF_COUNTERS];    // position in the group read
+    int leader;                 // fd of the group leader, or -1
+    int open;                   // counters in the group
+    uint64_t enabled, running;  // ns, as of the last read
+} perf_group;
+
+// opens what it can; returns the number of counters opened (0: none, with
+// the reason printed to stderr)
+int  perf_group_open( perf_group * g );
+void perf_group_close( perf_group * g );
+// starts counting; reads are cumulative from here
+void perf_group_enable( perf_group * g );
+// one read() of the whole group into values[PERF_COUNTERS]
+int  perf_group_read( perf_group * g, uint64_t * values );
+bool perf_group_has( const perf_group * g, int counter );
+// fraction of the enabled time the group was actually on the pmu
+double perf_group_coverage( const perf_group * g );
+const char * perf_counter_name( int counter );
+
+#endif
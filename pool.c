@@ -0,0 +1,182 @@
+//-----------------------------------------------------------------------------
+// name: pool.c
+// desc: persistent worker threads for splitting one job per hop
+//-----------------------------------------------------------------------------
+#include "pool.h"
+#include "rtcheck.h"
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: relax()
+// desc: one poll of a spin loop
+//-----------------------------------------------------------------------------
+static inline void relax( void )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_ia32_pause( );
+#elif defined( __aarch64__ )
+    __asm__ __volatile__( "yield" );
+#endif
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: wait_job()
+// desc: until the generation moves past seen; returns the new one
+//-----------------------------------------------------------------------------
+static unsigned int wait_job( worker_pool * pool, unsigned int seen )
+{
+    const struct timespec nap = { 0, POOL_NAP_US * 1000L };
+    unsigned int generation;
+    long polls = 0;
+
+    while( ( generation = atomic_load_explicit( &pool->generation, memory_order_acquire ) ) == seen )
+    {
+        if( polls < POOL_SPINS )
+            relax( );
+        else if( polls < POOL_SPINS + POOL_YIELDS )
+            sched_yield( );
+        else
+            nanosleep( &nap, NULL );
+        if( polls < POOL_SPINS + POOL_YIELDS )
+            polls++;
+    }
+
+    return generation;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: worker()
+// desc: run this worker's share of each job until the pool is destroyed
+//-----------------------------------------------------------------------------
+static void * worker( void * arg )
+{
+    pool_worker * w = (pool_worker *)arg;
+    worker_pool * pool = w->pool;
+    unsigned int seen = 0;
+
+    for( ;; )
+    {
+        seen = wait_job( pool, seen );
+        if( pool->finished )
+            break;
+
+        // a share is the audio thread's work, checked as such
+        RTCHECK_ENTER( );
+        pool->task( pool->arg, w->index, pool->threads );
+        RTCHECK_LEAVE( );
+
+        atomic_fetch_add_explicit( &pool->done, 1, memory_order_release );
+    }
+
+    return NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: finish()
+// desc: stop and join workers [1, started)
+//-----------------------------------------------------------------------------
+static void finish( worker_pool * pool, int started )
+{
+    int k;
+
+    pool->finished = true;
+    atomic_fetch_add_explicit( &pool->generation, 1, memory_order_release );
+    for( k = 1; k < started; k++ )
+        pthread_join( pool->workers[k].thread, NULL );
+    memset( pool, 0, sizeof(*pool) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pool_create()
+// desc: start threads - 1 workers waiting on the generation counter (the
+//       caller is share 0); -1 and nothing running if one fails
+//-----------------------------------------------------------------------------
+int pool_create( worker_pool * pool, int threads )
+{
+    int started;
+
+    memset( pool, 0, sizeof(*pool) );
+    if( threads < 2 || threads > POOL_MAX_THREADS )
+        return -1;
+
+    pool->threads = threads;
+    pool->finished = false;
+    atomic_init( &pool->generation, 0 );
+    atomic_init( &pool->done, 0 );
+
+    for( started = 1; started < threads; started++ )
+    {
+        pool->workers[started].pool = pool;
+        pool->workers[started].index = started;
+        if( pthread_create( &pool->workers[started].thread, NULL, worker,
+                            &pool->workers[started] ) != 0 )
+            break;
+    }
+
+    if( started != threads )
+    {
+        finish( pool, started );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pool_destroy()
+// desc: stop and join the workers (nothing to do for a pool never created)
+//-----------------------------------------------------------------------------
+void pool_destroy( worker_pool * pool )
+{
+    if( pool->threads < 2 )
+        return;
+
+    finish( pool, pool->threads );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pool_run()
+// desc: publish the job, run share 0, spin until the workers are through
+//-----------------------------------------------------------------------------
+void pool_run( worker_pool * pool, pool_task task, void * arg )
+{
+    long polls = 0;
+
+    pool->task = task;
+    pool->arg = arg;
+    atomic_store_explicit( &pool->done, 0, memory_order_relaxed );
+    atomic_fetch_add_explicit( &pool->generation, 1, memory_order_release );
+
+    task( arg, 0, pool->threads );
+
+    while( atomic_load_explicit( &pool->done, memory_order_acquire ) < pool->threads - 1 )
+    {
+        if( polls++ < POOL_SPINS )
+            relax( );
+        else
+            sched_yield( );
+    }
+}
@@ -0,0 +1,61 @@
+//-----------------------------------------------------------------------------
+// name: pool.h
+// desc: persistent worker threads for splitting one job per hop
+//
+//   the threads are started once and wait for the job generation to move;
+//   pool_run() publishes a task by bumping it, runs share 0 itself and
+//   spins until every worker has counted its share done.  the caller is
+//   the audio thread, so nothing on its side sleeps or takes a lock: it
+//   spins, then yields.  an idle worker spins, yields, then naps
+//   POOL_NAP_US at a time, so a worker woken from a long idle stretch can
+//   start up to that late.  shares are fixed by index, so a task that
+//   partitions its output by index is deterministic whatever the
+//   scheduling.
+//-----------------------------------------------------------------------------
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define POOL_MAX_THREADS    16
+#define POOL_SPINS          4096    // polls before a waiting thread yields
+#define POOL_YIELDS         1024    // yields before an idle worker naps
+#define POOL_NAP_US         50
+
+// share index of count
+typedef void (* pool_task)( void * arg, int index, int count );
+
+typedef struct worker_pool worker_pool;
+
+// what a worker thread is started with
+typedef struct
+{
+    worker_pool * pool;
+    int index;
+    pthread_t thread;
+} pool_worker;
+
+struct worker_pool
+{
+    int threads;                // shares, the calling thread's included
+    pool_worker workers[POOL_MAX_THREADS]; // [1, threads)
+    atomic_uint generation;     // bumped once per job, and to finish
+    atomic_int done;            // workers through the current job
+
+    // the job, written before generation is bumped
+    pool_task task;
+    void * arg;
+    bool finished;
+};
+
+// threads shares in all: starts threads - 1 workers (2 to
+// POOL_MAX_THREADS); returns 0 on success
+int  pool_create( worker_pool * pool, int threads );
+void pool_destroy( worker_pool * pool );
+
+// run task over every share and wait for all of them
+void pool_run( worker_pool * pool, pool_task task, void * arg );
+
+#endif
@@ -0,0 +1,116 @@
+//-----------------------------------------------------------------------------
+// name: pyramid.c
+// desc: min/max level-of-detail pyramid over a ring of samples
+//-----------------------------------------------------------------------------
+#include "pyramid.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pyramid_create()
+// desc: one arena for all levels, 2^1 up to the block size per bucket
+//-----------------------------------------------------------------------------
+int pyramid_create( minmax_pyramid * p, long frames, long block )
+{
+    size_t bytes = 0;
+    int l;
+
+    p->frames = frames;
+    p->block = block;
+    p->levels = 1;
+
+    if( block < 2 || ( block & (block-1) ) || frames % block )
+        return -1;
+
+    while( p->levels < PYRAMID_MAX_LEVELS && ( 1L << p->levels ) <= block )
+        p->levels++;
+
+    for( l = 1; l < p->levels; l++ )
+        bytes += ARENA_ROUND( 2 * ( frames >> l ) * sizeof(float) );
+
+    if( arena_create( &p->mem, bytes, false ) != 0 )
+        return -1;
+
+    p->level[0] = NULL;
+    for( l = 1; l < p->levels; l++ )
+        p->level[l] = (float *)arena_alloc( &p->mem, 2 * ( frames >> l ) * sizeof(float) );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pyramid_destroy()
+// desc: free the levels; the pyramid is empty after
+//-----------------------------------------------------------------------------
+void pyramid_destroy( minmax_pyramid * p )
+{
+    arena_destroy( &p->mem );
+    p->levels = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pyramid_update()
+// desc: level 1 from the samples, every further level from the one below
+//-----------------------------------------------------------------------------
+void pyramid_update( minmax_pyramid * p, const float * block, long offset )
+{
+    long i, n, first;
+    int l;
+
+    // level 1: pairs of samples
+    {
+        float * dst = p->level[1] + 2 * ( offset >> 1 );
+        n = p->block >> 1;
+        for( i = 0; i < n; i++ )
+        {
+            float a = block[2*i], b = block[2*i+1];
+            dst[2*i] = a < b ? a : b;
+            dst[2*i+1] = a < b ? b : a;
+        }
+    }
+
+    // level l: pairs of buckets from level l-1
+    for( l = 2; l < p->levels; l++ )
+    {
+        const float * src;
+        float * dst;
+
+        first = offset >> l;
+        n = p->block >> l;
+        src = p->level[l-1] + 4 * first;
+        dst = p->level[l] + 2 * first;
+
+        for( i = 0; i < n; i++ )
+        {
+            float lo0 = src[4*i], hi0 = src[4*i+1];
+            float lo1 = src[4*i+2], hi1 = src[4*i+3];
+            dst[2*i] = lo0 < lo1 ? lo0 : lo1;
+            dst[2*i+1] = hi0 > hi1 ? hi0 : hi1;
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pyramid_pick_level()
+// desc: coarsest level that still has at least one min/max pair per
+//       pixel
+//-----------------------------------------------------------------------------
+int pyramid_pick_level( const minmax_pyramid * p, long pixels )
+{
+    int l = 0;
+
+    while( l + 1 < p->levels && ( p->frames >> ( l + 1 ) ) >= pixels )
+        l++;
+
+    return l;
+}
@@ -0,0 +1,36 @@
+//-----------------------------------------------------------------------------
+// name: pyramid.h
+// desc: min/max level-of-detail pyramid over a ring of samples
+//
+//   level l holds one (min, max) pair per 2^l samples of the ring, stored
+//   interleaved; level 0 is the ring itself and is not stored here.  the
+//   ring is written a block at a time and each write refreshes only the
+//   buckets that block covers, so levels stop at the block size.
+//-----------------------------------------------------------------------------
+#ifndef __PYRAMID_H__
+#define __PYRAMID_H__
+
+#include "arena.h"
+
+#define PYRAMID_MAX_LEVELS  24
+
+typedef struct
+{
+    long frames;                        // ring length, a multiple of block
+    long block;                         // write size, a power of 2
+    int levels;                         // levels 1..levels-1 are stored
+    float * level[PYRAMID_MAX_LEVELS];  // 2 * (frames >> l) floats each
+    arena mem;
+} minmax_pyramid;
+
+// returns 0 on success
+int  pyramid_create( minmax_pyramid * p, long frames, long block );
+void pyramid_destroy( minmax_pyramid * p );
+
+// refresh every level over the block just written at offset in the ring
+void pyramid_update( minmax_pyramid * p, const float * block, long offset );
+
+// coarsest level that still has at least pixels buckets
+int  pyramid_pick_level( const minmax_pyramid * p, long pixels );
+
+#endif
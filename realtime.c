@@ -0,0 +1,195 @@
+//-----------------------------------------------------------------------------
+// name: realtime.c
+// desc: realtime mode - locked memory, SCHED_FIFO, affinity, FTZ/DAZ
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "realtime.h"
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined( __SSE__ )
+  #include <xmmintrin.h>
+  #define MXCSR_FTZ         0x8000
+  #define MXCSR_DAZ         0x0040
+#endif
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: realtime_parse()
+// desc: parse priority[,cpu]; the cpu is -1 (any) when left out
+//-----------------------------------------------------------------------------
+int realtime_parse( realtime_config * config, const char * spec )
+{
+    char * end;
+    long value;
+
+    config->priority = REALTIME_PRIORITY;
+    config->cpu = -1;
+
+    value = strtol( spec, &end, 10 );
+    if( end == spec || value < 0 || value > sched_get_priority_max( SCHED_FIFO ) )
+        return -1;
+    config->priority = (int)value;
+    if( *end == '\0' )
+        return 0;
+    if( *end != ',' )
+        return -1;
+
+    spec = end + 1;
+    value = strtol( spec, &end, 10 );
+    if( end == spec || *end != '\0' || value < 0 )
+        return -1;
+    config->cpu = (int)value;
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: realtime_lock_memory()
+// desc: mlockall() current and future pages; records the first failure
+//-----------------------------------------------------------------------------
+void realtime_lock_memory( realtime_status * status )
+{
+    if( mlockall( MCL_CURRENT | MCL_FUTURE ) != 0 && !status->lock )
+        status->lock = errno;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: realtime_prefault()
+// desc: write each page's first byte back to itself, so it is mapped
+//       private and present
+//-----------------------------------------------------------------------------
+void realtime_prefault( void * mem, size_t bytes )
+{
+    volatile char * p = (volatile char *)mem;
+    const size_t page = (size_t)sysconf( _SC_PAGESIZE );
+    size_t i;
+
+    for( i = 0; i < bytes; i += page )
+        p[i] = p[i];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: denormals_off()
+// desc: flush denormal results and operands to zero on the calling thread;
+//       returns 0 or ENOTSUP
+//-----------------------------------------------------------------------------
+static int denormals_off( void )
+{
+#if defined( __SSE__ )
+    _mm_setcsr( _mm_getcsr( ) | MXCSR_FTZ | MXCSR_DAZ );
+    return 0;
+#elif defined( __aarch64__ )
+    unsigned long fpcr;
+    __asm__ __volatile__( "mrs %0, fpcr" : "=r"( fpcr ) );
+    fpcr |= 1UL << 24;  // FZ
+    __asm__ __volatile__( "msr fpcr, %0" : : "r"( fpcr ) );
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: realtime_thread()
+// desc: set up the calling thread: SCHED_FIFO at priority, pinned to
+//       cpu + offset, FTZ/DAZ on, and REALTIME_STACK_BYTES (256 KB) of
+//       stack touched so it is faulted in; the players call it from the
+//       first audio callback, the pool on each worker
+//-----------------------------------------------------------------------------
+void realtime_thread( const realtime_config * config, int offset, realtime_status * status )
+{
+    volatile char stack[REALTIME_STACK_BYTES];
+    size_t i;
+    int err;
+
+    if( config->priority > 0 )
+    {
+        struct sched_param param;
+        memset( &param, 0, sizeof(param) );
+        param.sched_priority = config->priority;
+        err = pthread_setschedparam( pthread_self( ), SCHED_FIFO, &param );
+        if( err && !status->schedule )
+            status->schedule = err;
+    }
+
+    if( config->cpu >= 0 )
+    {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( ( config->cpu + offset ) % ( cpus > 0 ? cpus : 1 ), &set );
+        err = pthread_setaffinity_np( pthread_self( ), sizeof(set), &set );
+        if( err && !status->affinity )
+            status->affinity = err;
+    }
+
+    err = denormals_off( );
+    if( err && !status->denormals )
+        status->denormals = err;
+
+    // the deepest the callback is expected to go, faulted in now
+    for( i = 0; i < sizeof(stack); i += 1024 )
+        stack[i] = 0;
+
+    status->threads++;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: realtime_report()
+// desc: one line per failure, or one saying all went well; returns the
+//       number of failures
+//-----------------------------------------------------------------------------
+int realtime_report( FILE * out, const char * who, const realtime_status * status )
+{
+    int failed = 0;
+
+    if( status->lock )
+    {
+        fprintf( out, "Realtime (%s): could not lock memory: %s\n", who, strerror( status->lock ) );
+        failed++;
+    }
+    if( status->schedule )
+    {
+        fprintf( out, "Realtime (%s): could not set SCHED_FIFO: %s\n", who, strerror( status->schedule ) );
+        failed++;
+    }
+    if( status->affinity )
+    {
+        fprintf( out, "Realtime (%s): could not set CPU affinity: %s\n", who, strerror( status->affinity ) );
+        failed++;
+    }
+    if( status->denormals )
+    {
+        fprintf( out, "Realtime (%s): could not flush denormals: %s\n", who, strerror( status->denormals ) );
+        failed++;
+    }
+    if( !failed )
+        fprintf( out, "Realtime (%s): memory locked, %d thread%s set up\n", who, status->threads,
+                status->threads == 1 ? "" : "s" );
+
+    return failed;
+}
@@ -0,0 +1,59 @@
+//-----------------------------------------------------------------------------
+// name: realtime.h
+// desc: realtime mode - locked memory, SCHED_FIFO, affinity, FTZ/DAZ
+//
+//   an average block takes a fraction of its deadline, so the xruns left
+//   are page faults and preemption: memory is locked (mlockall) and the
+//   arenas and thread stacks touched before the stream starts, the audio
+//   thread and the engine's workers run SCHED_FIFO pinned to a CPU each,
+//   and each of them flushes denormals to zero (the overlap-add tails and
+//   the feedback through the previous frame decay into them).
+//
+//   nothing here is fatal: every setting that could not be applied is
+//   kept as an errno and reported, and the stream runs without it.
+//   SCHED_FIFO and mlockall usually need CAP_SYS_NICE / CAP_IPC_LOCK or
+//   matching rtprio and memlock limits.
+//-----------------------------------------------------------------------------
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define REALTIME_PRIORITY       70          // below the kernel's irq threads
+#define REALTIME_STACK_BYTES    ( 256 * 1024 )
+
+typedef struct
+{
+    int priority;       // SCHED_FIFO priority; 0 leaves the policy alone
+    int cpu;            // CPU of the audio thread, workers on the next
+                        //   ones; -1 leaves affinity alone
+} realtime_config;
+
+// what could not be applied: 0, or the errno of each setting
+typedef struct
+{
+    int lock;           // mlockall
+    int schedule;       // SCHED_FIFO, first thread it failed on
+    int affinity;
+    int denormals;      // ENOTSUP without an FTZ/DAZ control register
+    int threads;        // threads set up
+} realtime_status;
+
+// "priority[,cpu]" into config; returns 0 on success
+int  realtime_parse( realtime_config * config, const char * spec );
+
+// lock current and future pages; records any failure in status
+void realtime_lock_memory( realtime_status * status );
+// touch every page of [mem, mem + bytes)
+void realtime_prefault( void * mem, size_t bytes );
+
+// the calling thread: priority, the cpu + offset-th CPU (wrapping),
+// denormals off, REALTIME_STACK_BYTES of stack touched; records failures
+void realtime_thread( const realtime_config * config, int offset, realtime_status * status );
+
+// print what could not be applied, one line each; returns how many
+// settings failed
+int  realtime_report( FILE * out, const char * who, const realtime_status * status );
+
+#endif
@@ -0,0 +1,258 @@
+//-----------------------------------------------------------------------------
+// name: recorder.c
+// desc: record the processed output to disk without blocking the callback
+//-----------------------------------------------------------------------------
+#include "recorder.h"
+#include <sched.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: format_of()
+// desc: libsndfile format for the extension of path; 0 if unknown
+//-----------------------------------------------------------------------------
+static int format_of( const char * path )
+{
+    const char * dot = strrchr( path, '.' );
+
+    if( !dot )
+        return 0;
+    if( strcasecmp( dot, ".wav" ) == 0 )
+        return SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    if( strcasecmp( dot, ".flac" ) == 0 )
+        return SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+    if( strcasecmp( dot, ".raw" ) == 0 )
+        return SF_FORMAT_RAW | SF_FORMAT_FLOAT;
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: drain()
+// desc: write count frames from the tail, in at most two pieces (the ring
+//       wraps); after a write error the frames are only taken
+//-----------------------------------------------------------------------------
+static void drain( recorder * rec, unsigned long tail, unsigned long count )
+{
+    unsigned long start = tail & ( rec->capacity - 1 );
+    unsigned long first = count < rec->capacity - start ? count : rec->capacity - start;
+    sf_count_t done;
+
+    if( !atomic_load_explicit( &rec->error, memory_order_relaxed ) )
+    {
+        done = sf_writef_float( rec->file, rec->ring + start * rec->channels, first );
+        if( done == (sf_count_t)first && count > first )
+            done += sf_writef_float( rec->file, rec->ring, count - first );
+        atomic_fetch_add_explicit( &rec->written, (unsigned long)done, memory_order_relaxed );
+        if( done != (sf_count_t)count )
+        {
+            int err = sf_error( rec->file );
+            atomic_store_explicit( &rec->error, err ? err : -1, memory_order_relaxed );
+        }
+    }
+
+    // the frames may be overwritten from here on
+    atomic_store_explicit( &rec->tail, tail + count, memory_order_release );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: writer()
+// desc: drain a chunk whenever there is one, everything when stopping
+//-----------------------------------------------------------------------------
+static void * writer( void * arg )
+{
+    recorder * rec = (recorder *)arg;
+    struct timespec poll = { 0, RECORDER_POLL_MS * 1000000L };
+    unsigned long head, tail = atomic_load_explicit( &rec->tail, memory_order_relaxed );
+    bool stopping;
+
+    for( ;; )
+    {
+        stopping = atomic_load_explicit( &rec->stopping, memory_order_acquire );
+        head = atomic_load_explicit( &rec->head, memory_order_acquire );
+
+        if( head - tail >= rec->chunk )
+        {
+            drain( rec, tail, rec->chunk );
+            tail += rec->chunk;
+        }
+        else if( stopping )
+        {
+            if( head != tail )
+                drain( rec, tail, head - tail );
+            break;
+        }
+        else
+            nanosleep( &poll, NULL );
+    }
+
+    return NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: recorder_open()
+// desc: size the ring to RECORDER_SECONDS (at least four blocks), open
+//       the file and start the writer at normal priority; -1 on an
+//       unknown extension or if the file or thread cannot be made
+//-----------------------------------------------------------------------------
+int recorder_open( recorder * rec, const char * path, double rate, int channels, long block )
+{
+    SF_INFO info;
+    pthread_attr_t attr;
+    struct sched_param param;
+    unsigned long need = (unsigned long)( RECORDER_SECONDS * rate );
+
+    memset( rec, 0, sizeof(*rec) );
+    if( channels < 1 || block < 1 )
+        return -1;
+
+    memset( &info, 0, sizeof(info) );
+    info.samplerate = (int)rate;
+    info.channels = channels;
+    info.format = format_of( path );
+    if( !info.format || !sf_format_check( &info ) )
+        return -1;
+
+    if( need < 4 * (unsigned long)block )
+        need = 4 * (unsigned long)block;
+    for( rec->capacity = 1; rec->capacity < need; rec->capacity <<= 1 )
+        ;
+    rec->chunk = rec->capacity / 4;
+    rec->channels = channels;
+    rec->rate = rate;
+    rec->path = path;
+
+    // zeroed, so the ring is faulted in before the callback touches it
+    if( arena_create( &rec->mem, rec->capacity * channels * sizeof(float), false ) != 0 )
+        return -1;
+    rec->ring = (float *)arena_alloc( &rec->mem, rec->capacity * channels * sizeof(float) );
+
+    if( ( rec->file = sf_open( path, SFM_WRITE, &info ) ) == NULL )
+    {
+        arena_destroy( &rec->mem );
+        return -1;
+    }
+
+    atomic_init( &rec->head, 0 );
+    atomic_init( &rec->tail, 0 );
+    atomic_init( &rec->blocks, 0 );
+    atomic_init( &rec->dropped_blocks, 0 );
+    atomic_init( &rec->dropped_frames, 0 );
+    atomic_init( &rec->peak, 0 );
+    atomic_init( &rec->written, 0 );
+    atomic_init( &rec->error, 0 );
+    atomic_init( &rec->stopping, false );
+
+    // an ordinary thread, even when opened from a SCHED_FIFO one
+    memset( &param, 0, sizeof(param) );
+    pthread_attr_init( &attr );
+    pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+    pthread_attr_setschedpolicy( &attr, SCHED_OTHER );
+    pthread_attr_setschedparam( &attr, &param );
+    if( pthread_create( &rec->writer, &attr, writer, rec ) != 0 )
+    {
+        pthread_attr_destroy( &attr );
+        sf_close( rec->file );
+        arena_destroy( &rec->mem );
+        rec->file = NULL;
+        return -1;
+    }
+    pthread_attr_destroy( &attr );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: recorder_close()
+// desc: nothing to do for a recorder that is not open
+//-----------------------------------------------------------------------------
+void recorder_close( recorder * rec )
+{
+    if( !rec->file )
+        return;
+
+    atomic_store_explicit( &rec->stopping, true, memory_order_release );
+    pthread_join( rec->writer, NULL );
+
+    sf_close( rec->file );
+    rec->file = NULL;
+    arena_destroy( &rec->mem );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: recorder_push()
+// desc: audio thread, wait-free: copy the block in behind head, or, if
+//       the ring lacks room for all of it, drop the whole block and count
+//       it; never blocks, allocates or calls into the kernel
+//-----------------------------------------------------------------------------
+bool recorder_push( recorder * rec, const float * frames, long count )
+{
+    unsigned long head = atomic_load_explicit( &rec->head, memory_order_relaxed );
+    unsigned long tail = atomic_load_explicit( &rec->tail, memory_order_acquire );
+    unsigned long start, first, waiting;
+    const size_t frame = rec->channels * sizeof(float);
+
+    atomic_fetch_add_explicit( &rec->blocks, 1, memory_order_relaxed );
+    if( count <= 0 )
+        return true;
+    if( (unsigned long)count > rec->capacity - ( head - tail ) )
+    {
+        atomic_fetch_add_explicit( &rec->dropped_blocks, 1, memory_order_relaxed );
+        atomic_fetch_add_explicit( &rec->dropped_frames, count, memory_order_relaxed );
+        return false;
+    }
+
+    start = head & ( rec->capacity - 1 );
+    first = (unsigned long)count < rec->capacity - start ? (unsigned long)count : rec->capacity - start;
+    memcpy( rec->ring + start * rec->channels, frames, first * frame );
+    memcpy( rec->ring, frames + first * rec->channels, ( count - first ) * frame );
+    atomic_store_explicit( &rec->head, head + count, memory_order_release );
+
+    waiting = head + count - tail;
+    if( waiting > atomic_load_explicit( &rec->peak, memory_order_relaxed ) )
+        atomic_store_explicit( &rec->peak, waiting, memory_order_relaxed );
+
+    return true;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: recorder_report()
+// desc: one line: seconds written, dropped blocks and frames, ring peak
+//       fill, and a second line for a write error
+//-----------------------------------------------------------------------------
+void recorder_report( FILE * out, recorder * rec )
+{
+    unsigned long written = atomic_load( &rec->written );
+    unsigned long blocks = atomic_load( &rec->blocks );
+    unsigned long dropped = atomic_load( &rec->dropped_blocks );
+    unsigned long peak = atomic_load( &rec->peak );
+    int error = atomic_load( &rec->error );
+
+    fprintf( out, "Recording %s: %.1f s written, %lu of %lu blocks dropped (%lu frames), "
+             "ring peak %.0f%%\n", rec->path, written / rec->rate, dropped, blocks,
+             atomic_load( &rec->dropped_frames ), 100.0 * peak / rec->capacity );
+    if( error )
+        fprintf( out, "Recording %s: write failed: %s\n", rec->path,
+                 error > 0 ? sf_error_number( error ) : "short write" );
+}
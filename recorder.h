@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// name: recorder.h
+// desc: record the processed output to disk without blocking the callback
+//
+//   the callback copies each block into a single-producer single-consumer
+//   ring (a memcpy and two atomic indexes, never a lock or a syscall); a
+//   writer thread drains it into a libsndfile file in chunks of a quarter
+//   of the ring.  a block that does not fit whole is dropped and counted,
+//   so a disk that cannot keep up leaves gaps in the file rather than
+//   holding up the audio.
+//
+//   the format follows the extension: .wav is 32-bit float, .flac 24-bit,
+//   .raw headerless native float32.
+//-----------------------------------------------------------------------------
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sndfile.h>
+#include "arena.h"
+
+#define RECORDER_SECONDS    4       // ring length, at least 4 blocks
+#define RECORDER_POLL_MS    10      // writer's sleep while under a chunk
+
+typedef struct
+{
+    float * ring;
+    unsigned long capacity;     // frames, a power of 2
+    unsigned long chunk;        // frames per write
+    int channels;
+    double rate;
+    atomic_ulong head;          // frames pushed, written by the callback
+    atomic_ulong tail;          // frames taken, written by the writer
+
+    // counters, readable while recording
+    atomic_ulong blocks;        // blocks pushed
+    atomic_ulong dropped_blocks;
+    atomic_ulong dropped_frames;
+    atomic_ulong peak;          // most frames waiting in the ring
+    atomic_ulong written;       // frames in the file
+    atomic_int error;           // first libsndfile error, 0 if none
+
+    const char * path;
+    SNDFILE * file;
+    pthread_t writer;
+    atomic_bool stopping;
+    arena mem;
+} recorder;
+
+// create path and start the writer for blocks of up to block frames of
+// channels interleaved samples at rate; returns 0 on success
+int  recorder_open( recorder * rec, const char * path, double rate, int channels, long block );
+// write what is left, stop the writer and close the file
+void recorder_close( recorder * rec );
+
+// audio thread: queue frames, or drop them all if they do not fit;
+// returns false if dropped
+bool recorder_push( recorder * rec, const float * frames, long count );
+
+// frames written, dropped blocks and any write error, one line
+void recorder_report( FILE * out, recorder * rec );
+
+#endif
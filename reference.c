@@ -0,0 +1,456 @@
+//-----------------------------------------------------------------------------
+// name: reference.c
+// desc: double-precision reference of the engine_process() chain
+//-----------------------------------------------------------------------------
+#include "reference.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_hanning()
+// desc: hanning() without the rounding to float
+//-----------------------------------------------------------------------------
+void reference_hanning( double * window, long length )
+{
+    long i;
+
+    for( i = 0; i < length; i++ )
+        window[i] = 0.5 * ( 1.0 - cos( 2.0 * M_PI * i / length ) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_cfft()
+// desc: cfft() in double with exact twiddles (same direction and scaling)
+//-----------------------------------------------------------------------------
+static void reference_cfft( double * x, long NC, bool forward )
+{
+    long ND = NC << 1, mmax, delta, m, i, j;
+    double scale;
+
+    // bit reverse, complex pairs
+    for( i = j = 0; i < ND; i += 2 )
+    {
+        if( j > i )
+        {
+            double rtemp = x[j], itemp = x[j+1];
+            x[j] = x[i]; x[j+1] = x[i+1];
+            x[i] = rtemp; x[i+1] = itemp;
+        }
+        for( m = ND >> 1; m >= 2 && j >= m; m >>= 1 )
+            j -= m;
+        j += m;
+    }
+
+    for( mmax = 2; mmax < ND; mmax = delta )
+    {
+        double theta = 2.0 * M_PI / ( forward ? mmax : -mmax );
+        delta = mmax << 1;
+
+        for( m = 0; m < mmax; m += 2 )
+        {
+            double wr = cos( theta * ( m >> 1 ) ), wi = sin( theta * ( m >> 1 ) );
+
+            for( i = m; i < ND; i += delta )
+            {
+                double rtemp, itemp;
+                j = i + mmax;
+                rtemp = wr * x[j] - wi * x[j+1];
+                itemp = wr * x[j+1] + wi * x[j];
+                x[j] = x[i] - rtemp;
+                x[j+1] = x[i+1] - itemp;
+                x[i] += rtemp;
+                x[i+1] += itemp;
+            }
+        }
+    }
+
+    scale = forward ? 1.0 / ND : 2.0;
+    for( i = 0; i < ND; i++ )
+        x[i] *= scale;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_rfft()
+// desc: rfft() in double with exact twiddles (same packing and scaling)
+//-----------------------------------------------------------------------------
+void reference_rfft( double * x, long N, bool forward )
+{
+    double theta = M_PI / N, c1 = 0.5, c2, xr, xi;
+    long i, i1, i2, i3, i4, N2p1 = ( N << 1 ) + 1;
+
+    if( forward )
+    {
+        c2 = -0.5;
+        reference_cfft( x, N, forward );
+        xr = x[0];
+        xi = x[1];
+    }
+    else
+    {
+        c2 = 0.5;
+        theta = -theta;
+        xr = x[1];
+        xi = 0.0;
+        x[1] = 0.0;
+    }
+
+    for( i = 0; i <= N >> 1; i++ )
+    {
+        double wr = cos( theta * i ), wi = sin( theta * i ), h1r, h1i, h2r, h2i;
+
+        i1 = i << 1;
+        i2 = i1 + 1;
+        i3 = N2p1 - i2;
+        i4 = i3 + 1;
+        if( i == 0 )
+        {
+            h1r = c1 * ( x[i1] + xr );
+            h1i = c1 * ( x[i2] - xi );
+            h2r = -c2 * ( x[i2] + xi );
+            h2i = c2 * ( x[i1] - xr );
+            x[i1] = h1r + wr * h2r - wi * h2i;
+            x[i2] = h1i + wr * h2i + wi * h2r;
+            xr = h1r - wr * h2r + wi * h2i;
+            xi = -h1i + wr * h2i + wi * h2r;
+        }
+        else
+        {
+            h1r = c1 * ( x[i1] + x[i3] );
+            h1i = c1 * ( x[i2] - x[i4] );
+            h2r = -c2 * ( x[i2] + x[i4] );
+            h2i = c2 * ( x[i1] - x[i3] );
+            x[i1] = h1r + wr * h2r - wi * h2i;
+            x[i2] = h1i + wr * h2i + wi * h2r;
+            x[i3] = h1r - wr * h2r + wi * h2i;
+            x[i4] = -h1i + wr * h2i + wi * h2r;
+        }
+    }
+
+    if( forward )
+        x[1] = xr;
+    else
+        reference_cfft( x, N, forward );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_to_polar() / reference_to_cartesian()
+// desc: engine_to_polar() / engine_to_cartesian() in double, libm's
+//       atan2, cos and sin
+//-----------------------------------------------------------------------------
+void reference_to_polar( const double * re, const double * im, double * magnitude,
+                         double * phase, long nbins )
+{
+    long j;
+
+    for( j = 0; j < nbins; j++ )
+    {
+        magnitude[j] = sqrt( re[j] * re[j] + im[j] * im[j] );
+        phase[j] = atan2( im[j], re[j] );
+    }
+}
+
+void reference_to_cartesian( const double * magnitude, const double * phase,
+                             double * re, double * im, long nbins )
+{
+    long j;
+
+    for( j = 0; j < nbins; j++ )
+    {
+        re[j] = magnitude[j] * cos( phase[j] );
+        im[j] = magnitude[j] * sin( phase[j] );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_adaptivecurve() / reference_findpeaks()
+// desc: adaptivecurve() and findpeaks() in double
+//-----------------------------------------------------------------------------
+void reference_adaptivecurve( double * adaptivecurve, const double * magnitude,
+                              long window_size, double threshold )
+{
+    long i, k;
+
+    for( i = 0; i < window_size / 4; i += 8 )
+    {
+        double average = 0.0;
+        for( k = 0; k < 8; k++ )
+            average += magnitude[i+k];
+        average /= 8.0;
+        for( k = 0; k < 8; k++ )
+            adaptivecurve[i+k] = ( average + magnitude[i+k] ) / 2 + threshold;
+    }
+}
+
+void reference_findpeaks( const double * magnitude, const double * adaptivecurve,
+                          bool * harmonicsindex, long window_size )
+{
+    long i;
+
+    for( i = 0; i < window_size / 4; i++ )
+        harmonicsindex[i] = adaptivecurve[i] < magnitude[i];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_harmonics()
+// desc: harmonics() in double, quirks included: the increment's
+//       (1-k/WINDOW_SIZE/4) is integer arithmetic, the mirror bin
+//       WINDOW_SIZE/2-k is written too, and non-peak bins are zeroed in
+//       place while later bins are still being read
+//-----------------------------------------------------------------------------
+void reference_harmonics( const bool * curr_harmonicsindex, const bool * prev_harmonicsindex,
+                          double * curr_magnitude, double * prev_magnitude,
+                          long window_size, double harmonic, int order )
+{
+    int W = (int)window_size, j, k;
+
+    for( j = 1; j < W / 4; j++ )
+    {
+        if( curr_harmonicsindex[j] )
+        {
+            for( k = j * order; k < W / 4; k += order * j )
+            {
+                curr_magnitude[k] += ( ( 1 - k / W / 4 ) * harmonic ) / 2;
+                curr_magnitude[W/2-k] += ( ( 1 - k / W / 4 ) * harmonic ) / 2;
+            }
+        }
+        else
+            curr_magnitude[j] = 0.0;
+
+        if( prev_harmonicsindex[j] )
+        {
+            for( k = j * order; k < W / 4; k += order * j )
+            {
+                prev_magnitude[k] += ( ( 1 - k / W / 4 ) * harmonic ) / 2;
+                prev_magnitude[W/2-k] += ( ( 1 - k / W / 4 ) * harmonic ) / 2;
+            }
+        }
+        else
+            prev_magnitude[j] = 0.0;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_create()
+// desc: calloc every buffer, the hanning window filled in; -1 if out of
+//       memory, with nothing left allocated
+//-----------------------------------------------------------------------------
+int reference_create( reference_engine * r, long window_size )
+{
+    const long W = window_size, nbins = W / 2;
+    double ** buffers[] = { &r->window, &r->frame, &r->curr_win, &r->prev_win, &r->prev_out };
+    double ** spectra[] = { &r->curr_re, &r->curr_im, &r->curr_magnitude, &r->curr_phase,
+                            &r->prev_re, &r->prev_im, &r->prev_magnitude, &r->prev_phase,
+                            &r->curr_adaptivecurve, &r->prev_adaptivecurve };
+    unsigned int i;
+
+    memset( r, 0, sizeof(*r) );
+    r->window_size = W;
+    r->hop_size = W / 2;
+    r->nbins = nbins;
+
+    for( i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++ )
+        if( !( *buffers[i] = (double *)calloc( W, sizeof(double) ) ) )
+            goto fail;
+    for( i = 0; i < sizeof(spectra) / sizeof(spectra[0]); i++ )
+        if( !( *spectra[i] = (double *)calloc( nbins, sizeof(double) ) ) )
+            goto fail;
+    r->curr_harmonicsindex = (bool *)calloc( nbins, sizeof(bool) );
+    r->prev_harmonicsindex = (bool *)calloc( nbins, sizeof(bool) );
+    if( !r->curr_harmonicsindex || !r->prev_harmonicsindex )
+        goto fail;
+
+    reference_hanning( r->window, W );
+
+    return 0;
+
+fail:
+    reference_destroy( r );
+    return -1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_destroy()
+// desc: free every buffer; safe on a partly created reference
+//-----------------------------------------------------------------------------
+void reference_destroy( reference_engine * r )
+{
+    free( r->window ); free( r->frame );
+    free( r->curr_win ); free( r->prev_win ); free( r->prev_out );
+    free( r->curr_re ); free( r->curr_im ); free( r->curr_magnitude ); free( r->curr_phase );
+    free( r->prev_re ); free( r->prev_im ); free( r->prev_magnitude ); free( r->prev_phase );
+    free( r->curr_adaptivecurve ); free( r->prev_adaptivecurve );
+    free( r->curr_harmonicsindex ); free( r->prev_harmonicsindex );
+    memset( r, 0, sizeof(*r) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: forward() / inverse()
+// desc: between 2*nbins reals and planar bins through the CARL packing
+//-----------------------------------------------------------------------------
+static void forward( reference_engine * r, const double * x, const double * window,
+                     double * re, double * im )
+{
+    long j;
+
+    for( j = 0; j < r->window_size; j++ )
+        r->frame[j] = window ? x[j] * window[j] : x[j];
+    reference_rfft( r->frame, r->nbins, true );
+    for( j = 0; j < r->nbins; j++ )
+    {
+        re[j] = r->frame[2*j];
+        im[j] = r->frame[2*j+1];
+    }
+}
+
+static void inverse( reference_engine * r, const double * re, const double * im, double * x )
+{
+    long j;
+
+    for( j = 0; j < r->nbins; j++ )
+    {
+        r->frame[2*j] = re[j];
+        r->frame[2*j+1] = im[j];
+    }
+    reference_rfft( r->frame, r->nbins, false );
+    memcpy( x, r->frame, r->window_size * sizeof(double) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: settle_ties()
+// desc: take the engine's decision where ours is a near-tie, and its phase
+//       where the bin is below the floor
+//-----------------------------------------------------------------------------
+static void settle_ties( reference_engine * r, const double * magnitude, const double * adaptivecurve,
+                         bool * harmonicsindex, double * phase, const bool * match_harmonicsindex,
+                         const float * match_phase )
+{
+    double level = 0.0;
+    long i;
+
+    for( i = 0; i < r->nbins; i++ )
+        level = magnitude[i] > level ? magnitude[i] : level;
+    level *= r->tie_floor;
+
+    for( i = 0; i < r->nbins; i++ )
+    {
+        bool quiet = magnitude[i] < level;
+
+        if( quiet )
+            phase[i] = match_phase[i];
+        if( i >= r->window_size / 4 ||
+            ( !quiet && fabs( magnitude[i] - adaptivecurve[i] ) > magnitude[i] * r->tie_tolerance ) )
+            continue;
+        r->ties += harmonicsindex[i] != match_harmonicsindex[i];
+        harmonicsindex[i] = match_harmonicsindex[i];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: reference_process()
+// desc: engine_process(), hop for hop
+//-----------------------------------------------------------------------------
+void reference_process( reference_engine * r, const engine_params * params,
+                        const double * in, double * out, long frames )
+{
+    const long W = r->window_size, hop = r->hop_size, nbins = r->nbins;
+    long i, j;
+
+    for( i = 0; i < frames; i += hop )
+    {
+        double * swap;
+
+        if( !r->primed )
+        {
+            r->second = params->second;
+            r->third = params->third;
+            r->fifth = params->fifth;
+            r->threshold = params->threshold;
+            r->primed = true;
+        }
+        else
+        {
+            r->second += ( params->second - r->second ) * ENGINE_GAIN_SMOOTHING;
+            r->third += ( params->third - r->third ) * ENGINE_GAIN_SMOOTHING;
+            r->fifth += ( params->fifth - r->fifth ) * ENGINE_GAIN_SMOOTHING;
+            r->threshold += ( params->threshold - r->threshold ) * ENGINE_GAIN_SMOOTHING;
+        }
+        r->toggle = params->toggle;
+
+        forward( r, in + i, r->window, r->curr_re, r->curr_im );
+        forward( r, r->prev_win, NULL, r->prev_re, r->prev_im );
+
+        reference_to_polar( r->curr_re, r->curr_im, r->curr_magnitude, r->curr_phase, nbins );
+        reference_to_polar( r->prev_re, r->prev_im, r->prev_magnitude, r->prev_phase, nbins );
+
+        if( r->toggle )
+        {
+            reference_adaptivecurve( r->curr_adaptivecurve, r->curr_magnitude, W, r->threshold );
+            reference_adaptivecurve( r->prev_adaptivecurve, r->prev_magnitude, W, r->threshold );
+
+            reference_findpeaks( r->curr_magnitude, r->curr_adaptivecurve, r->curr_harmonicsindex, W );
+            reference_findpeaks( r->prev_magnitude, r->prev_adaptivecurve, r->prev_harmonicsindex, W );
+
+            if( r->match )
+            {
+                settle_ties( r, r->curr_magnitude, r->curr_adaptivecurve, r->curr_harmonicsindex,
+                             r->curr_phase, r->match->curr_harmonicsindex, r->match->curr_phase );
+                settle_ties( r, r->prev_magnitude, r->prev_adaptivecurve, r->prev_harmonicsindex,
+                             r->prev_phase, r->match->prev_harmonicsindex, r->match->prev_phase );
+            }
+
+            reference_harmonics( r->curr_harmonicsindex, r->prev_harmonicsindex, r->curr_magnitude,
+                                 r->prev_magnitude, W, r->second, 2 );
+            reference_harmonics( r->curr_harmonicsindex, r->prev_harmonicsindex, r->curr_magnitude,
+                                 r->prev_magnitude, W, r->third, 3 );
+            reference_harmonics( r->curr_harmonicsindex, r->prev_harmonicsindex, r->curr_magnitude,
+                                 r->prev_magnitude, W, r->fifth, 5 );
+        }
+
+        reference_to_cartesian( r->curr_magnitude, r->curr_phase, r->curr_re, r->curr_im, nbins );
+        reference_to_cartesian( r->prev_magnitude, r->prev_phase, r->prev_re, r->prev_im, nbins );
+
+        inverse( r, r->curr_re, r->curr_im, r->curr_win );
+        inverse( r, r->prev_re, r->prev_im, r->prev_out );
+
+        for( j = 0; j < hop; j++ )
+            out[i+j] = r->prev_out[j+hop] + r->curr_win[j];
+
+        swap = r->prev_win;
+        r->prev_win = r->curr_win;
+        r->curr_win = swap;
+    }
+}
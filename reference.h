@@ -0,0 +1,75 @@
+//-----------------------------------------------------------------------------
+// name: reference.h
+// desc: double-precision reference of the engine_process() chain
+//
+//   the same STFT chain, stage for stage, as engine.c and fft.c: hanning
+//   window, CARL-packed real fft (bin 0's imaginary part holds the Nyquist
+//   value), polar, adaptive curve, peaks, harmonics (with their exact
+//   integer quirks), cartesian, inverse and overlap-add.  everything is
+//   double, the fft twiddles come straight from cos()/sin() instead of a
+//   recurrence, and the transcendentals are libm's double ones.  it is
+//   the yardstick fast paths are measured against; it is not realtime
+//   safe and not meant to be.
+//-----------------------------------------------------------------------------
+#ifndef __REFERENCE_H__
+#define __REFERENCE_H__
+
+#include <stdbool.h>
+#include "engine.h"
+
+typedef struct
+{
+    long window_size;
+    long hop_size;
+    long nbins;             // window_size / 2
+
+    double * window;
+    double * frame;         // interleaved CARL spectrum / time scratch
+
+    double * curr_re, * curr_im, * curr_magnitude, * curr_phase;
+    double * prev_re, * prev_im, * prev_magnitude, * prev_phase;
+    double * curr_win, * prev_win, * prev_out;
+    double * curr_adaptivecurve, * prev_adaptivecurve;
+    bool * curr_harmonicsindex, * prev_harmonicsindex;
+
+    // smoothed gains and threshold, as harmonic_engine.smoothed
+    double second, third, fifth, threshold;
+    bool toggle;
+    bool primed;
+
+    // if set, where this chain's input carries no information the engine's
+    // choices for the same hop are taken instead, so comparing the two is
+    // not swamped by noise: peak decisions within tie_tolerance (relative)
+    // of the curve, and the phase of bins below tie_floor of the frame
+    // peak (rounding noise, which the harmonics then add onto).  frames
+    // must be one hop per call, after the engine's
+    const harmonic_engine * match;
+    double tie_tolerance, tie_floor;
+    long ties;              // tied decisions that went the other way
+} reference_engine;
+
+// returns 0 on success
+int  reference_create( reference_engine * r, long window_size );
+void reference_destroy( reference_engine * r );
+
+// engine_process() in double: in must hold frames + hop_size samples
+void reference_process( reference_engine * r, const engine_params * params,
+                        const double * in, double * out, long frames );
+
+// the stages on their own, same layouts and scaling as the fast kernels
+void reference_hanning( double * window, long length );
+// x holds 2*N reals or N CARL-packed bins
+void reference_rfft( double * x, long N, bool forward );
+void reference_to_polar( const double * re, const double * im, double * magnitude,
+                         double * phase, long nbins );
+void reference_to_cartesian( const double * magnitude, const double * phase,
+                             double * re, double * im, long nbins );
+void reference_adaptivecurve( double * adaptivecurve, const double * magnitude,
+                              long window_size, double threshold );
+void reference_findpeaks( const double * magnitude, const double * adaptivecurve,
+                          bool * harmonicsindex, long window_size );
+void reference_harmonics( const bool * curr_harmonicsindex, const bool * prev_harmonicsindex,
+                          double * curr_magnitude, double * prev_magnitude,
+                          long window_size, double harmonic, int order );
+
+#endif
@@ -0,0 +1,552 @@
+//-----------------------------------------------------------------------------
+// name: rtcheck.c
+// desc: realtime-safety checker - flags allocations, locks and blocking
+//       syscalls made from the audio thread
+//
+//   LD_PRELOAD library, see rtcheck.h:
+//     gcc -O2 -std=gnu99 -shared -fPIC -o librtcheck.so rtcheck.c -ldl -lpthread
+//
+//   the allocator is forwarded to glibc's __libc_* entry points (dlsym
+//   allocates, so it cannot resolve malloc), everything else to the next
+//   definition through dlsym( RTLD_NEXT ).  a call is only checked on a
+//   marked thread, and never while the checker is recording one.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+
+// the markers are defined here, so no weak declarations
+#undef HARMONICS_RTCHECK
+#include "rtcheck.h"
+
+#define EXPORT              __attribute__(( visibility( "default" ) ))
+#define MARKED              __attribute__(( tls_model( "initial-exec" ) ))
+
+// the next definition of name, looked up once
+#define REAL( name )        ({ if( !real_##name ) \
+                                   real_##name = (__typeof__( real_##name ))dlsym( RTLD_NEXT, #name ); \
+                               real_##name; })
+#define DECLARE( name )     static __typeof__( name ) * real_##name
+
+// glibc's own allocator
+extern void * __libc_malloc( size_t bytes );
+extern void * __libc_calloc( size_t count, size_t bytes );
+extern void * __libc_realloc( void * p, size_t bytes );
+extern void * __libc_memalign( size_t alignment, size_t bytes );
+extern void   __libc_free( void * p );
+
+// one place a forbidden call is made from
+typedef struct
+{
+    const char * call;
+    int depth;
+    void * frames[RTCHECK_DEPTH];
+    unsigned long count;
+} rtcheck_site;
+
+static rtcheck_site g_sites[RTCHECK_MAX_SITES];
+static int g_site_count = 0;
+static unsigned long g_calls = 0;       // forbidden calls in all
+static unsigned long g_unkept = 0;      // of them, from sites past the table
+static volatile int g_lock = 0;
+static bool g_abort = false;
+
+static __thread int t_marked MARKED = 0;    // RTCHECK_ENTER() depth
+static __thread int t_inside MARKED = 0;    // recording a call
+
+DECLARE( pthread_mutex_lock );
+DECLARE( pthread_cond_wait );
+DECLARE( pthread_cond_timedwait );
+DECLARE( pthread_rwlock_rdlock );
+DECLARE( pthread_rwlock_wrlock );
+DECLARE( pthread_barrier_wait );
+DECLARE( pthread_join );
+DECLARE( sem_wait );
+DECLARE( sem_timedwait );
+DECLARE( read );
+DECLARE( write );
+DECLARE( pread );
+DECLARE( pwrite );
+DECLARE( open );
+DECLARE( openat );
+DECLARE( close );
+DECLARE( lseek );
+DECLARE( fsync );
+DECLARE( fopen );
+DECLARE( fclose );
+DECLARE( fread );
+DECLARE( fwrite );
+DECLARE( fseek );
+DECLARE( fflush );
+DECLARE( vprintf );
+DECLARE( vfprintf );
+DECLARE( puts );
+DECLARE( nanosleep );
+DECLARE( clock_nanosleep );
+DECLARE( usleep );
+DECLARE( sleep );
+DECLARE( poll );
+DECLARE( select );
+DECLARE( mmap );
+DECLARE( munmap );
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: print_site()
+// desc: one site of the report, frames after the interposer
+//-----------------------------------------------------------------------------
+static void print_site( int fd, const rtcheck_site * site )
+{
+    dprintf( fd, "  %s, %lu call%s\n", site->call, site->count, site->count == 1 ? "" : "s" );
+    backtrace_symbols_fd( (void * const *)site->frames, site->depth, fd );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: record()
+// desc: count a forbidden call under its call site
+//-----------------------------------------------------------------------------
+static void record( const char * call )
+{
+    void * frames[RTCHECK_DEPTH + 2];
+    rtcheck_site * site = NULL;
+    int depth, i;
+
+    t_inside = 1;
+
+    // drop record() and the interposer
+    depth = backtrace( frames, RTCHECK_DEPTH + 2 ) - 2;
+    if( depth < 0 )
+        depth = 0;
+
+    while( __atomic_exchange_n( &g_lock, 1, __ATOMIC_ACQUIRE ) )
+        ;
+
+    g_calls++;
+    for( i = 0; i < g_site_count && !site; i++ )
+        if( g_sites[i].call == call && g_sites[i].depth == depth &&
+            !memcmp( g_sites[i].frames, frames + 2, depth * sizeof(void *) ) )
+            site = &g_sites[i];
+    if( !site && g_site_count < RTCHECK_MAX_SITES )
+    {
+        site = &g_sites[g_site_count++];
+        site->call = call;
+        site->depth = depth;
+        memcpy( site->frames, frames + 2, depth * sizeof(void *) );
+    }
+    if( site )
+        site->count++;
+    else
+        g_unkept++;
+
+    __atomic_store_n( &g_lock, 0, __ATOMIC_RELEASE );
+
+    if( g_abort )
+    {
+        dprintf( STDERR_FILENO, "rtcheck: %s on a realtime thread\n", call );
+        if( site )
+            print_site( STDERR_FILENO, site );
+        abort( );
+    }
+
+    t_inside = 0;
+}
+
+// checked on a marked thread only
+#define CHECK( call )       do { if( t_marked && !t_inside ) record( call ); } while( 0 )
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: rtcheck_init()
+// desc: load backtrace()'s unwinder now, not from the first record()
+//-----------------------------------------------------------------------------
+__attribute__(( constructor ))
+static void rtcheck_init( void )
+{
+    void * frames[2];
+    const char * env = getenv( "RTCHECK_ABORT" );
+
+    g_abort = env && *env && strcmp( env, "0" ) != 0;
+    backtrace( frames, 2 );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: rtcheck_report()
+// desc: every site at exit
+//-----------------------------------------------------------------------------
+__attribute__(( destructor ))
+static void rtcheck_report( void )
+{
+    const char * path = getenv( "RTCHECK_LOG" );
+    int fd = STDERR_FILENO;
+    int i;
+
+    if( path && *path )
+    {
+        fd = REAL( open )( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if( fd < 0 )
+            fd = STDERR_FILENO;
+    }
+
+    if( !g_calls )
+        dprintf( fd, "rtcheck: no calls that are not realtime-safe on marked threads\n" );
+    else
+    {
+        dprintf( fd, "rtcheck: %lu call%s that %s not realtime-safe on marked threads, from %d site%s%s\n",
+                g_calls, g_calls == 1 ? "" : "s", g_calls == 1 ? "is" : "are",
+                g_site_count, g_site_count == 1 ? "" : "s", g_unkept ? " (and more not kept)" : "" );
+        for( i = 0; i < g_site_count; i++ )
+            print_site( fd, &g_sites[i] );
+    }
+
+    if( fd != STDERR_FILENO )
+        REAL( close )( fd );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: rtcheck_enter() / rtcheck_leave() / rtcheck_violations()
+// desc: the markers, see rtcheck.h
+//-----------------------------------------------------------------------------
+EXPORT void rtcheck_enter( void ) { t_marked++; }
+EXPORT void rtcheck_leave( void ) { if( t_marked > 0 ) t_marked--; }
+EXPORT unsigned long rtcheck_violations( void ) { return __atomic_load_n( &g_calls, __ATOMIC_RELAXED ); }
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: malloc() etc.
+// desc: the allocator
+//-----------------------------------------------------------------------------
+EXPORT void * malloc( size_t bytes )
+{
+    CHECK( "malloc" );
+    return __libc_malloc( bytes );
+}
+
+EXPORT void * calloc( size_t count, size_t bytes )
+{
+    CHECK( "calloc" );
+    return __libc_calloc( count, bytes );
+}
+
+EXPORT void * realloc( void * p, size_t bytes )
+{
+    CHECK( "realloc" );
+    return __libc_realloc( p, bytes );
+}
+
+EXPORT void free( void * p )
+{
+    if( p )
+        CHECK( "free" );
+    __libc_free( p );
+}
+
+EXPORT int posix_memalign( void ** p, size_t alignment, size_t bytes )
+{
+    CHECK( "posix_memalign" );
+    if( alignment % sizeof(void *) || ( alignment & ( alignment - 1 ) ) )
+        return EINVAL;
+    *p = __libc_memalign( alignment, bytes );
+    return *p ? 0 : ENOMEM;
+}
+
+EXPORT void * aligned_alloc( size_t alignment, size_t bytes )
+{
+    CHECK( "aligned_alloc" );
+    return __libc_memalign( alignment, bytes );
+}
+
+EXPORT void * memalign( size_t alignment, size_t bytes )
+{
+    CHECK( "memalign" );
+    return __libc_memalign( alignment, bytes );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: pthread_mutex_lock() etc.
+// desc: waits on other threads (trylock and unlock are fine)
+//-----------------------------------------------------------------------------
+EXPORT int pthread_mutex_lock( pthread_mutex_t * m )
+{
+    CHECK( "pthread_mutex_lock" );
+    return REAL( pthread_mutex_lock )( m );
+}
+
+EXPORT int pthread_cond_wait( pthread_cond_t * c, pthread_mutex_t * m )
+{
+    CHECK( "pthread_cond_wait" );
+    return REAL( pthread_cond_wait )( c, m );
+}
+
+EXPORT int pthread_cond_timedwait( pthread_cond_t * c, pthread_mutex_t * m, const struct timespec * t )
+{
+    CHECK( "pthread_cond_timedwait" );
+    return REAL( pthread_cond_timedwait )( c, m, t );
+}
+
+EXPORT int pthread_rwlock_rdlock( pthread_rwlock_t * l )
+{
+    CHECK( "pthread_rwlock_rdlock" );
+    return REAL( pthread_rwlock_rdlock )( l );
+}
+
+EXPORT int pthread_rwlock_wrlock( pthread_rwlock_t * l )
+{
+    CHECK( "pthread_rwlock_wrlock" );
+    return REAL( pthread_rwlock_wrlock )( l );
+}
+
+EXPORT int pthread_barrier_wait( pthread_barrier_t * b )
+{
+    CHECK( "pthread_barrier_wait" );
+    return REAL( pthread_barrier_wait )( b );
+}
+
+EXPORT int pthread_join( pthread_t thread, void ** result )
+{
+    CHECK( "pthread_join" );
+    return REAL( pthread_join )( thread, result );
+}
+
+EXPORT int sem_wait( sem_t * s )
+{
+    CHECK( "sem_wait" );
+    return REAL( sem_wait )( s );
+}
+
+EXPORT int sem_timedwait( sem_t * s, const struct timespec * t )
+{
+    CHECK( "sem_timedwait" );
+    return REAL( sem_timedwait )( s, t );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: read() etc.
+// desc: files and stdio
+//-----------------------------------------------------------------------------
+EXPORT ssize_t read( int fd, void * buffer, size_t bytes )
+{
+    CHECK( "read" );
+    return REAL( read )( fd, buffer, bytes );
+}
+
+EXPORT ssize_t write( int fd, const void * buffer, size_t bytes )
+{
+    CHECK( "write" );
+    return REAL( write )( fd, buffer, bytes );
+}
+
+EXPORT ssize_t pread( int fd, void * buffer, size_t bytes, off_t offset )
+{
+    CHECK( "pread" );
+    return REAL( pread )( fd, buffer, bytes, offset );
+}
+
+EXPORT ssize_t pwrite( int fd, const void * buffer, size_t bytes, off_t offset )
+{
+    CHECK( "pwrite" );
+    return REAL( pwrite )( fd, buffer, bytes, offset );
+}
+
+EXPORT int open( const char * path, int flags, ... )
+{
+    mode_t mode = 0;
+
+    CHECK( "open" );
+    if( flags & ( O_CREAT | O_TMPFILE ) )
+    {
+        va_list args;
+        va_start( args, flags );
+        mode = va_arg( args, mode_t );
+        va_end( args );
+    }
+    return REAL( open )( path, flags, mode );
+}
+
+EXPORT int openat( int dir, const char * path, int flags, ... )
+{
+    mode_t mode = 0;
+
+    CHECK( "openat" );
+    if( flags & ( O_CREAT | O_TMPFILE ) )
+    {
+        va_list args;
+        va_start( args, flags );
+        mode = va_arg( args, mode_t );
+        va_end( args );
+    }
+    return REAL( openat )( dir, path, flags, mode );
+}
+
+EXPORT int close( int fd )
+{
+    CHECK( "close" );
+    return REAL( close )( fd );
+}
+
+EXPORT off_t lseek( int fd, off_t offset, int whence )
+{
+    CHECK( "lseek" );
+    return REAL( lseek )( fd, offset, whence );
+}
+
+EXPORT int fsync( int fd )
+{
+    CHECK( "fsync" );
+    return REAL( fsync )( fd );
+}
+
+EXPORT FILE * fopen( const char * path, const char * mode )
+{
+    CHECK( "fopen" );
+    return REAL( fopen )( path, mode );
+}
+
+EXPORT int fclose( FILE * f )
+{
+    CHECK( "fclose" );
+    return REAL( fclose )( f );
+}
+
+EXPORT size_t fread( void * buffer, size_t size, size_t count, FILE * f )
+{
+    CHECK( "fread" );
+    return REAL( fread )( buffer, size, count, f );
+}
+
+EXPORT size_t fwrite( const void * buffer, size_t size, size_t count, FILE * f )
+{
+    CHECK( "fwrite" );
+    return REAL( fwrite )( buffer, size, count, f );
+}
+
+EXPORT int fseek( FILE * f, long offset, int whence )
+{
+    CHECK( "fseek" );
+    return REAL( fseek )( f, offset, whence );
+}
+
+EXPORT int fflush( FILE * f )
+{
+    CHECK( "fflush" );
+    return REAL( fflush )( f );
+}
+
+EXPORT int printf( const char * format, ... )
+{
+    va_list args;
+    int n;
+
+    CHECK( "printf" );
+    va_start( args, format );
+    n = REAL( vprintf )( format, args );
+    va_end( args );
+    return n;
+}
+
+EXPORT int fprintf( FILE * f, const char * format, ... )
+{
+    va_list args;
+    int n;
+
+    CHECK( "fprintf" );
+    va_start( args, format );
+    n = REAL( vfprintf )( f, format, args );
+    va_end( args );
+    return n;
+}
+
+EXPORT int puts( const char * s )
+{
+    CHECK( "puts" );
+    return REAL( puts )( s );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: nanosleep() etc.
+// desc: sleeps, waits on descriptors, mappings
+//-----------------------------------------------------------------------------
+EXPORT int nanosleep( const struct timespec * t, struct timespec * left )
+{
+    CHECK( "nanosleep" );
+    return REAL( nanosleep )( t, left );
+}
+
+EXPORT int clock_nanosleep( clockid_t clock, int flags, const struct timespec * t, struct timespec * left )
+{
+    CHECK( "clock_nanosleep" );
+    return REAL( clock_nanosleep )( clock, flags, t, left );
+}
+
+EXPORT int usleep( useconds_t us )
+{
+    CHECK( "usleep" );
+    return REAL( usleep )( us );
+}
+
+EXPORT unsigned int sleep( unsigned int s )
+{
+    CHECK( "sleep" );
+    return REAL( sleep )( s );
+}
+
+EXPORT int poll( struct pollfd * fds, nfds_t count, int timeout )
+{
+    CHECK( "poll" );
+    return REAL( poll )( fds, count, timeout );
+}
+
+EXPORT int select( int count, fd_set * r, fd_set * w, fd_set * e, struct timeval * timeout )
+{
+    CHECK( "select" );
+    return REAL( select )( count, r, w, e, timeout );
+}
+
+EXPORT void * mmap( void * address, size_t bytes, int protection, int flags, int fd, off_t offset )
+{
+    CHECK( "mmap" );
+    return REAL( mmap )( address, bytes, protection, flags, fd, offset );
+}
+
+EXPORT int munmap( void * address, size_t bytes )
+{
+    CHECK( "munmap" );
+    return REAL( munmap )( address, bytes );
+}
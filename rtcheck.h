@@ -0,0 +1,53 @@
+//-----------------------------------------------------------------------------
+// name: rtcheck.h
+// desc: realtime-safety checker - flags allocations, locks and blocking
+//       syscalls made from the audio thread (-DHARMONICS_RTCHECK builds)
+//
+//   rtcheck.c builds into a library preloaded into the player or the
+//   callback harness.  it interposes the allocator, the pthread and
+//   semaphore waits, file and stdio calls and sleeps; a call made while
+//   the calling thread is marked (between RTCHECK_ENTER() and
+//   RTCHECK_LEAVE(), around the callback's body) is counted by call site,
+//   backtrace included, and reported when the process exits.  with
+//   RTCHECK_ABORT=1 the first one aborts instead (for a debugger), and
+//   RTCHECK_LOG=path writes the report there rather than to stderr.
+//
+//   the markers are weak references, so a -DHARMONICS_RTCHECK build runs
+//   as usual without the library; without HARMONICS_RTCHECK they expand to
+//   nothing.  it sees calls through the dynamic linker only: the stack, and
+//   what libc does internally, are not checked.
+//
+//   build and run:
+//     gcc -O2 -std=gnu99 -shared -fPIC -o librtcheck.so rtcheck.c -ldl -lpthread
+//     build the program with -DHARMONICS_RTCHECK (and -rdynamic for
+//     symbol names in the backtraces), then
+//     LD_PRELOAD=./librtcheck.so ./callbackbench ...
+//-----------------------------------------------------------------------------
+#ifndef __RTCHECK_H__
+#define __RTCHECK_H__
+
+#define RTCHECK_MAX_SITES   64      // distinct call sites kept
+#define RTCHECK_DEPTH       16      // backtrace frames per site
+
+#ifdef HARMONICS_RTCHECK
+
+// defined by the preloaded library only
+void rtcheck_enter( void ) __attribute__(( weak ));
+void rtcheck_leave( void ) __attribute__(( weak ));
+unsigned long rtcheck_violations( void ) __attribute__(( weak ));
+
+#define RTCHECK_ENTER( )            do { if( rtcheck_enter ) rtcheck_enter( ); } while( 0 )
+#define RTCHECK_LEAVE( )            do { if( rtcheck_leave ) rtcheck_leave( ); } while( 0 )
+#define RTCHECK_LOADED( )           ( rtcheck_violations != 0 )
+#define RTCHECK_VIOLATIONS( )       ( rtcheck_violations ? rtcheck_violations( ) : 0UL )
+
+#else
+
+#define RTCHECK_ENTER( )            ( (void)0 )
+#define RTCHECK_LEAVE( )            ( (void)0 )
+#define RTCHECK_LOADED( )           ( 0 )
+#define RTCHECK_VIOLATIONS( )       ( 0UL )
+
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+//-----------------------------------------------------------------------------
+// name: snapshot.c
+// desc: triple-buffered snapshots from the audio callback to the renderer
+//-----------------------------------------------------------------------------
+#include "snapshot.h"
+#include <string.h>
+
+#define SNAPSHOT_INDEX      3u
+#define SNAPSHOT_FRESH      4u
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: viz_channel_create()
+// desc: three frames carved from one arena
+//-----------------------------------------------------------------------------
+int viz_channel_create( viz_channel * ch, long frames, long bins, long columns )
+{
+    size_t bytes = 3 * ( 2 * ARENA_ROUND( frames * sizeof(float) ) +
+                         2 * ARENA_ROUND( bins * sizeof(float) ) +
+                         2 * ARENA_ROUND( columns * bins * sizeof(float) ) +
+                         ARENA_ROUND( columns * bins * sizeof(bool) ) );
+    int i;
+
+    if( arena_create( &ch->mem, bytes, false ) != 0 )
+        return -1;
+
+    for( i = 0; i < 3; i++ )
+    {
+        viz_frame * f = &ch->frame[i];
+        f->sequence = 0;
+        f->frames = 0;
+        f->bins = 0;
+        f->input = (float *)arena_alloc( &ch->mem, frames * sizeof(float) );
+        f->output = (float *)arena_alloc( &ch->mem, frames * sizeof(float) );
+        f->magnitude = (float *)arena_alloc( &ch->mem, bins * sizeof(float) );
+        f->adaptivecurve = (float *)arena_alloc( &ch->mem, bins * sizeof(float) );
+        f->columns = 0;
+        f->column_input = (float *)arena_alloc( &ch->mem, columns * bins * sizeof(float) );
+        f->column_output = (float *)arena_alloc( &ch->mem, columns * bins * sizeof(float) );
+        f->column_peaks = (bool *)arena_alloc( &ch->mem, columns * bins * sizeof(bool) );
+    }
+
+    ch->frames = frames;
+    ch->bins = bins;
+    ch->columns = columns;
+    ch->front = 0;
+    ch->back = 1;
+    ch->sequence = 0;
+    atomic_init( &ch->middle, 2 );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: viz_channel_destroy()
+// desc: free the three frames; neither side may use the channel after
+//-----------------------------------------------------------------------------
+void viz_channel_destroy( viz_channel * ch )
+{
+    arena_destroy( &ch->mem );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: viz_channel_back() / viz_channel_publish()
+// desc: producer side
+//-----------------------------------------------------------------------------
+viz_frame * viz_channel_back( viz_channel * ch )
+{
+    return &ch->frame[ch->back];
+}
+
+void viz_channel_publish( viz_channel * ch )
+{
+    ch->frame[ch->back].sequence = ++ch->sequence;
+
+    // our frame becomes the shared one; take back whatever was there
+    ch->back = atomic_exchange_explicit( &ch->middle, ch->back | SNAPSHOT_FRESH,
+                                         memory_order_acq_rel ) & SNAPSHOT_INDEX;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: viz_channel_fill()
+// desc: the low quarter of the spectrum, as the views show it
+//-----------------------------------------------------------------------------
+void viz_channel_fill( viz_channel * ch, const harmonic_engine * e,
+                       const float * out, long frames )
+{
+    viz_frame * f = &ch->frame[ch->back];
+    long bins = e->nbins / 2;
+
+    f->frames = frames < ch->frames ? frames : ch->frames;
+    f->bins = bins < ch->bins ? bins : ch->bins;
+    f->columns = e->columns < ch->columns ? e->columns : ch->columns;
+
+    memcpy( f->input, e->input, f->frames * sizeof(float) );
+    memcpy( f->output, out, f->frames * sizeof(float) );
+    memcpy( f->magnitude, e->pre_magnitude, f->bins * sizeof(float) );
+    memcpy( f->adaptivecurve, e->curr_adaptivecurve, f->bins * sizeof(float) );
+
+    // columns are packed at the frame's bin count
+    {
+        long c;
+        for( c = 0; c < f->columns; c++ )
+        {
+            memcpy( f->column_input + c * f->bins, e->column_input + c * bins, f->bins * sizeof(float) );
+            memcpy( f->column_output + c * f->bins, e->column_output + c * bins, f->bins * sizeof(float) );
+            memcpy( f->column_peaks + c * f->bins, e->column_peaks + c * bins, f->bins * sizeof(bool) );
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: viz_channel_acquire() / viz_channel_pending()
+// desc: consumer side
+//-----------------------------------------------------------------------------
+bool viz_channel_acquire( viz_channel * ch, const viz_frame ** frame )
+{
+    bool fresh = false;
+
+    if( atomic_load_explicit( &ch->middle, memory_order_relaxed ) & SNAPSHOT_FRESH )
+    {
+        ch->front = atomic_exchange_explicit( &ch->middle, ch->front,
+                                              memory_order_acq_rel ) & SNAPSHOT_INDEX;
+        fresh = true;
+    }
+
+    *frame = &ch->frame[ch->front];
+    return fresh;
+}
+
+bool viz_channel_pending( viz_channel * ch )
+{
+    return ( atomic_load_explicit( &ch->middle, memory_order_relaxed ) & SNAPSHOT_FRESH ) != 0;
+}
@@ -0,0 +1,65 @@
+//-----------------------------------------------------------------------------
+// name: snapshot.h
+// desc: triple-buffered snapshots from the audio callback to the renderer
+//
+//   the callback fills its private back frame and publishes it with one
+//   atomic exchange; the renderer swaps in the newest published frame with
+//   another.  neither side ever waits, and a frame is never written while
+//   the renderer holds it.  one producer, one consumer.
+//-----------------------------------------------------------------------------
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "arena.h"
+#include "engine.h"
+
+// what the views need from one processed block
+typedef struct
+{
+    unsigned long sequence; // block number, counted by the producer
+    long frames;            // valid samples in input/output
+    long bins;              // valid bins in magnitude/adaptivecurve
+    float * input;          // time domain before processing
+    float * output;         // time domain after processing
+    float * magnitude;      // input magnitude spectrum, low quarter
+    float * adaptivecurve;  // adaptive curve over the same bins
+    long columns;           // valid columns below, one per hop
+    float * column_input;   // per hop: magnitude before processing,
+    float * column_output;  //   after processing, and the peaks found;
+    bool * column_peaks;    //   bins values each
+} viz_frame;
+
+typedef struct
+{
+    viz_frame frame[3];
+    atomic_uint middle;     // index of the shared frame, plus a fresh bit
+    unsigned int back;      // producer's frame
+    unsigned int front;     // consumer's frame
+    unsigned long sequence;
+    long frames, bins, columns;     // capacity of each frame
+    arena mem;
+} viz_channel;
+
+// room for frames samples, bins bins and columns spectrogram columns per
+// frame; returns 0 on success
+int  viz_channel_create( viz_channel * ch, long frames, long bins, long columns );
+void viz_channel_destroy( viz_channel * ch );
+
+// producer: the frame to fill, then hand it over
+viz_frame * viz_channel_back( viz_channel * ch );
+void viz_channel_publish( viz_channel * ch );
+// producer: fill the back frame from the engine's last block and its output,
+// clipped to the channel's capacity
+void viz_channel_fill( viz_channel * ch, const harmonic_engine * e,
+                       const float * out, long frames );
+
+// consumer: newest frame; returns true if it was published since the last
+// call (otherwise *frame is the one already held)
+bool viz_channel_acquire( viz_channel * ch, const viz_frame ** frame );
+
+// consumer: true if acquire would return a fresh frame; takes nothing
+bool viz_channel_pending( viz_channel * ch );
+
+#endif
@@ -0,0 +1,238 @@
+//-----------------------------------------------------------------------------
+// name: spectrogram.c
+// desc: scrolling spectrogram (waterfall) of the input and processed
+//       magnitudes for harmonicsGL2, with the detected peaks marked
+//
+//   texel (column, bin) holds the input level in red, the processed level
+//   in green and a peak flag in blue, so both panels and the overlay come
+//   from the same texture.  the engine already has these magnitudes; they
+//   only travel here through the snapshot.
+//-----------------------------------------------------------------------------
+#define GL_GLEXT_PROTOTYPES
+#include "spectrogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// OpenGL
+#ifdef __MACOSX_CORE__
+  #include <GLUT/glut.h>
+#else
+  #include <GL/gl.h>
+  #include <GL/glext.h>
+  #include <GL/glut.h>
+#endif
+
+static const char * g_vertex_source =
+  "#version 120\n"
+  "void main()\n"
+  "{\n"
+  "  gl_Position = ftransform( );\n"
+  "  gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+  "}\n";
+
+static const char * g_fragment_source =
+  "#version 120\n"
+  "uniform sampler2D ring;\n"
+  "uniform float head;\n"
+  "uniform float processed;\n"
+  "void main()\n"
+  "{\n"
+  "  vec4 t = texture2D( ring, vec2( gl_TexCoord[0].s + head, gl_TexCoord[0].t ) );\n"
+  "  float level = processed > 0.5 ? t.g : t.r;\n"
+  "  vec3 color = vec3( 1.0 - level, 1.0 - level, 1.0 - 0.6 * level );\n"
+  "  gl_FragColor = vec4( t.b > 0.5 ? vec3( 1.0, 0.2, 0.0 ) : color, 1.0 );\n"
+  "}\n";
+
+// program and uniforms
+static GLuint g_program = 0;
+static GLint g_u_ring, g_u_head, g_u_processed;
+
+// ring texture and the column about to be overwritten
+static GLuint g_texture = 0;
+static long g_columns = 0, g_bins = 0, g_writer = 0;
+
+// one column staged for upload
+static GLubyte * g_column = NULL;
+
+//-----------------------------------------------------------------------------
+// Name: compileShader( )
+// Desc: compile one stage, printing the log on failure
+//-----------------------------------------------------------------------------
+static GLuint compileShader( GLenum type, const char * source )
+{
+  GLuint shader = glCreateShader( type );
+  GLint ok = GL_FALSE;
+
+  glShaderSource( shader, 1, &source, NULL );
+  glCompileShader( shader );
+  glGetShaderiv( shader, GL_COMPILE_STATUS, &ok );
+  if( !ok )
+  {
+    char log[1024];
+    glGetShaderInfoLog( shader, sizeof(log), NULL, log );
+    printf( "Error: spectrogram shader: %s\n", log );
+    glDeleteShader( shader );
+    return 0;
+  }
+
+  return shader;
+}
+
+//-----------------------------------------------------------------------------
+// Name: spectrogram_init( )
+// Desc: shader and a blank ring texture
+//-----------------------------------------------------------------------------
+int spectrogram_init( long columns, long bins )
+{
+  GLuint vs, fs;
+  GLint ok = GL_FALSE;
+  GLubyte * blank;
+
+  g_columns = columns;
+  g_bins = bins;
+  g_writer = 0;
+
+  vs = compileShader( GL_VERTEX_SHADER, g_vertex_source );
+  fs = compileShader( GL_FRAGMENT_SHADER, g_fragment_source );
+  if( !vs || !fs )
+    return -1;
+
+  g_program = glCreateProgram( );
+  glAttachShader( g_program, vs );
+  glAttachShader( g_program, fs );
+  glLinkProgram( g_program );
+  glDeleteShader( vs );
+  glDeleteShader( fs );
+  glGetProgramiv( g_program, GL_LINK_STATUS, &ok );
+  if( !ok )
+  {
+    printf( "Error: could not link the spectrogram shader\n" );
+    return -1;
+  }
+
+  g_u_ring = glGetUniformLocation( g_program, "ring" );
+  g_u_head = glGetUniformLocation( g_program, "head" );
+  g_u_processed = glGetUniformLocation( g_program, "processed" );
+
+  g_column = (GLubyte *)malloc( bins * 4 );
+  blank = (GLubyte *)calloc( columns * bins, 4 );
+  if( !g_column || !blank )
+  {
+    free( blank );
+    return -1;
+  }
+
+  // width is time, height is frequency; repeat across s so the shader can
+  // scroll past the end of the ring
+  glGenTextures( 1, &g_texture );
+  glBindTexture( GL_TEXTURE_2D, g_texture );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei)columns, (GLsizei)bins, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, blank );
+  glBindTexture( GL_TEXTURE_2D, 0 );
+  free( blank );
+
+  return glGetError( ) == GL_NO_ERROR ? 0 : -1;
+}
+
+//-----------------------------------------------------------------------------
+// Name: spectrogram_shutdown( )
+// Desc: ...
+//-----------------------------------------------------------------------------
+void spectrogram_shutdown( )
+{
+  glDeleteTextures( 1, &g_texture );
+  glDeleteProgram( g_program );
+  g_texture = 0;
+  g_program = 0;
+  free( g_column );
+  g_column = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Name: level( )
+// Desc: magnitude to 0..255 between the floor and 0 dB
+//-----------------------------------------------------------------------------
+static GLubyte level( float magnitude )
+{
+  float db = 20.0f * log10f( magnitude + 1e-9f );
+  float v = ( db - SPECTROGRAM_FLOOR_DB ) / -SPECTROGRAM_FLOOR_DB;
+
+  if( v <= 0.0f ) return 0;
+  if( v >= 1.0f ) return 255;
+  return (GLubyte)( v * 255.0f );
+}
+
+//-----------------------------------------------------------------------------
+// Name: spectrogram_upload( )
+// Desc: one glTexSubImage2D per hop, at the ring's write position
+//-----------------------------------------------------------------------------
+void spectrogram_upload( const viz_frame * frame )
+{
+  long c, k;
+  long bins = frame->bins < g_bins ? frame->bins : g_bins;
+
+  glBindTexture( GL_TEXTURE_2D, g_texture );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+
+  for( c = 0; c < frame->columns; c++ )
+  {
+    const float * in = frame->column_input + c * frame->bins;
+    const float * out = frame->column_output + c * frame->bins;
+    const bool * peaks = frame->column_peaks + c * frame->bins;
+
+    for( k = 0; k < bins; k++ )
+    {
+      g_column[4*k] = level( in[k] );
+      g_column[4*k+1] = level( out[k] );
+      g_column[4*k+2] = peaks[k] ? 255 : 0;
+      g_column[4*k+3] = 255;
+    }
+
+    glTexSubImage2D( GL_TEXTURE_2D, 0, (GLint)g_writer, 0, 1, (GLsizei)bins,
+                     GL_RGBA, GL_UNSIGNED_BYTE, g_column );
+    g_writer = ( g_writer + 1 ) % g_columns;
+  }
+
+  glBindTexture( GL_TEXTURE_2D, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Name: drawPanel( )
+// Desc: one textured quad, bins upward, oldest hop on the left
+//-----------------------------------------------------------------------------
+static void drawPanel( GLfloat x0, GLfloat x1, GLfloat y0, GLfloat y1, GLfloat processed )
+{
+  glUniform1f( g_u_processed, processed );
+
+  glBegin( GL_QUADS );
+  glTexCoord2f( 0.0f, 0.0f ); glVertex3f( x0, y0, 0.0f );
+  glTexCoord2f( 1.0f, 0.0f ); glVertex3f( x1, y0, 0.0f );
+  glTexCoord2f( 1.0f, 1.0f ); glVertex3f( x1, y1, 0.0f );
+  glTexCoord2f( 0.0f, 1.0f ); glVertex3f( x0, y1, 0.0f );
+  glEnd( );
+}
+
+//-----------------------------------------------------------------------------
+// Name: drawSpectrogram( )
+// Desc: Draws the input and processed waterfalls between the windowed and
+//       scrolling time domain views
+//-----------------------------------------------------------------------------
+void drawSpectrogram( )
+{
+  glUseProgram( g_program );
+  glActiveTexture( GL_TEXTURE0 );
+  glBindTexture( GL_TEXTURE_2D, g_texture );
+  glUniform1i( g_u_ring, 0 );
+  glUniform1f( g_u_head, (GLfloat)g_writer / g_columns );
+
+  drawPanel( -5.4f, -0.1f, -2.0f, 1.2f, 0.0f );
+  drawPanel( 0.1f, 5.4f, -2.0f, 1.2f, 1.0f );
+
+  glBindTexture( GL_TEXTURE_2D, 0 );
+  glUseProgram( 0 );
+}
@@ -0,0 +1,29 @@
+//-----------------------------------------------------------------------------
+// name: spectrogram.h
+// desc: scrolling spectrogram (waterfall) of the input and processed
+//       magnitudes for harmonicsGL2, with the detected peaks marked
+//
+//   the history is a ring texture, one texel column per hop; each hop is
+//   written with one glTexSubImage2D and the shader scrolls by offsetting
+//   the texture coordinate, so nothing is re-uploaded
+//-----------------------------------------------------------------------------
+#ifndef __SPECTROGRAM_H__
+#define __SPECTROGRAM_H__
+
+#include "snapshot.h"
+
+// bottom of the color scale; magnitudes are mapped from here to 0 dB
+#define SPECTROGRAM_FLOOR_DB    -96.0f
+
+// texture of columns hops by bins bins; needs a current GL context (2.0 or
+// later).  returns 0 on success
+int  spectrogram_init( long columns, long bins );
+void spectrogram_shutdown( );
+
+// write the frame's columns over the oldest ones
+void spectrogram_upload( const viz_frame * frame );
+
+// input on the left, processed on the right, oldest hop at each panel's left
+void drawSpectrogram( );
+
+#endif
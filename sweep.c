@@ -0,0 +1,393 @@
+//-----------------------------------------------------------------------------
+// name: sweep.c
+// desc: parameter-sweep renderer - one clip through a grid of harmonics
+//       settings, analyzed once
+//
+//   renders an audio file (its first channel) once per combination of the
+//   second, third, fifth and threshold values given as comma-separated
+//   lists, e.g. -2 0,0.001,0.01 -3 0,0.001 gives six renders.  every
+//   render windows and transforms the same input frames, so the main
+//   thread runs that analysis once per block (engine_analyze()) and the
+//   workers fan it out: each runs harmonics generation, inverse ffts and
+//   overlap-add for its share of the parameter sets on an engine of its
+//   own (engine_process_analyzed()) and writes that set's output.  the
+//   previous-frame analysis works on each set's own output and is not
+//   shared.  parameters are fixed for the whole render (no easing).
+//
+//   outputs are dir/sweepNNN.wav (float, the clip's rate); the sets
+//   behind them and the time spent go to stdout as JSON, a table to
+//   stderr.
+//
+//   build:
+//     gcc -O2 -std=gnu99 -o sweep sweep.c engine.c fft.c fft_plan.c
+//         arena.c loopcache.c waveshaper.c partials.c pool.c realtime.c
+//         -lsndfile -lpthread -lm
+//   run:
+//     ./sweep [-w window] [-b block] [-j threads] [-o dir] [-2 list]
+//             [-3 list] [-5 list] [-t list] audio_file > sweep.json
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sndfile.h>
+#include "engine.h"
+
+#define SWEEP_MAX_VALUES    64      // per list
+#define SWEEP_MAX_SETS      1024
+#define SWEEP_MAX_THREADS   64
+
+// one list of the grid
+typedef struct
+{
+    float values[SWEEP_MAX_VALUES];
+    int count;
+} sweep_list;
+
+// the render shared by the main thread and the workers
+typedef struct
+{
+    int sets;
+    int threads;
+    engine_params * params;     // per set
+    harmonic_engine * engines;  // per set
+    SNDFILE ** outfiles;        // per set
+    float ** out;               // per set, block frames
+
+    // the block being rendered, written by the main thread between barriers
+    float * magnitude;          // block/hop frames of nbins
+    float * phase;
+    long frames;                // frames to process (whole hops)
+    long write;                 // frames to write out
+    bool finished;
+    int errors;
+
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+} sweep_job;
+
+typedef struct
+{
+    pthread_t thread;
+    int first;                  // renders sets first, first + threads, ...
+    sweep_job * job;
+} sweep_worker;
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: usage()
+// desc: print the options to stderr
+//-----------------------------------------------------------------------------
+static void usage( const char * name )
+{
+    fprintf( stderr, "Usage: %s [-w window] [-b block] [-j threads] [-o dir] [-2 list]\n"
+                     "          [-3 list] [-5 list] [-t list] audio_file\n"
+                     "  -w  window size, power of 2 (default 1024)\n"
+                     "  -b  frames per block, a multiple of window/2 (default 65536)\n"
+                     "  -j  worker threads (default: one per core)\n"
+                     "  -o  output directory (default .)\n"
+                     "  -2  2nd order harmonics gains, comma-separated (default 0.00001)\n"
+                     "  -3  3rd order harmonics gains (default 0.00001)\n"
+                     "  -5  5th order harmonics gains (default 0.00001)\n"
+                     "  -t  adaptive curve thresholds (default 0)\n", name );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: now()
+// desc: monotonic time in seconds
+//-----------------------------------------------------------------------------
+static double now( )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: parse_list()
+// desc: comma-separated floats into a list; returns 0 on success
+//-----------------------------------------------------------------------------
+static int parse_list( sweep_list * list, const char * text )
+{
+    char * end;
+
+    list->count = 0;
+    for( ;; )
+    {
+        if( list->count == SWEEP_MAX_VALUES )
+            return -1;
+        list->values[list->count++] = strtof( text, &end );
+        if( end == text )
+            return -1;
+        if( *end == '\0' )
+            return 0;
+        if( *end != ',' )
+            return -1;
+        text = end + 1;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: worker()
+// desc: render this worker's sets for each block the main thread analyzed
+//-----------------------------------------------------------------------------
+static void * worker( void * arg )
+{
+    sweep_worker * w = (sweep_worker *)arg;
+    sweep_job * job = w->job;
+    int k;
+
+    for( ;; )
+    {
+        pthread_barrier_wait( &job->start );
+        if( job->finished )
+            break;
+
+        for( k = w->first; k < job->sets; k += job->threads )
+        {
+            engine_process_analyzed( &job->engines[k], &job->params[k], job->magnitude,
+                                     job->phase, job->out[k], job->frames );
+            if( sf_writef_float( job->outfiles[k], job->out[k], job->write ) != job->write )
+                __atomic_add_fetch( &job->errors, 1, __ATOMIC_RELAXED );
+        }
+
+        pthread_barrier_wait( &job->done );
+    }
+
+    return NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: main()
+// desc: parse the lists, then render every set: analysis here, the rest
+//       on the workers, block by block
+//-----------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+    long window = 1024, block = 65536, frames, hops, pos, i;
+    const char * dir = ".";
+    sweep_list second, third, fifth, threshold;
+    int threads = (int)sysconf( _SC_NPROCESSORS_ONLN ), opt, k, a, b, c, d;
+    SF_INFO sfinfo;
+    SNDFILE * infile;
+    float * interleaved, * input;
+    harmonic_engine analyzer;
+    engine_config config;
+    sweep_job job;
+    sweep_worker workers[SWEEP_MAX_THREADS];
+    double t0, analysis = 0.0, wall;
+
+    parse_list( &second, "0.00001" );
+    parse_list( &third, "0.00001" );
+    parse_list( &fifth, "0.00001" );
+    parse_list( &threshold, "0" );
+
+    while( ( opt = getopt( argc, argv, "w:b:j:o:2:3:5:t:" ) ) != -1 )
+    {
+        int bad = 0;
+        switch( opt )
+        {
+            case 'w': window = atol( optarg ); break;
+            case 'b': block = atol( optarg ); break;
+            case 'j': threads = atoi( optarg ); break;
+            case 'o': dir = optarg; break;
+            case '2': bad = parse_list( &second, optarg ); break;
+            case '3': bad = parse_list( &third, optarg ); break;
+            case '5': bad = parse_list( &fifth, optarg ); break;
+            case 't': bad = parse_list( &threshold, optarg ); break;
+            default: bad = -1; break;
+        }
+        if( bad )
+        {
+            usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+    if( optind != argc - 1 || window < 64 || ( window & ( window - 1 ) ) ||
+        block < window / 2 || block % ( window / 2 ) || threads < 1 )
+    {
+        usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    job.sets = second.count * third.count * fifth.count * threshold.count;
+    if( job.sets > SWEEP_MAX_SETS )
+    {
+        fprintf( stderr, "Error: %d parameter sets, at most %d\n", job.sets, SWEEP_MAX_SETS );
+        return EXIT_FAILURE;
+    }
+    if( threads > job.sets ) threads = job.sets;
+    if( threads > SWEEP_MAX_THREADS ) threads = SWEEP_MAX_THREADS;
+    job.threads = threads;
+
+    // the whole clip, first channel, with a block and a hop of zeros past
+    // its end for the last block
+    memset( &sfinfo, 0, sizeof(sfinfo) );
+    infile = sf_open( argv[optind], SFM_READ, &sfinfo );
+    if( infile == NULL )
+    {
+        fprintf( stderr, "Error: could not open file: %s\n", argv[optind] );
+        return EXIT_FAILURE;
+    }
+    frames = (long)sfinfo.frames;
+    interleaved = (float *)malloc( frames * sfinfo.channels * sizeof(float) );
+    input = (float *)calloc( frames + block + window, sizeof(float) );
+    if( !interleaved || !input )
+    {
+        fprintf( stderr, "Error: out of memory\n" );
+        return EXIT_FAILURE;
+    }
+    frames = (long)sf_readf_float( infile, interleaved, frames );
+    for( i = 0; i < frames; i++ )
+        input[i] = interleaved[i * sfinfo.channels];
+    free( interleaved );
+    sf_close( infile );
+
+    // an engine per set, and one more for the analysis
+    config.window_size = window;
+    config.frames_per_buffer = block;
+    config.channels = 1;
+    config.huge_pages = false;
+    config.oversampling = 0;
+    config.threads = 1;         // the sets already run in parallel
+    hops = block / ( window / 2 );
+    job.params = (engine_params *)calloc( job.sets, sizeof(engine_params) );
+    job.engines = (harmonic_engine *)calloc( job.sets, sizeof(harmonic_engine) );
+    job.outfiles = (SNDFILE **)calloc( job.sets, sizeof(SNDFILE *) );
+    job.out = (float **)calloc( job.sets, sizeof(float *) );
+    job.magnitude = (float *)malloc( hops * ( window / 2 ) * sizeof(float) );
+    job.phase = (float *)malloc( hops * ( window / 2 ) * sizeof(float) );
+    if( !job.params || !job.engines || !job.outfiles || !job.out || !job.magnitude ||
+        !job.phase || engine_create( &analyzer, &config ) != 0 )
+    {
+        fprintf( stderr, "Error: out of memory\n" );
+        return EXIT_FAILURE;
+    }
+
+    k = 0;
+    for( a = 0; a < second.count; a++ )
+        for( b = 0; b < third.count; b++ )
+            for( c = 0; c < fifth.count; c++ )
+                for( d = 0; d < threshold.count; d++, k++ )
+                {
+                    engine_params * p = &job.params[k];
+                    SF_INFO outinfo;
+                    char path[1024];
+
+                    p->second = second.values[a];
+                    p->third = third.values[b];
+                    p->fifth = fifth.values[c];
+                    p->threshold = threshold.values[d];
+                    p->toggle = true;
+
+                    memset( &outinfo, 0, sizeof(outinfo) );
+                    outinfo.samplerate = sfinfo.samplerate;
+                    outinfo.channels = 1;
+                    outinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+                    snprintf( path, sizeof(path), "%s/sweep%03d.wav", dir, k );
+                    job.out[k] = (float *)malloc( block * sizeof(float) );
+                    job.outfiles[k] = sf_open( path, SFM_WRITE, &outinfo );
+                    if( !job.out[k] || !job.outfiles[k] ||
+                        engine_create( &job.engines[k], &config ) != 0 )
+                    {
+                        fprintf( stderr, "Error: could not set up %s\n", path );
+                        return EXIT_FAILURE;
+                    }
+                }
+
+    job.finished = false;
+    job.errors = 0;
+    pthread_barrier_init( &job.start, NULL, threads + 1 );
+    pthread_barrier_init( &job.done, NULL, threads + 1 );
+    for( k = 0; k < threads; k++ )
+    {
+        workers[k].first = k;
+        workers[k].job = &job;
+        if( pthread_create( &workers[k].thread, NULL, worker, &workers[k] ) != 0 )
+        {
+            fprintf( stderr, "Error: could not start worker thread\n" );
+            return EXIT_FAILURE;
+        }
+    }
+
+    // analyze a block, hand it to the workers, wait for them
+    wall = now( );
+    for( pos = 0; pos < frames; pos += block )
+    {
+        job.write = frames - pos < block ? frames - pos : block;
+        job.frames = ( job.write + window / 2 - 1 ) / ( window / 2 ) * ( window / 2 );
+
+        t0 = now( );
+        engine_analyze( &analyzer, input + pos, job.frames, job.magnitude, job.phase );
+        analysis += now( ) - t0;
+
+        pthread_barrier_wait( &job.start );
+        pthread_barrier_wait( &job.done );
+    }
+    job.finished = true;
+    pthread_barrier_wait( &job.start );
+    wall = now( ) - wall;
+
+    for( k = 0; k < threads; k++ )
+        pthread_join( workers[k].thread, NULL );
+    pthread_barrier_destroy( &job.start );
+    pthread_barrier_destroy( &job.done );
+
+    fprintf( stderr, "%s: %ld frames at %d Hz, window %ld, %d sets on %d threads\n",
+             argv[optind], frames, sfinfo.samplerate, window, job.sets, threads );
+    fprintf( stderr, "%-14s %10s %10s %10s %10s\n", "output", "second", "third", "fifth",
+             "threshold" );
+    printf( "{\n  \"benchmark\": \"sweep\",\n  \"file\": \"%s\", \"frames\": %ld, \"window\": %ld,"
+            " \"threads\": %d,\n  \"sets\": [\n", argv[optind], frames, window, threads );
+    for( k = 0; k < job.sets; k++ )
+    {
+        const engine_params * p = &job.params[k];
+        fprintf( stderr, "sweep%03d.wav   %10g %10g %10g %10g\n", k, p->second, p->third,
+                 p->fifth, p->threshold );
+        printf( "    { \"output\": \"sweep%03d.wav\", \"second\": %g, \"third\": %g, \"fifth\": %g,"
+                " \"threshold\": %g }%s\n", k, p->second, p->third, p->fifth, p->threshold,
+                k + 1 < job.sets ? "," : "" );
+        sf_close( job.outfiles[k] );
+        engine_destroy( &job.engines[k] );
+        free( job.out[k] );
+    }
+    fprintf( stderr, "%.3f s for %.1f s of audio per set (%.1fx realtime over all sets),"
+             " analysis %.3f s once\n", wall, (double)frames / sfinfo.samplerate,
+             (double)frames * job.sets / sfinfo.samplerate / wall, analysis );
+    printf( "  ],\n  \"wall_s\": %.6f, \"analysis_s\": %.6f, \"write_errors\": %d\n}\n", wall,
+            analysis, job.errors );
+
+    engine_destroy( &analyzer );
+    free( job.params );
+    free( job.engines );
+    free( job.outfiles );
+    free( job.out );
+    free( job.magnitude );
+    free( job.phase );
+    free( input );
+
+    if( job.errors )
+    {
+        fprintf( stderr, "Error: %d writes failed\n", job.errors );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,398 @@
+//-----------------------------------------------------------------------------
+// name: trace.c
+// desc: per-stage timing of the realtime callback (-DHARMONICS_TRACE)
+//-----------------------------------------------------------------------------
+#include "trace.h"
+
+#ifdef HARMONICS_TRACE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "histogram.h"
+
+#define TRACE_DRAIN_US      50000   // drain thread period
+
+typedef struct
+{
+    uint64_t start, end;    // clock ticks
+    uint32_t stage;
+    uint32_t arg;           // status flags for TRACE_XRUN
+} trace_event;
+
+// one producer thread's events; head is written by the producer only,
+// tail by the drain only
+typedef struct
+{
+    trace_event event[TRACE_RING_SIZE];
+    _Alignas(64) atomic_ulong head;
+    _Alignas(64) atomic_ulong tail;
+    atomic_ulong dropped;
+    atomic_ulong xruns;
+    atomic_llong headroom_min;  // smallest dac - current time seen, ns
+} trace_ring;
+
+static const char * g_stage_names[TRACE_STAGES] =
+{
+    "callback", "io", "params", "fft", "polar", "peaks", "harmonics",
+    "cartesian", "ifft", "overlap_add", "snapshot", "xrun"
+};
+
+static trace_ring g_rings[TRACE_MAX_THREADS];
+static atomic_int g_ring_count;
+static _Thread_local trace_ring * t_ring = NULL;
+static trace_hook g_hook = NULL;
+
+// drain side
+static latency_histogram g_stats[TRACE_STAGES];
+static pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t g_drain_thread;
+static atomic_bool g_running;
+static FILE * g_chrome = NULL;
+static bool g_chrome_first = true;
+static uint64_t g_origin;
+static double g_ns_per_tick = 1.0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: calibrate()
+// desc: ns per trace_now() tick
+//-----------------------------------------------------------------------------
+static double calibrate( void )
+{
+#if TRACE_USE_TSC
+    struct timespec a, b;
+    uint64_t t0, t1;
+
+    clock_gettime( CLOCK_MONOTONIC, &a );
+    t0 = trace_now( );
+    usleep( 20000 );
+    clock_gettime( CLOCK_MONOTONIC, &b );
+    t1 = trace_now( );
+
+    return ( ( b.tv_sec - a.tv_sec ) * 1e9 + ( b.tv_nsec - a.tv_nsec ) ) / (double)( t1 - t0 );
+#else
+    return 1.0;
+#endif
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: ring_claim()
+// desc: the calling thread's ring; claimed on first use with one atomic add
+//-----------------------------------------------------------------------------
+static trace_ring * ring_claim( void )
+{
+    int index;
+
+    if( t_ring )
+        return t_ring;
+
+    index = atomic_fetch_add( &g_ring_count, 1 );
+    if( index >= TRACE_MAX_THREADS )
+        return NULL;
+
+    t_ring = &g_rings[index];
+    return t_ring;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: push()
+// desc: one event onto the calling thread's ring, or count it as dropped
+//       if the ring is full
+//-----------------------------------------------------------------------------
+static void push( unsigned int stage, uint64_t start, uint64_t end, uint32_t arg )
+{
+    trace_ring * r = ring_claim( );
+    unsigned long head, tail;
+    trace_event * e;
+
+    if( !r )
+        return;
+
+    head = atomic_load_explicit( &r->head, memory_order_relaxed );
+    tail = atomic_load_explicit( &r->tail, memory_order_acquire );
+    if( head - tail >= TRACE_RING_SIZE )
+    {
+        atomic_fetch_add_explicit( &r->dropped, 1, memory_order_relaxed );
+        return;
+    }
+
+    e = &r->event[head & ( TRACE_RING_SIZE - 1 )];
+    e->start = start;
+    e->end = end;
+    e->stage = stage;
+    e->arg = arg;
+    atomic_store_explicit( &r->head, head + 1, memory_order_release );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_emit()
+// desc: queue one stage's span from the realtime side, then run the hook
+//-----------------------------------------------------------------------------
+void trace_emit( unsigned int stage, uint64_t start, uint64_t end )
+{
+    push( stage, start, end, 0 );
+
+    if( g_hook )
+        g_hook( stage );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_set_hook()
+// desc: install the per-stage callback trace_emit() makes
+//-----------------------------------------------------------------------------
+void trace_set_hook( trace_hook hook )
+{
+    g_hook = hook;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_callback()
+// desc: count xruns from the status flags and keep the smallest headroom
+//       between the callback and the dac
+//-----------------------------------------------------------------------------
+void trace_callback( unsigned long status_flags, double current_time, double dac_time )
+{
+    trace_ring * r = ring_claim( );
+    long long headroom;
+
+    if( !r )
+        return;
+
+    if( status_flags & TRACE_XRUN_FLAGS )
+    {
+        uint64_t now = trace_now( );
+        atomic_fetch_add_explicit( &r->xruns, 1, memory_order_relaxed );
+        push( TRACE_XRUN, now, now, (uint32_t)status_flags );
+    }
+
+    // some host apis report no times
+    if( dac_time > 0.0 && current_time > 0.0 )
+    {
+        headroom = (long long)( ( dac_time - current_time ) * 1e9 );
+        if( headroom < atomic_load_explicit( &r->headroom_min, memory_order_relaxed ) )
+            atomic_store_explicit( &r->headroom_min, headroom, memory_order_relaxed );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: drain()
+// desc: empty every ring into the histograms and the chrome trace
+//-----------------------------------------------------------------------------
+static void drain( void )
+{
+    int count = atomic_load( &g_ring_count ), i;
+
+    if( count > TRACE_MAX_THREADS )
+        count = TRACE_MAX_THREADS;
+
+    pthread_mutex_lock( &g_stats_lock );
+    for( i = 0; i < count; i++ )
+    {
+        trace_ring * r = &g_rings[i];
+        unsigned long tail = atomic_load_explicit( &r->tail, memory_order_relaxed );
+        unsigned long head = atomic_load_explicit( &r->head, memory_order_acquire );
+
+        for( ; tail != head; tail++ )
+        {
+            const trace_event * e = &r->event[tail & ( TRACE_RING_SIZE - 1 )];
+            double ts = ( e->start - g_origin ) * g_ns_per_tick * 1e-3;
+            double dur = ( e->end - e->start ) * g_ns_per_tick * 1e-3;
+
+            if( e->stage >= TRACE_STAGES )
+                continue;
+
+            if( e->stage != TRACE_XRUN )
+                histogram_record( &g_stats[e->stage], (uint64_t)( dur * 1e3 ) );
+
+            if( g_chrome )
+            {
+                if( e->stage == TRACE_XRUN )
+                    fprintf( g_chrome, "%s{\"name\":\"xrun\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,"
+                             "\"pid\":1,\"tid\":%d,\"args\":{\"flags\":%u}}",
+                             g_chrome_first ? "" : ",\n", ts, i, e->arg );
+                else
+                    fprintf( g_chrome, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"pid\":1,\"tid\":%d}", g_chrome_first ? "" : ",\n",
+                             g_stage_names[e->stage], ts, dur, i );
+                g_chrome_first = false;
+            }
+        }
+
+        atomic_store_explicit( &r->tail, tail, memory_order_release );
+    }
+    pthread_mutex_unlock( &g_stats_lock );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: drain_thread()
+// desc: drain() every TRACE_DRAIN_US until tracing stops, then once more
+//-----------------------------------------------------------------------------
+static void * drain_thread( void * arg )
+{
+    (void)arg;
+
+    while( atomic_load( &g_running ) )
+    {
+        drain( );
+        usleep( TRACE_DRAIN_US );
+    }
+    drain( );
+
+    return NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_setup()
+// desc: reset the rings and histograms, calibrate the clock, open the
+//       chrome trace if a path is given and start the drain thread
+//-----------------------------------------------------------------------------
+int trace_setup( const char * chrome_path )
+{
+    int i;
+
+    // touch every ring now rather than in the callback
+    memset( g_rings, 0, sizeof(g_rings) );
+    for( i = 0; i < TRACE_MAX_THREADS; i++ )
+        atomic_init( &g_rings[i].headroom_min, (long long)1e18 );
+    atomic_init( &g_ring_count, 0 );
+    for( i = 0; i < TRACE_STAGES; i++ )
+        histogram_init( &g_stats[i] );
+
+    g_ns_per_tick = calibrate( );
+    g_origin = trace_now( );
+
+    if( chrome_path )
+    {
+        g_chrome = fopen( chrome_path, "w" );
+        if( !g_chrome )
+        {
+            fprintf( stderr, "Error: could not open the trace file %s\n", chrome_path );
+            return -1;
+        }
+        fprintf( g_chrome, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+        g_chrome_first = true;
+    }
+
+    atomic_store( &g_running, true );
+    if( pthread_create( &g_drain_thread, NULL, drain_thread, NULL ) != 0 )
+    {
+        fprintf( stderr, "Error: could not start the trace drain thread\n" );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_shutdown()
+// desc: stop the drain after a last pass and close the chrome trace
+//-----------------------------------------------------------------------------
+void trace_shutdown( void )
+{
+    if( !atomic_exchange( &g_running, false ) )
+        return;
+
+    pthread_join( g_drain_thread, NULL );
+
+    if( g_chrome )
+    {
+        fprintf( g_chrome, "\n]}\n" );
+        fclose( g_chrome );
+        g_chrome = NULL;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_stage_name()
+// desc: name of a stage, as in the report and the chrome trace
+//-----------------------------------------------------------------------------
+const char * trace_stage_name( unsigned int stage )
+{
+    return stage < TRACE_STAGES ? g_stage_names[stage] : "unknown";
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: trace_report()
+// desc: per-stage times so far, with xruns, drops and headroom
+//-----------------------------------------------------------------------------
+void trace_report( FILE * out )
+{
+    int count = atomic_load( &g_ring_count ), i;
+    unsigned long xruns = 0, dropped = 0;
+    long long headroom = (long long)1e18;
+    double total;
+
+    if( count > TRACE_MAX_THREADS )
+        count = TRACE_MAX_THREADS;
+
+    pthread_mutex_lock( &g_stats_lock );
+    total = g_stats[TRACE_CALLBACK_TOTAL].sum;
+
+    fprintf( out, "%-12s %10s %10s %10s %10s %7s\n",
+             "stage", "count", "mean us", "p99 us", "max us", "share" );
+    for( i = 0; i < TRACE_XRUN; i++ )
+    {
+        const latency_histogram * h = &g_stats[i];
+        if( h->total == 0 )
+            continue;
+        fprintf( out, "%-12s %10lu %10.2f %10.2f %10.2f %6.1f%%\n", g_stage_names[i],
+                 (unsigned long)h->total, histogram_mean( h ) * 1e-3,
+                 histogram_percentile( h, 0.99 ) * 1e-3, h->max * 1e-3,
+                 total > 0.0 ? 100.0 * h->sum / total : 0.0 );
+    }
+    pthread_mutex_unlock( &g_stats_lock );
+
+    for( i = 0; i < count; i++ )
+    {
+        long long h = atomic_load( &g_rings[i].headroom_min );
+        xruns += atomic_load( &g_rings[i].xruns );
+        dropped += atomic_load( &g_rings[i].dropped );
+        if( h < headroom ) headroom = h;
+    }
+
+    fprintf( out, "xruns %lu, dropped events %lu", xruns, dropped );
+    if( headroom < (long long)1e18 )
+        fprintf( out, ", min dac headroom %.2f ms", headroom * 1e-6 );
+    fprintf( out, "\n" );
+}
+
+#endif
@@ -0,0 +1,116 @@
+//-----------------------------------------------------------------------------
+// name: trace.h
+// desc: per-stage timing of the realtime callback, compiled in only with
+//       -DHARMONICS_TRACE
+//
+//   the callback marks the end of each stage; every mark is one timestamp
+//   (clock_gettime, or rdtsc with -DHARMONICS_TRACE_TSC on x86) and one
+//   event pushed on a lock-free single-producer ring owned by the calling
+//   thread.  a full ring drops the event and counts it; the callback never
+//   waits.  a drain thread empties the rings into per-stage histograms and,
+//   if given a path, a Chrome trace (chrome://tracing, Perfetto).
+//   without HARMONICS_TRACE every TRACE_* macro expands to nothing.
+//
+//   usage:
+//     TRACE_SETUP( path );              // before the stream starts
+//     TRACE_START( t );                 // in the callback, declares t
+//     ...stage...
+//     TRACE_MARK( t, TRACE_FFT );       // [t, now) was the fft; t = now
+//     TRACE_RESTART( t );               // t = now, nothing emitted
+//     TRACE_CALLBACK( flags, now, dac ); // portaudio status and timing
+//     TRACE_REPORT( stdout );           // any time, from any thread
+//     TRACE_SHUTDOWN( );                // after the stream stops
+//-----------------------------------------------------------------------------
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// stages, in callback order
+enum
+{
+    TRACE_CALLBACK_TOTAL,   // whole callback
+    TRACE_IO,               // file read and channel split
+    TRACE_PARAMS,           // mailbox read and smoothing
+    TRACE_FFT,              // forward transforms
+    TRACE_POLAR,            // to magnitude and phase
+    TRACE_PEAKS,            // adaptive curve and peak picking
+    TRACE_HARMONICS,        // harmonics generation
+    TRACE_CARTESIAN,        // back to re/im
+    TRACE_IFFT,             // inverse transforms
+    TRACE_OVERLAP_ADD,      // overlap-add and frame swap
+    TRACE_SNAPSHOT,         // visualization hand-off
+    TRACE_XRUN,             // an xrun reported to the callback (instant)
+    TRACE_STAGES
+};
+
+// portaudio statusFlags bits that mean lost or late audio (input/output
+// underflow/overflow); priming output is not an xrun
+#define TRACE_XRUN_FLAGS    0x0fUL
+
+#ifdef HARMONICS_TRACE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(HARMONICS_TRACE_TSC) && ( defined(__x86_64__) || defined(__i386__) )
+#include <x86intrin.h>
+#define TRACE_USE_TSC       1
+#else
+#define TRACE_USE_TSC       0
+#endif
+
+#define TRACE_RING_SIZE     16384   // events per thread, a power of 2
+#define TRACE_MAX_THREADS   4
+
+static inline uint64_t trace_now( void )
+{
+#if TRACE_USE_TSC
+    return __rdtsc( );
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// prefault the rings, calibrate the clock and start the drain thread;
+// chrome_path may be NULL.  returns 0 on success
+int  trace_setup( const char * chrome_path );
+void trace_shutdown( void );
+void trace_report( FILE * out );
+const char * trace_stage_name( unsigned int stage );
+
+// realtime side
+void trace_emit( unsigned int stage, uint64_t start, uint64_t end );
+void trace_callback( unsigned long status_flags, double current_time, double dac_time );
+
+// called by trace_emit() at the end of every stage, on the emitting thread
+// (e.g. to read hardware counters); NULL to remove.  set it while the
+// stream is stopped
+typedef void (*trace_hook)( unsigned int stage );
+void trace_set_hook( trace_hook hook );
+
+#define TRACE_SETUP( path )         trace_setup( path )
+#define TRACE_SHUTDOWN( )           trace_shutdown( )
+#define TRACE_REPORT( out )         trace_report( out )
+#define TRACE_START( t )            uint64_t t = trace_now( )
+#define TRACE_MARK( t, stage )      do { uint64_t _now = trace_now( ); \
+                                         trace_emit( (stage), (t), _now ); \
+                                         (t) = _now; } while( 0 )
+#define TRACE_SPAN( t, stage )      trace_emit( (stage), (t), trace_now( ) )
+#define TRACE_RESTART( t )          ( (t) = trace_now( ) )
+#define TRACE_CALLBACK( flags, now, dac ) trace_callback( (flags), (now), (dac) )
+
+#else
+
+#define TRACE_SETUP( path )         ( 0 )
+#define TRACE_SHUTDOWN( )           ( (void)0 )
+#define TRACE_REPORT( out )         ( (void)0 )
+#define TRACE_START( t )
+#define TRACE_MARK( t, stage )      ( (void)0 )
+#define TRACE_SPAN( t, stage )      ( (void)0 )
+#define TRACE_RESTART( t )          ( (void)0 )
+#define TRACE_CALLBACK( flags, now, dac ) ( (void)0 )
+
+#endif
+
+#endif
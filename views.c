@@ -0,0 +1,563 @@
+//-----------------------------------------------------------------------------
+// name: views.c
+// desc: retained-mode waveform and spectrum views for harmonicsGL2
+//
+//   every view is a GL_LINE_STRIP over two vertex attributes: the vertex
+//   number, from a static buffer shared by all views, and the sample value,
+//   from a per-view buffer.  the vertex shader places x = x0 + (n + start) *
+//   xinc and scales y, so a block costs one buffer upload instead of one
+//   glVertex call per sample.
+//
+//   the windowed and spectrum buffers are orphaned and refilled per block;
+//   the scroll buffer is a ring on the GPU that only receives the new block.
+//   next to it sit the levels of a min/max pyramid over the same ring, and
+//   the scroll view draws the level whose bucket count matches the window
+//   width, so its cost follows the pixels rather than the history length.
+//   the spectrum is reduced on the cpu to one log-frequency point per pixel
+//   column, already in display units, through a map built per resize.
+//-----------------------------------------------------------------------------
+#define GL_GLEXT_PROTOTYPES
+#include "views.h"
+#include "pyramid.h"
+#include "logmap.h"
+#include "spectrogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+// OpenGL
+#ifdef __MACOSX_CORE__
+  #include <GLUT/glut.h>
+#else
+  #include <GL/gl.h>
+  #include <GL/glext.h>
+  #include <GL/glut.h>
+#endif
+
+#define ATTRIB_INDEX    0
+#define ATTRIB_VALUE    1
+
+static const char * g_vertex_source =
+  "#version 120\n"
+  "attribute float index;\n"
+  "attribute float value;\n"
+  "uniform float x0;\n"
+  "uniform float xinc;\n"
+  "uniform float start;\n"
+  "uniform float yscale;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix *\n"
+  "                vec4( x0 + ( index + start ) * xinc, yscale * value, 0.0, 1.0 );\n"
+  "  gl_FrontColor = gl_Color;\n"
+  "}\n";
+
+static const char * g_fragment_source =
+  "#version 120\n"
+  "void main()\n"
+  "{\n"
+  "  gl_FragColor = gl_Color;\n"
+  "}\n";
+
+// program and uniforms
+static GLuint g_program = 0;
+static GLint g_u_x0, g_u_xinc, g_u_start, g_u_yscale;
+
+// buffers
+static GLuint g_index_vbo = 0;
+static GLuint g_input_vbo = 0, g_output_vbo = 0;
+static GLuint g_scroll_vbo = 0;
+static GLuint g_magnitude_vbo = 0, g_curve_vbo = 0;
+
+// sizes and ring state
+static long g_block_frames = 0, g_scroll_frames = 0, g_bins = 0;
+static long g_frames = 0, g_valid_bins = 0;
+static long g_scroll_writer = 0, g_scroll_reader = 0;
+
+// min/max levels of the scroll ring, and the one being drawn
+static minmax_pyramid g_pyramid;
+static GLuint g_pyramid_vbo[PYRAMID_MAX_LEVELS];
+static int g_scroll_level = 0;
+
+// spectrum view: bins to log-frequency pixel columns, and the columns of
+// the latest block, magnitude then curve
+static logmap g_logmap;
+static float * g_columns = NULL;
+static long g_points = 0;
+static long g_index_count = 0;
+
+//-----------------------------------------------------------------------------
+// Name: compileShader( )
+// Desc: compile one stage, printing the log on failure
+//-----------------------------------------------------------------------------
+static GLuint compileShader( GLenum type, const char * source )
+{
+  GLuint shader = glCreateShader( type );
+  GLint ok = GL_FALSE;
+
+  glShaderSource( shader, 1, &source, NULL );
+  glCompileShader( shader );
+  glGetShaderiv( shader, GL_COMPILE_STATUS, &ok );
+  if( !ok )
+  {
+    char log[1024];
+    glGetShaderInfoLog( shader, sizeof(log), NULL, log );
+    printf( "Error: view shader: %s\n", log );
+    glDeleteShader( shader );
+    return 0;
+  }
+
+  return shader;
+}
+
+//-----------------------------------------------------------------------------
+// Name: streamBuffer( )
+// Desc: allocate a buffer that is refilled every block
+//-----------------------------------------------------------------------------
+static GLuint streamBuffer( long count )
+{
+  GLuint vbo;
+
+  glGenBuffers( 1, &vbo );
+  glBindBuffer( GL_ARRAY_BUFFER, vbo );
+  glBufferData( GL_ARRAY_BUFFER, count * sizeof(GLfloat), NULL, GL_STREAM_DRAW );
+
+  return vbo;
+}
+
+//-----------------------------------------------------------------------------
+// Name: buildLogmap( )
+// Desc: spectrum map and column storage for a view pixels columns wide
+//-----------------------------------------------------------------------------
+static int buildLogmap( long pixels )
+{
+  if( pixels > g_index_count ) pixels = g_index_count;
+  if( pixels == g_logmap.pixels )
+    return 0;
+
+  if( g_logmap.pixels )
+    logmap_destroy( &g_logmap );
+  free( g_columns );
+
+  g_columns = (float *)malloc( 2 * pixels * sizeof(float) );
+  if( !g_columns || logmap_create( &g_logmap, g_bins, pixels ) != 0 )
+  {
+    g_logmap.pixels = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: views_init( )
+// Desc: shader, static index buffer and per-view value buffers
+//-----------------------------------------------------------------------------
+int views_init( long block_frames, long scroll_frames, long bins )
+{
+  GLuint vs, fs;
+  GLint ok = GL_FALSE;
+  GLfloat * index;
+  long i, count;
+
+  g_block_frames = block_frames;
+  g_scroll_frames = scroll_frames;
+  g_bins = bins;
+
+  vs = compileShader( GL_VERTEX_SHADER, g_vertex_source );
+  fs = compileShader( GL_FRAGMENT_SHADER, g_fragment_source );
+  if( !vs || !fs )
+    return -1;
+
+  g_program = glCreateProgram( );
+  glAttachShader( g_program, vs );
+  glAttachShader( g_program, fs );
+  glBindAttribLocation( g_program, ATTRIB_INDEX, "index" );
+  glBindAttribLocation( g_program, ATTRIB_VALUE, "value" );
+  glLinkProgram( g_program );
+  glDeleteShader( vs );
+  glDeleteShader( fs );
+  glGetProgramiv( g_program, GL_LINK_STATUS, &ok );
+  if( !ok )
+  {
+    printf( "Error: could not link the view shader\n" );
+    return -1;
+  }
+
+  g_u_x0 = glGetUniformLocation( g_program, "x0" );
+  g_u_xinc = glGetUniformLocation( g_program, "xinc" );
+  g_u_start = glGetUniformLocation( g_program, "start" );
+  g_u_yscale = glGetUniformLocation( g_program, "yscale" );
+
+  // vertex numbers 0..n-1, enough for the longest view
+  count = scroll_frames;
+  if( block_frames > count ) count = block_frames;
+  if( bins > count ) count = bins;
+  index = (GLfloat *)malloc( count * sizeof(GLfloat) );
+  if( !index )
+    return -1;
+  for( i = 0; i < count; i++ )
+    index[i] = (GLfloat)i;
+
+  g_index_count = count;
+  glGenBuffers( 1, &g_index_vbo );
+  glBindBuffer( GL_ARRAY_BUFFER, g_index_vbo );
+  glBufferData( GL_ARRAY_BUFFER, count * sizeof(GLfloat), index, GL_STATIC_DRAW );
+  free( index );
+
+  g_input_vbo = streamBuffer( block_frames );
+  g_output_vbo = streamBuffer( block_frames );
+  glGenBuffers( 1, &g_magnitude_vbo );
+  glGenBuffers( 1, &g_curve_vbo );
+
+  // the scroll ring starts silent
+  glGenBuffers( 1, &g_scroll_vbo );
+  glBindBuffer( GL_ARRAY_BUFFER, g_scroll_vbo );
+  {
+    GLfloat * zeros = (GLfloat *)calloc( scroll_frames, sizeof(GLfloat) );
+    glBufferData( GL_ARRAY_BUFFER, scroll_frames * sizeof(GLfloat), zeros, GL_DYNAMIC_DRAW );
+    free( zeros );
+  }
+  g_scroll_writer = scroll_frames - block_frames;
+  g_scroll_reader = 0;
+
+  // and so do its min/max levels
+  if( pyramid_create( &g_pyramid, scroll_frames, block_frames ) != 0 )
+    return -1;
+  for( i = 1; i < g_pyramid.levels; i++ )
+  {
+    long floats = 2 * ( scroll_frames >> i );
+    glGenBuffers( 1, &g_pyramid_vbo[i] );
+    glBindBuffer( GL_ARRAY_BUFFER, g_pyramid_vbo[i] );
+    glBufferData( GL_ARRAY_BUFFER, floats * sizeof(GLfloat), g_pyramid.level[i], GL_DYNAMIC_DRAW );
+  }
+  // full detail, and a column per bin, until the first reshape says how
+  // wide we are
+  g_scroll_level = 0;
+  if( buildLogmap( bins ) != 0 )
+    return -1;
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+  return glGetError( ) == GL_NO_ERROR ? 0 : -1;
+}
+
+//-----------------------------------------------------------------------------
+// Name: views_shutdown( )
+// Desc: ...
+//-----------------------------------------------------------------------------
+void views_shutdown( )
+{
+  GLuint buffers[6] = { g_index_vbo, g_input_vbo, g_output_vbo,
+                        g_scroll_vbo, g_magnitude_vbo, g_curve_vbo };
+
+  glDeleteBuffers( 6, buffers );
+  glDeleteBuffers( g_pyramid.levels - 1, g_pyramid_vbo + 1 );
+  glDeleteProgram( g_program );
+  g_program = 0;
+  pyramid_destroy( &g_pyramid );
+  if( g_logmap.pixels )
+    logmap_destroy( &g_logmap );
+  free( g_columns );
+  g_columns = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Name: views_resize( )
+// Desc: pick the scroll level and rebuild the spectrum map for the window
+//       width (height is kept for the reshape signature; the map is
+//       per column)
+//-----------------------------------------------------------------------------
+void views_resize( int width, int height )
+{
+  (void)height;
+
+  g_scroll_level = pyramid_pick_level( &g_pyramid, width );
+  if( buildLogmap( width ) != 0 )
+    printf( "Error: could not map the spectrum to %d columns\n", width );
+}
+
+//-----------------------------------------------------------------------------
+// Name: views_project( )
+// Desc: map the view port to the client area and set up the camera
+//-----------------------------------------------------------------------------
+void views_project( int w, int h )
+{
+  // map the view port to the client area
+  glViewport( 0, 0, w, h );
+  // set the matrix mode to project
+  glMatrixMode( GL_PROJECTION );
+  // load the identity matrix
+  glLoadIdentity( );
+  // create the viewing frustum
+  //gluPerspective( 45.0, (GLfloat) w / (GLfloat) h, .05, 50.0 );
+  gluPerspective( 45.0, (GLfloat) w / (GLfloat) h, 1.0, 1000.0 );
+  // set the matrix mode to modelview
+  glMatrixMode( GL_MODELVIEW );
+  // load the identity matrix
+  glLoadIdentity( );
+  
+  // position the view point
+  //  void gluLookAt( GLdouble eyeX,
+  //                 GLdouble eyeY,
+  //                 GLdouble eyeZ,
+  //                 GLdouble centerX,
+  //                 GLdouble centerY,
+  //                 GLdouble centerZ,
+  //                 GLdouble upX,
+  //                 GLdouble upY,
+  //                 GLdouble upZ )
+  
+  gluLookAt( 0.0f, 0.0f, 10.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f );
+}
+
+//-----------------------------------------------------------------------------
+// Name: refill( )
+// Desc: orphan a stream buffer and upload new contents
+//-----------------------------------------------------------------------------
+static void refill( GLuint vbo, long size, const float * data, long count )
+{
+  glBindBuffer( GL_ARRAY_BUFFER, vbo );
+  glBufferData( GL_ARRAY_BUFFER, size * sizeof(GLfloat), NULL, GL_STREAM_DRAW );
+  glBufferSubData( GL_ARRAY_BUFFER, 0, count * sizeof(GLfloat), data );
+}
+
+//-----------------------------------------------------------------------------
+// Name: views_upload( )
+// Desc: new block: refill the windowed and spectrum buffers, write the block
+//       over the oldest one in the scroll ring
+//-----------------------------------------------------------------------------
+void views_upload( const viz_frame * frame )
+{
+  g_frames = frame->frames < g_block_frames ? frame->frames : g_block_frames;
+  g_valid_bins = frame->bins < g_bins ? frame->bins : g_bins;
+
+  refill( g_input_vbo, g_block_frames, frame->input, g_frames );
+  refill( g_output_vbo, g_block_frames, frame->output, g_frames );
+  // spectrum: loudest bin per pixel column, then 3*log10(v + 0.01)
+  if( g_logmap.pixels )
+  {
+    long pixels = g_logmap.pixels;
+    float * magnitude = g_columns, * curve = g_columns + pixels;
+
+    logmap_reduce( &g_logmap, frame->magnitude, g_valid_bins, magnitude );
+    logmap_reduce( &g_logmap, frame->adaptivecurve, g_valid_bins, curve );
+    fast_log10( g_columns, g_columns, 2 * pixels, 3.0f, 0.01f );
+
+    refill( g_magnitude_vbo, pixels, magnitude, pixels );
+    refill( g_curve_vbo, pixels, curve, pixels );
+    g_points = pixels;
+  }
+
+  // the scroll ring only advances by whole blocks
+  if( g_frames == g_block_frames )
+  {
+    int l;
+
+    glBindBuffer( GL_ARRAY_BUFFER, g_scroll_vbo );
+    glBufferSubData( GL_ARRAY_BUFFER, g_scroll_writer * sizeof(GLfloat),
+                     g_block_frames * sizeof(GLfloat), frame->output );
+
+    // refresh and upload the buckets this block covers, on every level
+    pyramid_update( &g_pyramid, frame->output, g_scroll_writer );
+    for( l = 1; l < g_pyramid.levels; l++ )
+    {
+      long first = 2 * ( g_scroll_writer >> l ), floats = 2 * ( g_block_frames >> l );
+      glBindBuffer( GL_ARRAY_BUFFER, g_pyramid_vbo[l] );
+      glBufferSubData( GL_ARRAY_BUFFER, first * sizeof(GLfloat), floats * sizeof(GLfloat),
+                       g_pyramid.level[l] + first );
+    }
+
+    // the block after the newest is the oldest; draw from there
+    g_scroll_reader = ( g_scroll_writer + g_block_frames ) % g_scroll_frames;
+    g_scroll_writer = g_scroll_reader;
+  }
+
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Name: drawStrip( )
+// Desc: line strip of count values starting at value number first
+//-----------------------------------------------------------------------------
+static void drawStrip( GLuint values, long first, long count, GLfloat x0,
+                       GLfloat xinc, GLfloat start, GLfloat yscale )
+{
+  if( count <= 0 )
+    return;
+
+  glUniform1f( g_u_x0, x0 );
+  glUniform1f( g_u_xinc, xinc );
+  glUniform1f( g_u_start, start );
+  glUniform1f( g_u_yscale, yscale );
+
+  glBindBuffer( GL_ARRAY_BUFFER, g_index_vbo );
+  glVertexAttribPointer( ATTRIB_INDEX, 1, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0 );
+  glBindBuffer( GL_ARRAY_BUFFER, values );
+  glVertexAttribPointer( ATTRIB_VALUE, 1, GL_FLOAT, GL_FALSE, 0,
+                         (const GLvoid *)( first * sizeof(GLfloat) ) );
+
+  glDrawArrays( GL_LINE_STRIP, 0, (GLsizei)count );
+}
+
+//-----------------------------------------------------------------------------
+// Name: beginViews( ) / endViews( )
+// Desc: bind the view program and attributes around a view's draws
+//-----------------------------------------------------------------------------
+static void beginViews( )
+{
+  glUseProgram( g_program );
+  glEnableVertexAttribArray( ATTRIB_INDEX );
+  glEnableVertexAttribArray( ATTRIB_VALUE );
+}
+
+static void endViews( )
+{
+  glDisableVertexAttribArray( ATTRIB_INDEX );
+  glDisableVertexAttribArray( ATTRIB_VALUE );
+  glBindBuffer( GL_ARRAY_BUFFER, 0 );
+  glUseProgram( 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Name: drawWindowedTimeDomain( )
+// Desc: Draws the Windowed Time Domain signal in the top of the screen
+//-----------------------------------------------------------------------------
+void drawWindowedTimeDomain( )
+{
+  // Initialize initial x
+  GLfloat x = -6.8;
+
+  // Calculate increment x
+  GLfloat xinc = fabs((2.1*x)/g_block_frames);
+
+  beginViews( );
+  glPushMatrix();
+  {
+    glTranslatef(0,2.5f,0.0f);
+
+    // Draw Pre-processing Windowed Time Domain
+    glColor3f(0., .2, 0.0);
+    drawStrip( g_input_vbo, 0, g_frames, x, xinc, 0.0f, 1.0f );
+
+    // Draw Post-processing Windowed Time Domain
+    glColor3f(.2, 0.0, 0.0);
+    drawStrip( g_output_vbo, 0, g_frames, x, xinc, 0.0f, 1.0f );
+  }
+  glPopMatrix();
+  endViews( );
+}
+
+//-----------------------------------------------------------------------------
+// Name: drawScrollingTimeDomain( )
+// Desc: Draws the scroll history, oldest block on the left; the ring is
+//       drawn as two strips, from the reader to the end and from the start.
+//       above level 0 each bucket is a min vertex and a max vertex, half a
+//       bucket apart
+//-----------------------------------------------------------------------------
+void drawScrollingTimeDomain( )
+{
+  // Initialize initial x
+  GLfloat x = -6.8;
+
+  // Calculate increment x
+  GLfloat xinc = fabs((2.5*x)/g_scroll_frames);
+
+  // ring of vertices on the chosen level
+  int l = g_scroll_level;
+  GLuint values = l ? g_pyramid_vbo[l] : g_scroll_vbo;
+  long per = l ? 2 : 1;
+  long vertices = per * ( g_scroll_frames >> l );
+  long reader = per * ( g_scroll_reader >> l );
+  long tail = vertices - reader;
+
+  xinc *= (GLfloat)( 1L << l ) / per;
+
+  beginViews( );
+  glPushMatrix();
+  {
+    glTranslatef(0.0, -3.0f, 0.0f);
+    glColor3f(0.2, 0.2, 1.0);
+
+    drawStrip( values, reader, tail, x, xinc, 0.0f, 0.7f );
+    drawStrip( values, 0, reader, x, xinc, (GLfloat)tail, 0.7f );
+  }
+  glPopMatrix();
+  endViews( );
+}
+
+//-----------------------------------------------------------------------------
+// Name: drawFrequencyDomain( )
+// Desc: Draws the input magnitude spectrum and the adaptive curve, one
+//       point per pixel column on a log-frequency axis
+//-----------------------------------------------------------------------------
+void drawFrequencyDomain( )
+{
+  // Initialize initial x
+  GLfloat x = -6.8;
+
+  // Calculate increment x, for the columns last uploaded
+  GLfloat xinc = g_points ? fabs((2.7*x)/g_points) : 0.0f;
+
+  beginViews( );
+  glPushMatrix();
+  {
+    glTranslatef(0,5.2f,0.0f);
+
+    glColor3f(1., .2, 0.0);
+    drawStrip( g_magnitude_vbo, 0, g_points, x, xinc, 0.0f, 1.0f );
+
+    glColor3f(.2, 0.0, 0.0);
+    drawStrip( g_curve_vbo, 0, g_points, x, xinc, 0.0f, 1.0f );
+  }
+  glPopMatrix();
+  endViews( );
+}
+
+//-----------------------------------------------------------------------------
+// Name: timeView( )
+// Desc: draw one view; when timing, wait for it to finish and add its time
+//-----------------------------------------------------------------------------
+static void timeView( void (*draw)( ), double * seconds )
+{
+  struct timespec t0, t1;
+
+  if( !seconds )
+  {
+    draw( );
+    return;
+  }
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  draw( );
+  glFinish( );
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  *seconds += ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) * 1e-9;
+}
+
+//-----------------------------------------------------------------------------
+// Name: views_draw( )
+// Desc: clear the color and depth buffers and draw the views
+//-----------------------------------------------------------------------------
+void views_draw( bool spectrogram, double * seconds )
+{
+  // start the first view's clock after the previous frame is done
+  if( seconds )
+    glFinish( );
+
+  glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+  // Windowed Time Domain
+  timeView( drawWindowedTimeDomain, seconds ? &seconds[VIEW_WINDOWED] : NULL );
+
+  // Scrolling Time Domain
+  timeView( drawScrollingTimeDomain, seconds ? &seconds[VIEW_SCROLLING] : NULL );
+
+  // draw magnitude and adaptive curve
+  timeView( drawFrequencyDomain, seconds ? &seconds[VIEW_FREQUENCY] : NULL );
+
+  // input and processed spectrogram with the peaks marked
+  if( spectrogram )
+    timeView( drawSpectrogram, seconds ? &seconds[VIEW_SPECTROGRAM] : NULL );
+}
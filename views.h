@@ -0,0 +1,40 @@
+//-----------------------------------------------------------------------------
+// name: views.h
+// desc: retained-mode waveform and spectrum views for harmonicsGL2
+//
+//   samples live in vertex buffer objects and only new data is uploaded per
+//   block; x positions come from one static index buffer and a shader
+//-----------------------------------------------------------------------------
+#ifndef __VIEWS_H__
+#define __VIEWS_H__
+
+#include <stdbool.h>
+#include "snapshot.h"
+
+// the views, in the order views_draw() draws them
+enum { VIEW_WINDOWED, VIEW_SCROLLING, VIEW_FREQUENCY, VIEW_SPECTROGRAM, VIEW_COUNT };
+
+// create buffers and the shader; needs a current GL context (2.0 or later)
+// returns 0 on success
+int  views_init( long block_frames, long scroll_frames, long bins );
+void views_shutdown( );
+
+// window size changed; picks the scroll view's level of detail
+void views_resize( int width, int height );
+
+// viewport, projection and camera for a width x height client area
+void views_project( int width, int height );
+
+// upload a newly published block
+void views_upload( const viz_frame * frame );
+
+// clear and draw every view.  with seconds (VIEW_COUNT entries) each view
+// is waited for and its time added to seconds[view], for benchmarking
+void views_draw( bool spectrogram, double * seconds );
+
+// the three views, in the positions harmonicsGL2 has always used
+void drawWindowedTimeDomain( );
+void drawScrollingTimeDomain( );
+void drawFrequencyDomain( );
+
+#endif
@@ -0,0 +1,317 @@
+//-----------------------------------------------------------------------------
+// name: waveshaper.c
+// desc: time-domain harmonics - Chebyshev waveshaping at 2x or 4x
+//-----------------------------------------------------------------------------
+#include "waveshaper.h"
+#include <string.h>
+#include <math.h>
+
+#define KAISER_BETA     8.0     // about 80 dB of stopband
+#define DC_POLE         0.999f  // DC blocker, a few Hz at 44.1 kHz
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: bessel_i0()
+// desc: modified Bessel function of the first kind, order 0 (series)
+//-----------------------------------------------------------------------------
+static double bessel_i0( double x )
+{
+    double sum = 1.0, term = 1.0;
+    int k;
+
+    for( k = 1; k < 32; k++ )
+    {
+        term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+        sum += term;
+    }
+
+    return sum;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: halfband_design()
+// desc: kaiser windowed halfband lowpass of 2K+1 taps h[t]; keeps the
+//       filtered phase g[i] = h[2i] (h[K] is 1/2, the other odd taps 0)
+//-----------------------------------------------------------------------------
+static void halfband_design( float * g, int K )
+{
+    const double pi = 4. * atan( 1. );
+    double h[2 * 64 + 1], sum = 0.0;
+    int t, i;
+
+    for( t = 0; t <= 2 * K; t++ )
+    {
+        double x = ( t - K ) / 2.0, r = ( t - K ) / (double)K;
+        double sinc = x == 0.0 ? 1.0 : sin( pi * x ) / ( pi * x );
+        h[t] = 0.5 * sinc * bessel_i0( KAISER_BETA * sqrt( 1.0 - r * r ) ) / bessel_i0( KAISER_BETA );
+    }
+
+    // the filtered phase carries half the DC gain
+    for( i = 0; i <= K; i++ )
+        sum += h[2 * i];
+    for( i = 0; i <= K; i++ )
+        g[i] = (float)( h[2 * i] * 0.5 / sum );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: stage_layout()
+// desc: carve a stage's taps and buffers (frames at its low rate)
+//-----------------------------------------------------------------------------
+static void stage_layout( halfband_stage * s, int K, long frames, arena * a )
+{
+    s->K = K;
+    s->g = (float *)arena_alloc( a, ( K + 1 ) * sizeof(float) );
+    s->up_in = (float *)arena_alloc( a, ( K + frames ) * sizeof(float) );
+    s->even = (float *)arena_alloc( a, ( K + frames ) * sizeof(float) );
+    s->odd = (float *)arena_alloc( a, ( K + frames ) * sizeof(float) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: layout()
+// desc: carve the shaper from an arena (or measure it)
+//-----------------------------------------------------------------------------
+static void layout( waveshaper * w, arena * a )
+{
+    stage_layout( &w->base, WAVESHAPER_TAPS_2X, w->frames, a );
+    if( w->factor == 4 )
+        stage_layout( &w->high, WAVESHAPER_TAPS_4X, 2 * w->frames, a );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: waveshaper_bytes()
+// desc: arena space of a shaper, from a dry run of its layout
+//-----------------------------------------------------------------------------
+size_t waveshaper_bytes( int factor, long frames )
+{
+    waveshaper w;
+    arena sizing;
+
+    memset( &w, 0, sizeof(w) );
+    w.factor = factor;
+    w.frames = frames;
+    arena_measure( &sizing );
+    layout( &w, &sizing );
+
+    return sizing.used;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: waveshaper_create_in()
+// desc: lay the stages out in a, design their halfband filters and clear
+//       the state; -1 on a bad factor or an arena too small
+//-----------------------------------------------------------------------------
+int waveshaper_create_in( waveshaper * w, int factor, long frames, arena * a )
+{
+    memset( w, 0, sizeof(*w) );
+    if( factor != 2 && factor != 4 )
+        return -1;
+
+    w->factor = factor;
+    w->frames = frames;
+    layout( w, a );
+    if( !w->base.odd || ( factor == 4 && !w->high.odd ) )
+        return -1;
+
+    halfband_design( w->base.g, w->base.K );
+    if( factor == 4 )
+        halfband_design( w->high.g, w->high.K );
+    waveshaper_reset( w );
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: waveshaper_reset()
+// desc: zero the filter histories and the DC blocker
+//-----------------------------------------------------------------------------
+void waveshaper_reset( waveshaper * w )
+{
+    halfband_stage * s[2] = { &w->base, &w->high };
+    int k;
+
+    for( k = 0; k < ( w->factor == 4 ? 2 : 1 ); k++ )
+    {
+        memset( s[k]->up_in, 0, s[k]->K * sizeof(float) );
+        memset( s[k]->even, 0, s[k]->K * sizeof(float) );
+        memset( s[k]->odd, 0, s[k]->K * sizeof(float) );
+    }
+    w->dc_x1 = w->dc_y1 = 0.0f;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: halfband_up()
+// desc: up_in[K..K+n) to twice the rate, as phases even[K..] and odd[K..]
+//         even[m] = 2 sum g[i] x[m-i]     odd[m] = x[m-(K-1)/2]
+//-----------------------------------------------------------------------------
+static void halfband_up( halfband_stage * s, long n )
+{
+    const int K = s->K;
+    float * restrict even = s->even + K;
+    float * restrict odd = s->odd + K;
+    const float * x = s->up_in + K;
+    long m;
+    int i;
+
+    // eight outputs at a time, summed over the taps in registers
+    for( m = 0; m < n; m += 8 )
+    {
+        float acc[8] = { 0.0f };
+        int k;
+        for( i = 0; i <= K; i++ )
+            for( k = 0; k < 8; k++ )
+                acc[k] += s->g[i] * x[m+k-i];
+        for( k = 0; k < 8; k++ )
+            even[m+k] = 2.0f * acc[k];
+    }
+    memcpy( odd, x - ( K - 1 ) / 2, n * sizeof(float) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: halfband_down()
+// desc: phases even[K..K+n) and odd[K..K+n) back to the low rate
+//         y[m] = sum g[i] even[m-i] + odd[m-(K+1)/2] / 2
+//-----------------------------------------------------------------------------
+static void halfband_down( const halfband_stage * s, float * restrict y, long n )
+{
+    const int K = s->K;
+    const float * even = s->even + K;
+    const float * restrict odd = s->odd + K - ( K + 1 ) / 2;
+    long m;
+    int i;
+
+    for( m = 0; m < n; m += 8 )
+    {
+        float acc[8];
+        int k;
+        for( k = 0; k < 8; k++ )
+            acc[k] = 0.5f * odd[m+k];
+        for( i = 0; i <= K; i++ )
+            for( k = 0; k < 8; k++ )
+                acc[k] += s->g[i] * even[m+k-i];
+        for( k = 0; k < 8; k++ )
+            y[m+k] = acc[k];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: stage_advance()
+// desc: keep the last K samples of each buffer as the next block's history
+//-----------------------------------------------------------------------------
+static void stage_advance( halfband_stage * s, long n )
+{
+    memmove( s->up_in, s->up_in + n, s->K * sizeof(float) );
+    memmove( s->even, s->even + n, s->K * sizeof(float) );
+    memmove( s->odd, s->odd + n, s->K * sizeof(float) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: shape()
+// desc: x + a2 (T2(c) + 1) + a3 T3(c) + a5 T5(c), c = x clamped to [-1, 1]
+//-----------------------------------------------------------------------------
+static void shape( float * restrict x, long n, float a2, float a3, float a5 )
+{
+    long m;
+
+    for( m = 0; m < n; m++ )
+    {
+        float c = x[m] > 1.0f ? 1.0f : ( x[m] < -1.0f ? -1.0f : x[m] );
+        float c2 = c * c;
+        x[m] += 2.0f * a2 * c2 + c * ( a3 * ( 4.0f * c2 - 3.0f ) +
+                                       a5 * ( ( 16.0f * c2 - 20.0f ) * c2 + 5.0f ) );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// name: waveshaper_process()
+// desc: up, shape, down, DC block
+//-----------------------------------------------------------------------------
+void waveshaper_process( waveshaper * w, float second, float third, float fifth,
+                         const float * in, float * out, long frames )
+{
+    halfband_stage * base = &w->base, * high = &w->high;
+    const float a2 = fminf( second * WAVESHAPER_GAIN_SCALE, 1.0f );
+    const float a3 = fminf( third * WAVESHAPER_GAIN_SCALE, 1.0f );
+    const float a5 = fminf( fifth * WAVESHAPER_GAIN_SCALE, 1.0f );
+    float x1 = w->dc_x1, y1 = w->dc_y1;
+    long m;
+
+    memcpy( base->up_in + base->K, in, frames * sizeof(float) );
+    halfband_up( base, frames );
+
+    if( w->factor == 2 )
+    {
+        shape( base->even + base->K, frames, a2, a3, a5 );
+        shape( base->odd + base->K, frames, a2, a3, a5 );
+    }
+    else
+    {
+        // interleave the 2x phases into the high stage's input, and the
+        // high stage's output back into the 2x phases
+        float * mid = high->up_in + high->K;
+        for( m = 0; m < frames; m++ )
+        {
+            mid[2 * m] = base->even[base->K + m];
+            mid[2 * m + 1] = base->odd[base->K + m];
+        }
+        halfband_up( high, 2 * frames );
+        shape( high->even + high->K, 2 * frames, a2, a3, a5 );
+        shape( high->odd + high->K, 2 * frames, a2, a3, a5 );
+        // keep the input history, then reuse the block as scratch
+        memmove( high->up_in, high->up_in + 2 * frames, high->K * sizeof(float) );
+        halfband_down( high, mid, 2 * frames );
+        for( m = 0; m < frames; m++ )
+        {
+            base->even[base->K + m] = mid[2 * m];
+            base->odd[base->K + m] = mid[2 * m + 1];
+        }
+        memmove( high->even, high->even + 2 * frames, high->K * sizeof(float) );
+        memmove( high->odd, high->odd + 2 * frames, high->K * sizeof(float) );
+    }
+
+    halfband_down( base, out, frames );
+    stage_advance( base, frames );
+
+    for( m = 0; m < frames; m++ )
+    {
+        float x = out[m];
+        out[m] = y1 = x - x1 + DC_POLE * y1;
+        x1 = x;
+    }
+    w->dc_x1 = x1;
+    w->dc_y1 = y1;
+}
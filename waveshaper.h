@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+// name: waveshaper.h
+// desc: time-domain harmonics - Chebyshev waveshaping at 2x or 4x
+//
+//   T_n(cos t) = cos(n t), so adding a * T_n(x) to a full-scale sinusoid x
+//   adds its nth harmonic at amplitude a; quieter input gets less of it
+//   (about A^n), which is how a saturating stage behaves.  the shaper adds
+//   T2 (less its DC), T3 and T5 weighted by the second, third and fifth
+//   gains, after clamping the input to [-1, 1] where the polynomials are
+//   bounded.  a DC blocker takes out what the even term leaves.
+//
+//   the 5th harmonic of anything above fs/10 folds back at the base rate,
+//   so the shaper runs oversampled: polyphase halfband FIR stages up and
+//   down (one for 2x, two for 4x), each split into its filtered phase
+//   (K+1 taps, eight outputs at a time with the sums kept in registers,
+//   which the compiler vectorizes at -O2) and its pure-delay phase.  the filters are linear phase;
+//   the whole chain delays by WAVESHAPER_LATENCY() base samples, against a
+//   window of latency and four ffts per hop for the spectral chain.
+//-----------------------------------------------------------------------------
+#ifndef __WAVESHAPER_H__
+#define __WAVESHAPER_H__
+
+#include <stddef.h>
+#include "arena.h"
+
+// halfband half-lengths (odd), kaiser windowed for about 80 dB: the base
+// rate stage passes to 0.42 fs, the 2x -> 4x stage only has to reject
+// from 3/4 of its band, where the images of the base band start
+#define WAVESHAPER_TAPS_2X      31
+#define WAVESHAPER_TAPS_4X      11
+
+// gains are what the players step by 1e-6 for the spectral chain: 1e-4
+// gives a harmonic 20 dB below a full-scale fundamental
+#define WAVESHAPER_GAIN_SCALE   1000.0f
+
+// delay of the chain in base rate samples at an oversampling factor
+#define WAVESHAPER_LATENCY( factor ) \
+    ( (factor) == 4 ? WAVESHAPER_TAPS_2X + WAVESHAPER_TAPS_4X / 2.0 : (double)WAVESHAPER_TAPS_2X )
+
+// one halfband stage between a rate and twice that rate
+typedef struct
+{
+    int K;                  // odd; 2K+1 taps, K+1 in the filtered phase
+    float * g;              // filtered phase taps, h[2i]
+    float * up_in;          // K history + frames, low rate input
+    float * even;           // K history + frames, each phase of the
+    float * odd;            //   high rate stream
+} halfband_stage;
+
+typedef struct
+{
+    int factor;             // 2 or 4
+    long frames;            // largest block
+    halfband_stage base;    // base rate <-> 2x
+    halfband_stage high;    // 2x <-> 4x, factor 4 only
+    float dc_x1, dc_y1;     // DC blocker state
+} waveshaper;
+
+// factor 2 or 4, blocks up to frames, carved from an arena
+// (waveshaper_bytes() of space); returns 0 on success
+int    waveshaper_create_in( waveshaper * w, int factor, long frames, arena * a );
+size_t waveshaper_bytes( int factor, long frames );
+// forget the signal so far (filter histories, DC blocker)
+void   waveshaper_reset( waveshaper * w );
+
+// frames samples of in (a multiple of 8), shaped, into out; gains as in
+// engine_params
+void   waveshaper_process( waveshaper * w, float second, float third, float fifth,
+                           const float * in, float * out, long frames );
+
+#endif